@@ -0,0 +1,92 @@
+#include "arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "sn3d.h"
+
+namespace arena {
+
+constexpr size_t HUGEPAGESIZE = 2 * 1024 * 1024;
+constexpr size_t MINCHUNKSIZE = 32 * HUGEPAGESIZE;
+constexpr size_t ALIGNMENT = 64;
+
+static const char *const usage_names[ARENA_USAGE_COUNT] = {
+    "elements", "ions", "levels", "transitions", "phixstargets", "phixs", "linelist", "ratecoeff",
+};
+
+static size_t bytes_by_usage[ARENA_USAGE_COUNT] = {0};
+static int allocs_by_usage[ARENA_USAGE_COUNT] = {0};
+
+static char *chunk_next = nullptr;  // next free byte in the current chunk
+static char *chunk_end = nullptr;
+static int chunk_count = 0;
+static int chunk_count_hugetlb = 0;
+static size_t mapped_bytes = 0;
+
+static void new_chunk(const size_t minbytes)
+// map a new chunk of at least minbytes, using explicit huge pages if the system has them reserved, otherwise
+// asking for transparent huge pages
+{
+  const size_t chunksize = std::max(MINCHUNKSIZE, (minbytes + HUGEPAGESIZE - 1) / HUGEPAGESIZE * HUGEPAGESIZE);
+
+  void *chunk = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  chunk = mmap(nullptr, chunksize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (chunk != MAP_FAILED) {
+    chunk_count_hugetlb++;
+  }
+#endif
+  if (chunk == MAP_FAILED) {
+    chunk = mmap(nullptr, chunksize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert_always(chunk != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+    madvise(chunk, chunksize, MADV_HUGEPAGE);
+#endif
+  }
+
+  chunk_next = static_cast<char *>(chunk);
+  chunk_end = chunk_next + chunksize;
+  chunk_count++;
+  mapped_bytes += chunksize;
+}
+
+void *alloc(const size_t bytes, const enum arena_usage usage) {
+  assert_always(usage >= 0 && usage < ARENA_USAGE_COUNT);
+  bytes_by_usage[usage] += bytes;
+  allocs_by_usage[usage]++;
+
+  if constexpr (!USE_ATOMIC_DATA_ARENA) {
+    void *ptr = calloc(std::max(bytes, static_cast<size_t>(1)), 1);
+    assert_always(ptr != nullptr);
+    return ptr;
+  }
+
+  const size_t alignedbytes = std::max((bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, ALIGNMENT);
+  if (chunk_next == nullptr || static_cast<size_t>(chunk_end - chunk_next) < alignedbytes) {
+    new_chunk(alignedbytes);
+  }
+
+  // anonymous mappings are zero-filled
+  void *ptr = chunk_next;
+  chunk_next += alignedbytes;
+  return ptr;
+}
+
+void report(void) {
+  size_t totalbytes = 0;
+  for (int usage = 0; usage < ARENA_USAGE_COUNT; usage++) {
+    printout("[info] mem_usage: atomic data %-12s %10.3f MB in %8d allocations\n", usage_names[usage],
+             bytes_by_usage[usage] / 1024. / 1024., allocs_by_usage[usage]);
+    totalbytes += bytes_by_usage[usage];
+  }
+  printout("[info] mem_usage: atomic data total %.3f MB\n", totalbytes / 1024. / 1024.);
+  if constexpr (USE_ATOMIC_DATA_ARENA) {
+    printout("[info] mem_usage: atomic data arena has %d chunks (%d with explicit huge pages) mapping %.3f MB\n",
+             chunk_count, chunk_count_hugetlb, mapped_bytes / 1024. / 1024.);
+  }
+}
+
+}  // namespace arena
@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+// Bump allocator for the atomic data, which is allocated once during input and never freed. With
+// USE_ATOMIC_DATA_ARENA, the blocks come from a few large mappings (huge pages where available) in the order that
+// they are allocated, which follows the element/ion/level traversal order. Otherwise calloc is used.
+
+namespace arena {
+
+enum arena_usage {
+  ARENA_ELEMENTS = 0,
+  ARENA_IONS = 1,
+  ARENA_LEVELS = 2,
+  ARENA_TRANSITIONS = 3,
+  ARENA_PHIXSTARGETS = 4,
+  ARENA_PHIXS = 5,
+  ARENA_LINELIST = 6,
+  ARENA_RATECOEFF = 7,
+  ARENA_USAGE_COUNT = 8,
+};
+
+// zero-initialised and aligned to a cache line. Not thread safe
+void *alloc(size_t bytes, enum arena_usage usage);
+
+template <typename T>
+T *alloc_array(const size_t count, const enum arena_usage usage) {
+  return static_cast<T *>(alloc(count * sizeof(T), usage));
+}
+
+void report(void);
+
+}  // namespace arena
+
+#endif  // ARENA_H
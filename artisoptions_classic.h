@@ -20,9 +20,25 @@ constexpr bool NLTE_POPS_ON = false;
 // solve the NLTE population matrix equation simultaneously for levels of all ions of an element
 constexpr bool NLTE_POPS_ALL_IONS_SIMULTANEOUS = false;
 
+// with NLTE_POPS_ALL_IONS_SIMULTANEOUS, solve the element rate matrix by block elimination over the ions
+// instead of a full LU decomposition (falls back to full LU if the blockwise solution fails)
+constexpr bool NLTE_POPS_BLOCKWISE_SOLVER = false;
+
+// with NLTE_POPS_ALL_IONS_SIMULTANEOUS, first try a BiCGSTAB solution (block Jacobi preconditioned) that starts from
+// the previous NLTE populations of the cell. Falls back to the direct solver if it does not converge
+constexpr bool NLTE_POPS_ITERATIVE_SOLVER = false;
+
 // maximum number of NLTE/Te/Spencer-Fano iterations
 constexpr int NLTEITER = 30;
 
+// in update_grid, keep the previous radiation field fit, T_e, and NLTE/non-thermal solutions for cells whose
+// estimators (per unit density) changed by less than UPDATEGRID_SKIP_NOISE_THRESHOLD times their relative Monte Carlo
+// noise since the last full solution. Needs MULTIBIN_RADFIELD_MODEL_ON for the packet contribution counts
+constexpr bool UPDATEGRID_SKIP_CONVERGED_CELLS = false;
+constexpr double UPDATEGRID_SKIP_NOISE_THRESHOLD = 1.;
+// force a full solution after this many consecutive skipped updates of a cell
+constexpr int UPDATEGRID_SKIP_MAX_CONSECUTIVE = 3;
+
 // this macro function determines which levels of which ions will be treated in full NLTE (if NLTE_POPS_ON is true)
 // for now, all NLTE levels should be contiguous and include the ground state
 // (i.e. level indices < X should return true for some X)
@@ -240,4 +256,103 @@ constexpr double FIXED_TIMESTEP_WIDTH = 0.1;
 
 constexpr double TIMESTEP_TRANSITION_TIME = 5;
 
+// use the inline xoshiro256++ random number generator instead of GSL's ran3 (changes the random number sequences,
+// so results will not be identical to runs with the GSL generator)
+constexpr bool USE_XOSHIRO_RNG = false;
+
+// use approximate exp/log/pow (relative error < 1e-7) in the packet transport kernels instead of libm
+constexpr bool USE_FAST_TRANSPORT_MATH = false;
+
+// with MPI, ranks that have finished their own packets for a timestep borrow batches of up to
+// MPI_PACKET_STEAL_BATCH_SIZE active packets from busy ranks, to reduce the waiting time at the end of update_packets
+constexpr bool MPI_PACKET_WORK_STEALING = false;
+constexpr int MPI_PACKET_STEAL_BATCH_SIZE = 1000;
+
+// pin OpenMP threads to cores, first touch the per-thread lists from the threads that use them, and (with MPI) share
+// read-mostly data between the ranks of a NUMA domain instead of a whole node
+constexpr bool NUMA_AWARE_MEMORY = false;
+
+// allocate the atomic data (element, ion, and level lists, transitions, photoionisation tables, line list, and rate
+// coefficient tables) from a bump allocator backed by huge pages (explicit if reserved, otherwise transparent) to
+// reduce TLB misses, instead of many separate calloc/malloc blocks
+constexpr bool USE_ATOMIC_DATA_ARENA = false;
+
+// write the estimators, radfield, and non-thermal spectrum output of each cell to a separate in-memory buffer inside
+// the parallel update_grid loop, and append the buffers to the files in modelgridindex order afterwards, instead of
+// serialising the threads on the file writes
+constexpr bool BUFFERED_CELL_OUTPUT = false;
+
+// write the restart data (gridsave and temporary packets files) every CHECKPOINT_INTERVAL_TIMESTEPS timesteps, or
+// sooner if CHECKPOINT_INTERVAL_SECONDS (if > 0) of wall time have passed since the last checkpoint. Restart data is
+// always written before stopping at the wall time limit and at the last timestep of the job
+constexpr int CHECKPOINT_INTERVAL_TIMESTEPS = 1;
+constexpr int CHECKPOINT_INTERVAL_SECONDS = 0;
+
+// log each escaped packet to escpkts_<rank>.bin as it escapes and keep running totals for the partial light curves
+// and spectra, instead of rescanning all packets every timestep. exspec reads the logs when they exist
+constexpr bool ESCAPED_PACKET_LOG = false;
+
+// write a formal-integral spectrum towards syn_dir every timestep (spec_formal_ts*.out), using rays on a grid of
+// FORMAL_INTEGRAL_NRAYS impact parameters per axis. Lines only (no continuum), so nebular phase only: the run stops
+// if the electron-scattering optical depth along a ray reaches 0.1
+constexpr bool FORMAL_INTEGRAL = false;
+constexpr int FORMAL_INTEGRAL_NRAYS = 100;
+
+// sample blackbody k-packet emission frequencies by inverting a tabulated Planck CDF (one random number per packet)
+// instead of by rejection over [nu_min_r, nu_max_r]
+constexpr bool PLANCK_INVERSE_CDF_SAMPLING = false;
+
+// choose the gamma-ray line of a decaying pellet from a precomputed alias table (constant time) instead of by a
+// linear search through the nuclide's lines
+constexpr bool GAMMA_LINE_ALIAS_SAMPLING = false;
+
+// evaluate the collisional ionisation and free-bound cooling rates from flat per-continuum arrays of the
+// temperature-independent factors (faster T_e solver iterations, same rates up to rounding)
+constexpr bool COOLING_RATES_FACTORISED = false;
+
+// when a rank has fewer non-empty cells than OpenMP threads, update the cells one at a time and divide the work within
+// each cell (elements in the NLTE solver, ions in the cooling and bf heating rates, rows of the Spencer-Fano matrix)
+constexpr bool INTRA_CELL_PARALLEL = false;
+
+// every RADFIELD_ADAPTIVE_BINNING_INTERVAL timesteps, re-derive the radiation field bin boundaries from the packet
+// counts in the bins (equal counts per bin, aligned with ground-level bf edges) with RADFIELD_ADAPTIVE_BINCOUNT bins
+constexpr bool RADFIELD_ADAPTIVE_BINNING = false;
+constexpr int RADFIELD_ADAPTIVE_BINNING_INTERVAL = 5;
+constexpr int RADFIELD_ADAPTIVE_BINCOUNT = RADFIELDBINCOUNT / 2;
+
+// at the start of each timestep, combine pairs of packets in cells with estimator noise (from the packet and radiation
+// field contribution counts) below ADAPTIVE_PACKET_COUNT_RELNOISE / 2, and split packets in cells above it
+constexpr bool ADAPTIVE_PACKET_COUNT = false;
+constexpr double ADAPTIVE_PACKET_COUNT_RELNOISE = 0.03;
+
+// split and Russian-roulette r-packets when their importance changes between update passes. The importance is
+// (mean density / cell density)^RPKT_IMPORTANCE_DENSITY_EXPONENT, clamped to a factor RPKT_IMPORTANCE_MAX either way,
+// times RPKT_IMPORTANCE_NU_FACTOR for rest-frame frequencies between RPKT_IMPORTANCE_NU_MIN and RPKT_IMPORTANCE_NU_MAX
+constexpr bool RPKT_SPLITTING_ROULETTE = false;
+constexpr double RPKT_IMPORTANCE_DENSITY_EXPONENT = 0.5;
+constexpr double RPKT_IMPORTANCE_MAX = 4.;
+constexpr double RPKT_IMPORTANCE_NU_MIN = (CLIGHT / (10000e-8));
+constexpr double RPKT_IMPORTANCE_NU_MAX = (CLIGHT / (3000e-8));
+constexpr double RPKT_IMPORTANCE_NU_FACTOR = 1.;
+
+// treat the lines as a binned expansion opacity on EXPANSION_OPACITY_NBINS log-spaced frequency bins from NU_MIN_R to
+// NU_MAX_R instead of one line at a time. An absorbed packet is thermalised with probability
+// EXPANSION_OPACITY_THERMALISATION_PROB, otherwise it activates the macroatom of a line chosen from the bin
+constexpr bool EXPANSION_OPACITY_BINNED = false;
+constexpr int EXPANSION_OPACITY_NBINS = 2000;
+constexpr double EXPANSION_OPACITY_THERMALISATION_PROB = 0.;
+
+// use a deterministic ray-traced gamma-ray deposition field (GAMMA_DEPOSITION_RAYTRACE_NRAYS rays from each cell with
+// a grey absorption opacity of globals::gamma_grey if positive, otherwise GAMMA_DEPOSITION_RAYTRACE_KAPPA [cm^2/g])
+// instead of the Monte Carlo path-length estimator for the gamma-ray deposition rates. Gamma-ray pellets then deposit
+// directly at positions drawn from this field, and the remaining gamma-ray packets escape without interacting
+constexpr bool GAMMA_DEPOSITION_RAYTRACE = false;
+constexpr int GAMMA_DEPOSITION_RAYTRACE_NRAYS = 256;
+constexpr double GAMMA_DEPOSITION_RAYTRACE_KAPPA = 0.03;
+
+// update_packets passes iterate over a shrinking list of active packet indices instead of sorting and scanning the
+// whole packet array. This changes the packet processing order and therefore the random number sequence.
+// Needed by ESCAPED_PACKET_LOG, RPKT_SPLITTING_ROULETTE and MPI_PACKET_WORK_STEALING
+constexpr bool UPDATE_PACKETS_ACTIVE_LIST = false;
+
 #endif  // ARTISOPTIONS_H
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "atomic.h"
 
+#include "arena.h"
 #include "artisoptions.h"
 #include "grid.h"
 #include "ltepop.h"
@@ -13,6 +14,17 @@ __managed__ int maxnions = 0;      // highest number of ions for any element
 __managed__ int includedions = 0;  // number of ions of any element
 int phixs_file_version = -1;       // 1 for phixsdata.txt (classic) and 2 for phixsdata_v2.txt
 
+// flat index tables and level attributes by unique level index, built by setup_atomic_index_tables()
+__managed__ static int includedlevels = 0;
+__managed__ static int *element_firstuniqueion = nullptr;  // [nelements + 1]
+__managed__ static int *ion_firstuniquelevel = nullptr;    // [includedions + 1]
+__managed__ static int *uniqueion_element = nullptr;       // [includedions]
+__managed__ static int *uniquelevel_uniqueion = nullptr;   // [includedlevels]
+__managed__ static double *level_epsilon = nullptr;
+__managed__ static float *level_stat_weight = nullptr;
+__managed__ static int *level_ndowntrans = nullptr;
+__managed__ static int *level_nuptrans = nullptr;
+
 __host__ __device__ static int get_continuumindex_phixstargetindex(const int element, const int ion, const int level,
                                                                    const int phixstargetindex)
 /// Returns the index of the continuum associated to the given level.
@@ -192,6 +204,13 @@ __host__ __device__ int get_includedions(void)
   return includedions;
 }
 
+__host__ __device__ int get_includedlevels(void)
+// returns the number of levels of all ions of all elements combined (available after setup_atomic_index_tables)
+{
+  assert_testmodeonly(ion_firstuniquelevel != nullptr);
+  return includedlevels;
+}
+
 __host__ __device__ void update_max_nions(const int nions)
 // Will ensure that maxnions is always greater than or equal to the number of nions
 // this is called at startup once per element with the number of ions
@@ -256,16 +275,67 @@ __host__ __device__ int get_ionisinglevels(const int element, const int ion)
   return globals::elements[element].ions[ion].ionisinglevels;
 }
 
+void setup_atomic_index_tables(void)
+// prefix offsets of the ions and levels of each element and ion, and the reverse lookups, so that the unique
+// index accessors are array loads. Call once after the atomic data has been read
+{
+  element_firstuniqueion = arena::alloc_array<int>(get_nelements() + 1, arena::ARENA_ELEMENTS);
+  ion_firstuniquelevel = arena::alloc_array<int>(includedions + 1, arena::ARENA_IONS);
+  uniqueion_element = arena::alloc_array<int>(includedions, arena::ARENA_IONS);
+
+  int uniqueionindex = 0;
+  int uniquelevelindex = 0;
+  for (int element = 0; element < get_nelements(); element++) {
+    element_firstuniqueion[element] = uniqueionindex;
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      assert_always(globals::elements[element].ions[ion].uniqueionindex == uniqueionindex);
+      ion_firstuniquelevel[uniqueionindex] = uniquelevelindex;
+      uniqueion_element[uniqueionindex] = element;
+      uniquelevelindex += get_nlevels(element, ion);
+      uniqueionindex++;
+    }
+  }
+  assert_always(uniqueionindex == includedions);
+  element_firstuniqueion[get_nelements()] = includedions;
+  ion_firstuniquelevel[includedions] = uniquelevelindex;
+  includedlevels = uniquelevelindex;
+
+  uniquelevel_uniqueion = arena::alloc_array<int>(includedlevels, arena::ARENA_LEVELS);
+  auto *const epsilons = arena::alloc_array<double>(includedlevels, arena::ARENA_LEVELS);
+  auto *const stat_weights = arena::alloc_array<float>(includedlevels, arena::ARENA_LEVELS);
+  auto *const ndowntrans = arena::alloc_array<int>(includedlevels, arena::ARENA_LEVELS);
+  auto *const nuptrans = arena::alloc_array<int>(includedlevels, arena::ARENA_LEVELS);
+  for (int uniqueion = 0; uniqueion < includedions; uniqueion++) {
+    const int element = uniqueion_element[uniqueion];
+    const int ion = uniqueion - element_firstuniqueion[element];
+    for (int level = 0; level < get_nlevels(element, ion); level++) {
+      const int index = ion_firstuniquelevel[uniqueion] + level;
+      const struct levellist_entry *levelentry = &globals::elements[element].ions[ion].levels[level];
+      assert_always(levelentry->uniquelevelindex == index);
+      uniquelevel_uniqueion[index] = uniqueion;
+      epsilons[index] = levelentry->epsilon;
+      stat_weights[index] = levelentry->stat_weight;
+      ndowntrans[index] = levelentry->ndowntrans;
+      nuptrans[index] = levelentry->nuptrans;
+    }
+  }
+
+  // the accessors switch to the flat arrays once these are set
+  level_epsilon = epsilons;
+  level_stat_weight = stat_weights;
+  level_ndowntrans = ndowntrans;
+  level_nuptrans = nuptrans;
+
+  printout("atomic index tables: %d elements, %d ions, %d levels\n", get_nelements(), includedions, includedlevels);
+}
+
 __host__ __device__ int get_uniqueionindex(const int element, const int ion)
 // Get an index for an ionstage of an element that is unique for every ion of every element
 {
+  assert_testmodeonly(element_firstuniqueion != nullptr);
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
-  int index = 0;
-  for (int e = 0; e < element; e++) {
-    index += get_nions(e);
-  }
-  index += ion;
+  const int index = element_firstuniqueion[element] + ion;
 
   assert_testmodeonly(index == globals::elements[element].ions[ion].uniqueionindex);
   assert_testmodeonly(index < includedions);
@@ -273,42 +343,21 @@ __host__ __device__ int get_uniqueionindex(const int element, const int ion)
 }
 
 __host__ __device__ void get_ionfromuniqueionindex(const int allionsindex, int *element, int *ion) {
-  int allionsindex_thiselementfirstion = 0;
-  for (int e = 0; e < get_nelements(); e++) {
-    if ((allionsindex - allionsindex_thiselementfirstion) >= get_nions(e)) {
-      allionsindex_thiselementfirstion += get_nions(e);  // skip this element
-    } else {
-      *element = e;
-      *ion = allionsindex - allionsindex_thiselementfirstion;
-      assert_testmodeonly(get_uniqueionindex(*element, *ion) == allionsindex);
-      return;
-    }
-  }
-  assert_always(false);  // allionsindex too high to be valid
-  *element = -1;
-  *ion = -1;
+  assert_always(allionsindex >= 0 && allionsindex < includedions);  // allionsindex too high to be valid
+  *element = uniqueion_element[allionsindex];
+  *ion = allionsindex - element_firstuniqueion[*element];
+  assert_testmodeonly(get_uniqueionindex(*element, *ion) == allionsindex);
 }
 
 __host__ __device__ int get_uniquelevelindex(const int element, const int ion, const int level)
 // Get an index for level of an ionstage of an element that is unique across every ion of every element
 {
+  assert_testmodeonly(ion_firstuniquelevel != nullptr);
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
 
-  int index = 0;
-  for (int e = 0; e < element; e++) {
-    const int nions = get_nions(e);
-    for (int i = 0; i < nions; i++) {
-      index += get_nlevels(e, i);
-    }
-  }
-  // selected element, levels from lower ions
-  for (int i = 0; i < ion; i++) {
-    index += get_nlevels(element, i);
-  }
-  // lower levels in selected element/ion
-  index += level;
+  const int index = ion_firstuniquelevel[element_firstuniqueion[element] + ion] + level;
 
   assert_testmodeonly(index == globals::elements[element].ions[ion].levels[level].uniquelevelindex);
   return index;
@@ -317,25 +366,12 @@ __host__ __device__ int get_uniquelevelindex(const int element, const int ion, c
 __host__ __device__ void get_levelfromuniquelevelindex(const int alllevelsindex, int *element, int *ion, int *level)
 // inverse of get_uniquelevelindex(). get the element/ion/level from a unique level index
 {
-  int allionsindex_thisionfirstlevel = 0;
-  for (int e = 0; e < get_nelements(); e++) {
-    const int nions = get_nions(e);
-    for (int i = 0; i < nions; i++) {
-      if ((alllevelsindex - allionsindex_thisionfirstlevel) >= get_nlevels(e, i)) {
-        allionsindex_thisionfirstlevel += get_nlevels(e, i);  // skip this ion
-      } else {
-        *element = e;
-        *ion = i;
-        *level = alllevelsindex - allionsindex_thisionfirstlevel;
-        assert_testmodeonly(get_uniquelevelindex(*element, *ion, *level) == alllevelsindex);
-        return;
-      }
-    }
-  }
-  assert_always(false);  // alllevelsindex too high to be valid
-  *element = -1;
-  *ion = -1;
-  *level = -1;
+  assert_always(alllevelsindex >= 0 && alllevelsindex < includedlevels);  // alllevelsindex too high to be valid
+  const int uniqueionindex = uniquelevel_uniqueion[alllevelsindex];
+  *element = uniqueion_element[uniqueionindex];
+  *ion = uniqueionindex - element_firstuniqueion[*element];
+  *level = alllevelsindex - ion_firstuniquelevel[uniqueionindex];
+  assert_testmodeonly(get_uniquelevelindex(*element, *ion, *level) == alllevelsindex);
 }
 
 __host__ __device__ double epsilon(const int element, const int ion, const int level)
@@ -344,6 +380,9 @@ __host__ __device__ double epsilon(const int element, const int ion, const int l
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
+  if (level_epsilon != nullptr) {
+    return level_epsilon[get_uniquelevelindex(element, ion, level)];
+  }
   return globals::elements[element].ions[ion].levels[level].epsilon;
 }
 
@@ -353,6 +392,9 @@ __host__ __device__ double stat_weight(const int element, const int ion, const i
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
+  if (level_stat_weight != nullptr) {
+    return level_stat_weight[get_uniquelevelindex(element, ion, level)];
+  }
   return globals::elements[element].ions[ion].levels[level].stat_weight;
 }
 
@@ -376,6 +418,9 @@ __host__ __device__ int get_ndowntrans(const int element, const int ion, const i
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
+  if (level_ndowntrans != nullptr) {
+    return level_ndowntrans[get_uniquelevelindex(element, ion, level)];
+  }
   return globals::elements[element].ions[ion].levels[level].ndowntrans;
 }
 
@@ -385,6 +430,9 @@ __host__ __device__ int get_nuptrans(const int element, const int ion, const int
   assert_testmodeonly(element < get_nelements());
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
+  if (level_nuptrans != nullptr) {
+    return level_nuptrans[get_uniquelevelindex(element, ion, level)];
+  }
   return globals::elements[element].ions[ion].levels[level].nuptrans;
 }
 
@@ -395,6 +443,9 @@ __host__ __device__ void set_ndowntrans(const int element, const int ion, const
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
   globals::elements[element].ions[ion].levels[level].ndowntrans = ndowntrans;
+  if (level_ndowntrans != nullptr) {
+    level_ndowntrans[get_uniquelevelindex(element, ion, level)] = ndowntrans;
+  }
 }
 
 __host__ __device__ void set_nuptrans(const int element, const int ion, const int level, const int nuptrans)
@@ -404,6 +455,9 @@ __host__ __device__ void set_nuptrans(const int element, const int ion, const in
   assert_testmodeonly(ion < get_nions(element));
   assert_testmodeonly(level < get_nlevels(element, ion));
   globals::elements[element].ions[ion].levels[level].nuptrans = nuptrans;
+  if (level_nuptrans != nullptr) {
+    level_nuptrans[get_uniquelevelindex(element, ion, level)] = nuptrans;
+  }
 }
 
 __host__ __device__ int get_nphixstargets(const int element, const int ion, const int level)
@@ -26,6 +26,7 @@ __host__ __device__ int get_element(int element);
 __host__ __device__ int get_elementindex(int Z);
 __host__ __device__ void increase_includedions(int nions);
 __host__ __device__ int get_includedions(void);
+__host__ __device__ int get_includedlevels(void);
 __host__ __device__ void update_max_nions(const int nions);
 __host__ __device__ int get_max_nions(void);
 __host__ __device__ int get_nions(int element);
@@ -34,6 +35,7 @@ __host__ __device__ int get_nlevels(int element, int ion);
 __host__ __device__ int get_nlevels_nlte(int element, int ion);
 __host__ __device__ int get_nlevels_groundterm(int element, int ion);
 __host__ __device__ int get_ionisinglevels(int element, int ion);
+void setup_atomic_index_tables(void);
 __host__ __device__ int get_uniqueionindex(int element, int ion);
 __host__ __device__ void get_ionfromuniqueionindex(int allionsindex, int *element, int *ion);
 __host__ __device__ int get_uniquelevelindex(const int element, const int ion, const int level);
@@ -0,0 +1,68 @@
+#include "celloutput.h"
+
+#include <cstdlib>
+
+#include "sn3d.h"
+
+namespace celloutput {
+
+void init(struct bufferedfile *bf, FILE *file, const int ncells) {
+  bf->file = file;
+  if constexpr (BUFFERED_CELL_OUTPUT) {
+    bf->streams.assign(ncells, NULL);
+    bf->buffers.assign(ncells, NULL);
+    bf->sizes.assign(ncells, 0);
+  }
+}
+
+FILE *cellstream(struct bufferedfile *bf, const int mgi) {
+  if constexpr (!BUFFERED_CELL_OUTPUT) {
+    return bf->file;
+  }
+
+  assert_always(mgi >= 0 && mgi < static_cast<int>(bf->streams.size()));
+  if (bf->streams[mgi] == NULL) {
+    bf->streams[mgi] = open_memstream(&bf->buffers[mgi], &bf->sizes[mgi]);
+    assert_always(bf->streams[mgi] != NULL);
+  }
+  return bf->streams[mgi];
+}
+
+static void close_cell(struct bufferedfile *bf, const int mgi)
+// close the memory stream, which makes buffers[mgi] and sizes[mgi] valid
+{
+  if (bf->streams[mgi] != NULL) {
+    fclose(bf->streams[mgi]);
+    bf->streams[mgi] = NULL;
+  }
+}
+
+void discard_cell(struct bufferedfile *bf, const int mgi) {
+  if constexpr (BUFFERED_CELL_OUTPUT) {
+    close_cell(bf, mgi);
+    free(bf->buffers[mgi]);
+    bf->buffers[mgi] = NULL;
+    bf->sizes[mgi] = 0;
+  }
+}
+
+void flush(struct bufferedfile *bf) {
+  if constexpr (BUFFERED_CELL_OUTPUT) {
+    if (bf->file == NULL) {
+      return;
+    }
+    const int ncells = bf->streams.size();
+    for (int mgi = 0; mgi < ncells; mgi++) {
+      close_cell(bf, mgi);
+      if (bf->buffers[mgi] != NULL) {
+        fwrite(bf->buffers[mgi], 1, bf->sizes[mgi], bf->file);
+        discard_cell(bf, mgi);
+      }
+    }
+  }
+  if (bf->file != NULL) {
+    fflush(bf->file);
+  }
+}
+
+}  // namespace celloutput
@@ -0,0 +1,35 @@
+#ifndef CELLOUTPUT_H
+#define CELLOUTPUT_H
+
+#include <cstdio>
+#include <vector>
+
+// Text output files that are written per model grid cell from inside the parallel loop in update_grid. With
+// BUFFERED_CELL_OUTPUT, each cell is written to its own in-memory stream without locking, and the streams are
+// appended to the file in modelgridindex order by flush(). Otherwise, cellstream() returns the file itself and the
+// caller must serialise the writes.
+
+namespace celloutput {
+
+struct bufferedfile {
+  FILE *file;
+  std::vector<FILE *> streams;  // open memory stream for each cell with pending output, or NULL
+  std::vector<char *> buffers;
+  std::vector<size_t> sizes;
+};
+
+// call outside of parallel regions
+void init(struct bufferedfile *bf, FILE *file, int ncells);
+
+// the stream to write cell mgi's output to. Safe to call concurrently for different cells
+FILE *cellstream(struct bufferedfile *bf, int mgi);
+
+// discard the pending output of cell mgi (buffered mode only)
+void discard_cell(struct bufferedfile *bf, int mgi);
+
+// write the pending output of all cells in modelgridindex order. Call outside of parallel regions
+void flush(struct bufferedfile *bf);
+
+}  // namespace celloutput
+
+#endif  // CELLOUTPUT_H
@@ -724,7 +724,7 @@ __host__ __device__ static double sample_decaytime(const int decaypathindex, con
     for (int i = 0; i < get_decaypathlength(decaypathindex); i++) {
       const int z = decaypaths[decaypathindex].z[i];
       const int a = decaypaths[decaypathindex].a[i];
-      const double zrand = gsl_rng_uniform_pos(rng);
+      const double zrand = rng_uniform_pos();
       tdecay += -get_meanlife(z, a) * log(zrand);
     }
   }
@@ -1110,7 +1110,7 @@ void setup_decaypath_energy_per_mass(void) {
   printout("done.\n");
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   printout("Calculating for decaypath_energy_per_mass for all cells...");
@@ -1127,7 +1127,7 @@ void setup_decaypath_energy_per_mass(void) {
   printout("done.\n");
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 }
 
@@ -1173,6 +1173,33 @@ __host__ __device__ double get_particle_injection_rate(const int modelgridindex,
   return dep_sum;
 }
 
+double get_gamma_emission_rate(const int modelgridindex, const double t)
+// energy release rate in form of gamma rays [erg/s/g]
+{
+  double emission_sum = 0.;
+  for (int nucindex = 0; nucindex < get_num_nuclides(); nucindex++) {
+    const int z = get_nuc_z(nucindex);
+    if (z < 1) {
+      continue;
+    }
+    const int a = get_nuc_a(nucindex);
+    const double meanlife = get_meanlife(z, a);
+    if (meanlife <= 0.) {
+      continue;
+    }
+    const double en_gamma = nucdecayenergygamma(z, a);
+    if (en_gamma > 0.) {
+      const double nucdecayrate = get_nuc_massfrac(modelgridindex, z, a, t) / meanlife;
+      assert_always(nucdecayrate >= 0);
+      emission_sum += nucdecayrate * en_gamma / nucmass(z, a);
+    }
+  }
+
+  assert_always(std::isfinite(emission_sum));
+
+  return emission_sum;
+}
+
 double get_qdot_modelcell(const int modelgridindex, const double t, const int decaytype)
 // energy release rate [erg/s/g] including everything (even neutrinos that are ignored elsewhere)
 {
@@ -1385,7 +1412,7 @@ void setup_radioactive_pellet(const double e0, const int mgi, struct packet *pkt
   }
 #endif
 
-  const double zrand_chain = gsl_rng_uniform(rng) * total_endecay_per_ejectamass;
+  const double zrand_chain = rng_uniform() * total_endecay_per_ejectamass;
 
   if (zrand_chain >= cumulative_endecay[num_decaypaths - 1]) {
     assert_always(USE_MODEL_INITIAL_ENERGY);
@@ -1428,7 +1455,7 @@ void setup_radioactive_pellet(const double e0, const int mgi, struct packet *pkt
     // use uniform decay time distribution (scale the packet energies instead)
     // keeping the pellet decay rate constant will give better statistics at very late times when very little
     // energy is released
-    const double zrand = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
     pkt_ptr->tdecay = zrand * tdecaymin + (1. - zrand) * globals::tmax;
 
     // we need to scale the packet energy up or down according to decay rate at the randomly selected time.
@@ -1451,7 +1478,7 @@ void setup_radioactive_pellet(const double e0, const int mgi, struct packet *pkt
   pkt_ptr->pellet_nucindex = get_nuc_index(z, a);
   pkt_ptr->pellet_decaytype = decaytype;
 
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
   pkt_ptr->originated_from_particlenotgamma =
       (zrand >= nucdecayenergygamma(z, a) / (nucdecayenergygamma(z, a) + nucdecayenergyparticle(z, a, decaytype)));
   pkt_ptr->nu_cmf = nucdecayenergyparticle(z, a, decaytype) / H;
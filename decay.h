@@ -43,6 +43,7 @@ __host__ __device__ void setup_decaypath_energy_per_mass(void);
 __host__ __device__ void free_decaypath_energy_per_mass(void);
 __host__ __device__ double get_qdot_modelcell(int modelgridindex, double t, int decaytype);
 __host__ __device__ double get_particle_injection_rate(int modelgridindex, double t, int decaytype);
+__host__ __device__ double get_gamma_emission_rate(int modelgridindex, double t);
 __host__ __device__ double get_global_etot_t0_tinf(void);
 void fprint_nuc_abundances(FILE *estimators_file, int modelgridindex, double t_current, int element);
 __host__ __device__ void setup_radioactive_pellet(double e0, int mgi, struct packet *pkt_ptr);
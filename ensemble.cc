@@ -0,0 +1,114 @@
+#include "ensemble.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "input.h"
+#include "sn3d.h"
+
+namespace ensemble {
+
+static bool ensemble_active = false;
+static int model_index = 0;
+static int rank_world = 0;
+static std::string shared_data_dir;
+static std::string model_dir;
+
+static const char *get_ensemble_filename(int argc, char **argv)
+// look for -e FILE or -eFILE on the command line (the other options are parsed later with getopt)
+{
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      return argv[i + 1];
+    }
+    if (strncmp(argv[i], "-e", 2) == 0 && strlen(argv[i]) > 2) {
+      return argv[i] + 2;
+    }
+  }
+  return nullptr;
+}
+
+static std::string get_cwd(void) {
+  char buffer[4096];
+  if (getcwd(buffer, sizeof(buffer)) == nullptr) {
+    fprintf(stderr, "ensemble: could not get the current directory\n");
+    abort();
+  }
+  return std::string(buffer);
+}
+
+static void change_dir(const std::string &dir) {
+  if (chdir(dir.c_str()) != 0) {
+    fprintf(stderr, "ensemble: could not change directory to %s\n", dir.c_str());
+    abort();
+  }
+}
+
+void init(int argc, char **argv) {
+  int nprocs_world = 1;
+#ifdef MPI_ON
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank_world);
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs_world);
+#endif
+
+  const char *ensemble_filename = get_ensemble_filename(argc, argv);
+  if (ensemble_filename == nullptr) {
+    return;
+  }
+
+  std::ifstream ensemble_file(ensemble_filename);
+  if (!ensemble_file.is_open()) {
+    fprintf(stderr, "ensemble: could not open %s\n", ensemble_filename);
+    abort();
+  }
+
+  std::vector<std::string> model_dirs;
+  std::string line;
+  while (get_noncommentline(ensemble_file, line)) {
+    model_dirs.push_back(line.substr(0, line.find_last_not_of(" \t\r") + 1));
+  }
+  const int nmodels = model_dirs.size();
+
+  if (nmodels < 1 || nmodels > nprocs_world) {
+    fprintf(stderr, "ensemble: %s lists %d models, but there must be between 1 and %d (the number of ranks)\n",
+            ensemble_filename, nmodels, nprocs_world);
+    abort();
+  }
+
+  ensemble_active = true;
+  model_index = static_cast<int>(static_cast<long>(rank_world) * nmodels / nprocs_world);
+
+#ifdef MPI_ON
+  MPI_Comm_split(MPI_COMM_WORLD, model_index, rank_world, &globals::mpi_comm_model);
+#endif
+
+  shared_data_dir = get_cwd();
+  change_dir(model_dirs[model_index]);
+  model_dir = get_cwd();
+}
+
+bool active(void) { return ensemble_active; }
+
+int get_model_index(void) { return model_index; }
+
+void enter_shared_data_dir(void) {
+  if (ensemble_active) {
+    change_dir(shared_data_dir);
+  }
+}
+
+void leave_shared_data_dir(void) {
+  if (ensemble_active) {
+    change_dir(model_dir);
+  }
+}
+
+bool is_shared_data_writer(void) { return ensemble_active ? (rank_world == 0) : (globals::rank_global == 0); }
+
+}  // namespace ensemble
@@ -0,0 +1,28 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+// Ensemble mode runs several models that use the same atomic data in one MPI job: sn3d -e ensemble.txt, where the
+// file lists one model directory per line. The ranks are split into contiguous groups, one per model, and each group
+// runs in its model directory (input.txt, model.txt, abundances.txt, and all output). The atomic data
+// (compositiondata.txt, adata.txt, transitiondata.txt, phixsdata*.txt) and the rate coefficient files (ratecoeff.dat,
+// recombrates.txt) are read from the launch directory, and the node-shared atomic data is shared between all models
+// on a node. Other data files (e.g., for decays and non-thermal solutions) are read from each model directory.
+
+namespace ensemble {
+
+// call after MPI_Init and before any files are opened. Sets globals::mpi_comm_model
+void init(int argc, char **argv);
+
+bool active(void);
+int get_model_index(void);
+
+// switch the working directory to the launch directory to read the shared atomic data, and back again
+void enter_shared_data_dir(void);
+void leave_shared_data_dir(void);
+
+// true for the one rank that writes shared files (such as ratecoeff.dat) to the launch directory
+bool is_shared_data_writer(void);
+
+}  // namespace ensemble
+
+#endif  // ENSEMBLE_H
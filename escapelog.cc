@@ -0,0 +1,159 @@
+#include "escapelog.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "sn3d.h"
+#include "spectrum.h"
+
+namespace escapelog {
+
+static FILE *logfile = NULL;
+static bool started = false;
+static int nts_started = -1;
+
+static void get_filename(const int rank, char *filename, const size_t size) {
+  snprintf(filename, size, "escpkts_%.4d.bin", rank);
+}
+
+void init(const int my_rank) {
+  char filename[128];
+  get_filename(my_rank, filename, sizeof(filename));
+
+  // an existing log is kept for a restarted simulation, and is truncated to the restart timestep in start_timestep()
+  logfile = fopen(filename, access(filename, F_OK) == 0 ? "r+b" : "w+b");
+  assert_always(logfile != NULL);
+  started = false;
+}
+
+static void truncate_log(const int nts)
+// remove any records from timestep nts onwards, which were written after the checkpoint being restarted from
+{
+  assert_always(fseek(logfile, 0, SEEK_SET) == 0);
+  long nrecords_keep = 0;
+  struct escapedpacket rec;
+  while (fread(&rec, sizeof(rec), 1, logfile) == 1 && rec.timestep < nts) {
+    nrecords_keep++;
+  }
+
+  const long size_keep = nrecords_keep * static_cast<long>(sizeof(struct escapedpacket));
+  assert_always(fflush(logfile) == 0);
+  assert_always(ftruncate(fileno(logfile), size_keep) == 0);
+  assert_always(fseek(logfile, size_keep, SEEK_SET) == 0);
+
+  printout("escapelog: keeping %ld escaped packet records from before timestep %d\n", nrecords_keep, nts);
+}
+
+void start_timestep(const int nts, const struct packet *pkts, const int npkts_nonescaped) {
+  // a timestep is repeated for each temperature iteration (titer) with the packets restored from the start of it
+  if (started && nts > nts_started) {
+    nts_started = nts;
+    return;
+  }
+  started = true;
+  nts_started = nts;
+
+  truncate_log(nts);
+
+  // packets that escaped before this timestep (restored from a checkpoint) go straight into the running totals
+  clear_partial_lightcurve_spectra();
+  add_to_partial_lightcurve_spectra(&pkts[npkts_nonescaped], globals::npkts - npkts_nonescaped);
+}
+
+void end_timestep(const int nts, const struct packet *pkts, const int npkts_nonescaped) {
+  assert_always(started);
+
+  // every packet that escaped during this timestep was in [0, npkts_nonescaped) at the start of it
+  std::vector<struct escapedpacket> records;
+  for (int i = 0; i < npkts_nonescaped; i++) {
+    const struct packet *pkt_ptr = &pkts[i];
+    if (pkt_ptr->type != TYPE_ESCAPE) {
+      continue;
+    }
+
+    struct escapedpacket rec;
+    memset(&rec, 0, sizeof(rec));  // no uninitialised padding bytes in the file
+    rec.timestep = nts;
+    rec.escape_type = pkt_ptr->escape_type;
+    rec.escape_time = pkt_ptr->escape_time;
+    rec.emissiontype = pkt_ptr->emissiontype;
+    rec.trueemissiontype = pkt_ptr->trueemissiontype;
+    rec.absorptiontype = pkt_ptr->absorptiontype;
+    rec.em_time = pkt_ptr->em_time;
+    rec.trueemissionvelocity = pkt_ptr->trueemissionvelocity;
+    for (int d = 0; d < 3; d++) {
+      rec.pos[d] = pkt_ptr->pos[d];
+      rec.dir[d] = pkt_ptr->dir[d];
+      rec.em_pos[d] = pkt_ptr->em_pos[d];
+      rec.stokes[d] = pkt_ptr->stokes[d];
+    }
+    rec.e_cmf = pkt_ptr->e_cmf;
+    rec.e_rf = pkt_ptr->e_rf;
+    rec.nu_rf = pkt_ptr->nu_rf;
+    rec.absorptionfreq = pkt_ptr->absorptionfreq;
+    records.push_back(rec);
+  }
+
+  if (!records.empty()) {
+    assert_always(fwrite(records.data(), sizeof(struct escapedpacket), records.size(), logfile) == records.size());
+  }
+  fflush(logfile);
+
+  add_to_partial_lightcurve_spectra(pkts, npkts_nonescaped);
+
+  printout("escapelog: timestep %d logged %zu escaped packets\n", nts, records.size());
+}
+
+void close_file(void) {
+  if (logfile != NULL) {
+    fclose(logfile);
+    logfile = NULL;
+  }
+}
+
+bool read_escaped_packets(const int rank, struct packet *pkts) {
+  char filename[128];
+  get_filename(rank, filename, sizeof(filename));
+  if (access(filename, F_OK) != 0) {
+    return false;
+  }
+
+  FILE *file = fopen_required(filename, "rb");
+  memset(pkts, 0, globals::npkts * sizeof(struct packet));
+  for (int i = 0; i < globals::npkts; i++) {
+    pkts[i].type = TYPE_PRE_KPKT;
+  }
+
+  int npkts_read = 0;
+  struct escapedpacket rec;
+  while (fread(&rec, sizeof(rec), 1, file) == 1) {
+    assert_always(npkts_read < globals::npkts);
+    struct packet *pkt_ptr = &pkts[npkts_read];
+    pkt_ptr->type = TYPE_ESCAPE;
+    pkt_ptr->escape_type = rec.escape_type;
+    pkt_ptr->escape_time = rec.escape_time;
+    pkt_ptr->emissiontype = rec.emissiontype;
+    pkt_ptr->trueemissiontype = rec.trueemissiontype;
+    pkt_ptr->absorptiontype = rec.absorptiontype;
+    pkt_ptr->em_time = rec.em_time;
+    pkt_ptr->trueemissionvelocity = rec.trueemissionvelocity;
+    for (int d = 0; d < 3; d++) {
+      pkt_ptr->pos[d] = rec.pos[d];
+      pkt_ptr->dir[d] = rec.dir[d];
+      pkt_ptr->em_pos[d] = rec.em_pos[d];
+      pkt_ptr->stokes[d] = rec.stokes[d];
+    }
+    pkt_ptr->e_cmf = rec.e_cmf;
+    pkt_ptr->e_rf = rec.e_rf;
+    pkt_ptr->nu_rf = rec.nu_rf;
+    pkt_ptr->absorptionfreq = rec.absorptionfreq;
+    npkts_read++;
+  }
+  fclose(file);
+
+  return true;
+}
+
+}  // namespace escapelog
@@ -0,0 +1,48 @@
+#ifndef ESCAPELOG_H
+#define ESCAPELOG_H
+
+#include "packet.h"
+
+// Streaming log of escaped packets (ESCAPED_PACKET_LOG). Each rank appends a compact record for every packet that
+// escapes to escpkts_<rank>.bin at the end of each timestep, and adds it to running totals of the light curves and
+// spectra (see add_to_partial_lightcurve_spectra), so that the partial output does not need to rescan the whole
+// packet array each timestep. exspec reads the logs instead of the packets files when they exist.
+
+namespace escapelog {
+
+struct escapedpacket {
+  int timestep;  // timestep during which the packet escaped
+  enum packet_type escape_type;
+  int escape_time;
+  int emissiontype;
+  int trueemissiontype;
+  int absorptiontype;
+  int em_time;
+  float trueemissionvelocity;
+  double pos[3];
+  double dir[3];
+  double em_pos[3];
+  double e_cmf;
+  double e_rf;
+  double nu_rf;
+  double absorptionfreq;
+  double stokes[3];
+};
+
+void init(int my_rank);
+
+// call before the packets are propagated in timestep nts, with the escaped packets compacted to the end of the array
+void start_timestep(int nts, const struct packet *pkts, int npkts_nonescaped);
+
+// log and accumulate the packets that escaped during timestep nts
+void end_timestep(int nts, const struct packet *pkts, int npkts_nonescaped);
+
+void close_file(void);
+
+// for exspec: fill pkts with the escaped packets logged by a rank (the remaining packets are not of TYPE_ESCAPE).
+// Returns false if there is no log for this rank
+bool read_escaped_packets(int rank, struct packet *pkts);
+
+}  // namespace escapelog
+
+#endif  // ESCAPELOG_H
@@ -0,0 +1,231 @@
+#include "expansionopacity.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "atomic.h"
+#include "grid.h"
+#include "ltepop.h"
+#include "sn3d.h"
+
+namespace expansionopacity {
+
+constexpr int NBINS = EXPANSION_OPACITY_NBINS;
+
+static double dlognu = 0.;
+static std::vector<double> bin_nu_lower;  // [NBINS + 1], the last entry is the upper edge of the top bin
+
+// the lines of bin b are linelist indices bin_linelimit[b + 1] to bin_linelimit[b] - 1 (the linelist is in order of
+// decreasing frequency)
+static std::vector<int> bin_linelimit;
+
+static float *kappa_allcells = nullptr;  // [nonemptymgi * NBINS + binindex]
+#ifdef MPI_ON
+static MPI_Win win_kappa_allcells = MPI_WIN_NULL;
+#endif
+
+// per-thread running sums of 1 - exp(-tau) over the lines of the bin that the thread last selected a line from, so
+// that further absorptions in the same bin, cell and timestep only need a binary search
+struct linecumulative_cache {
+  int modelgridindex = -1;
+  int binindex = -1;
+  int timestep = -1;
+  std::vector<double> linecumulative;
+};
+static std::vector<struct linecumulative_cache> linecumulative_thread;
+
+void init(void) {
+  dlognu = (std::log(NU_MAX_R) - std::log(NU_MIN_R)) / NBINS;
+  bin_nu_lower.resize(NBINS + 1);
+  bin_linelimit.resize(NBINS + 1);
+  for (int b = 0; b <= NBINS; b++) {
+    bin_nu_lower[b] = std::exp(std::log(NU_MIN_R) + (b * dlognu));
+
+    // first line with nu <= bin_nu_lower[b]
+    const linelist_entry *const line = std::lower_bound(
+        &globals::linelist[0], &globals::linelist[globals::nlines], bin_nu_lower[b],
+        [](const linelist_entry &lineentry, const double nu) { return lineentry.nu > nu; });
+    bin_linelimit[b] = line - globals::linelist;
+  }
+  const int nlines_binned = bin_linelimit[0] - bin_linelimit[NBINS];
+  int maxlinesperbin = 0;
+  for (int b = 0; b < NBINS; b++) {
+    maxlinesperbin = std::max(maxlinesperbin, bin_linelimit[b] - bin_linelimit[b + 1]);
+  }
+  linecumulative_thread.resize(get_max_threads());
+  for (auto &cache : linecumulative_thread) {
+    cache.linecumulative.resize(maxlinesperbin);
+  }
+
+  const int nonempty_npts_model = grid::get_nonempty_npts_model();
+#ifdef MPI_ON
+  {
+    int my_rank_cells = nonempty_npts_model / globals::node_nprocs;
+    // rank_in_node 0 gets any remainder
+    if (globals::rank_in_node == 0) {
+      my_rank_cells += nonempty_npts_model - (my_rank_cells * globals::node_nprocs);
+    }
+    MPI_Aint size = static_cast<MPI_Aint>(my_rank_cells) * NBINS * sizeof(float);
+    int disp_unit = sizeof(float);
+    MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &kappa_allcells,
+                            &win_kappa_allcells);
+    MPI_Win_shared_query(win_kappa_allcells, 0, &size, &disp_unit, &kappa_allcells);
+  }
+#else
+  kappa_allcells = static_cast<float *>(malloc(static_cast<size_t>(nonempty_npts_model) * NBINS * sizeof(float)));
+#endif
+  assert_always(kappa_allcells != nullptr);
+
+  printout("expansion opacity: %d bins from %g to %g Hz for %d lines\n", NBINS, NU_MIN_R, NU_MAX_R, nlines_binned);
+  printout("[info] mem_usage: binned expansion opacities for non-empty cells occupy %.3f MB (node shared memory)\n",
+           static_cast<double>(nonempty_npts_model) * NBINS * sizeof(float) / 1024. / 1024.);
+  printout("[info] mem_usage: line selection buffers of up to %d lines per bin occupy %.3f MB\n", maxlinesperbin,
+           static_cast<double>(get_max_threads()) * maxlinesperbin * sizeof(double) / 1024. / 1024.);
+}
+
+static double get_tau_sobolev_frompops(const int lineindex, const double n_l, const double n_u, const double t_current)
+// same as get_tau_sobolev(), but with the populations given
+{
+  const struct linelist_entry *line = &globals::linelist[lineindex];
+  const int element = line->elementindex;
+  const int ion = line->ionindex;
+  const double nu_trans = line->nu;
+  const double A_ul = einstein_spontaneous_emission(lineindex);
+  const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nu_trans, 3) * A_ul;
+  const double B_lu =
+      stat_weight(element, ion, line->upperlevelindex) / stat_weight(element, ion, line->lowerlevelindex) * B_ul;
+
+  return (B_lu * n_l - B_ul * n_u) * HCLIGHTOVERFOURPI * t_current;
+}
+
+static double calculate_bin_kappa(const int nonemptymgi, const int b, const std::vector<double> &levelpops,
+                                  const double t_current)
+// store and return the expansion opacity of one bin from the level populations (indexed by unique level index)
+{
+  double sum_escapecomplement = 0.;
+  for (int lineindex = bin_linelimit[b + 1]; lineindex < bin_linelimit[b]; lineindex++) {
+    const struct linelist_entry *line = &globals::linelist[lineindex];
+    const double n_l = levelpops[get_uniquelevelindex(line->elementindex, line->ionindex, line->lowerlevelindex)];
+    const double n_u = levelpops[get_uniquelevelindex(line->elementindex, line->ionindex, line->upperlevelindex)];
+    const double tau = get_tau_sobolev_frompops(lineindex, n_l, n_u, t_current);
+    if (tau > 0.) {
+      sum_escapecomplement += -std::expm1(-tau);
+    }
+  }
+  const double nu_mid = std::sqrt(bin_nu_lower[b] * bin_nu_lower[b + 1]);
+  const double kappa = nu_mid / (bin_nu_lower[b + 1] - bin_nu_lower[b]) / (CLIGHT * t_current) * sum_escapecomplement;
+  kappa_allcells[(nonemptymgi * NBINS) + b] = kappa;
+  return kappa;
+}
+
+void calculate_cell(const int modelgridindex, const double t_current) {
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+
+  // the lines are in frequency order, so look up the level populations by unique level index
+  std::vector<double> levelpops(get_includedlevels());
+  for (int element = 0; element < get_nelements(); element++) {
+    for (int ion = 0; ion < get_nions(element); ion++) {
+      for (int level = 0; level < get_nlevels(element, ion); level++) {
+        levelpops[get_uniquelevelindex(element, ion, level)] = calculate_levelpop(modelgridindex, element, ion, level);
+      }
+    }
+  }
+
+  double kappa_max = 0.;
+  if (globals::intracell_parallel) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(max : kappa_max)
+#endif
+    for (int b = 0; b < NBINS; b++) {
+      kappa_max = std::max(kappa_max, calculate_bin_kappa(nonemptymgi, b, levelpops, t_current));
+    }
+  } else {
+    for (int b = 0; b < NBINS; b++) {
+      kappa_max = std::max(kappa_max, calculate_bin_kappa(nonemptymgi, b, levelpops, t_current));
+    }
+  }
+
+  printout("expansion opacity: cell %d max kappa %g /cm (line-of-sight tau across the cell %g)\n", modelgridindex,
+           kappa_max, kappa_max * grid::wid_init(modelgridindex) * t_current / globals::tmin);
+}
+
+#ifdef MPI_ON
+void do_MPI_Bcast(const int modelgridindex, const int root_node_id)
+// the owning rank wrote the cell into the node-shared array, so only the other nodes need it
+{
+  const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+  if (globals::rank_in_node == 0) {
+    MPI_Bcast(&kappa_allcells[nonemptymgi * NBINS], NBINS, MPI_FLOAT, root_node_id, globals::mpi_comm_internode);
+  }
+}
+#endif
+
+__host__ __device__ int get_bin(const double nu_cmf) {
+  if (nu_cmf < bin_nu_lower[0]) {
+    return -1;
+  }
+  if (nu_cmf >= bin_nu_lower[NBINS]) {
+    return NBINS;
+  }
+  const int binindex = static_cast<int>((std::log(nu_cmf) - std::log(bin_nu_lower[0])) / dlognu);
+  // rounding can put a frequency on a bin edge into the neighbouring bin
+  return std::clamp(binindex, 0, NBINS - 1);
+}
+
+__host__ __device__ double get_bin_nu_lower(const int binindex) {
+  assert_testmodeonly(binindex >= 0 && binindex <= NBINS);
+  return bin_nu_lower[binindex];
+}
+
+__host__ __device__ double get_kappa(const int modelgridindex, const int binindex) {
+  assert_testmodeonly(binindex >= 0 && binindex < NBINS);
+  return kappa_allcells[(grid::get_modelcell_nonemptymgi(modelgridindex) * NBINS) + binindex];
+}
+
+__host__ __device__ int select_line(const int modelgridindex, const int binindex)
+// choose the absorbing line of a bin with probability proportional to 1 - exp(-tau_sobolev). The optical depths come
+// from the level populations in the cell history of the packet's cell, at the same time as in calculate_cell
+{
+  const int firstline = bin_linelimit[binindex + 1];
+  const int nbinlines = bin_linelimit[binindex] - firstline;
+  assert_always(nbinlines > 0);
+
+  struct linecumulative_cache &cache = linecumulative_thread[get_thread_num()];
+  double *const linecumulative = cache.linecumulative.data();
+  if (cache.modelgridindex != modelgridindex || cache.binindex != binindex || cache.timestep != globals::nts_global) {
+    const double t_current = globals::time_step[globals::nts_global].mid;
+    double sum_escapecomplement = 0.;
+    for (int i = 0; i < nbinlines; i++) {
+      const double tau = get_tau_sobolev(modelgridindex, firstline + i, t_current);
+      if (tau > 0.) {
+        sum_escapecomplement += -std::expm1(-tau);
+      }
+      linecumulative[i] = sum_escapecomplement;
+    }
+    cache.modelgridindex = modelgridindex;
+    cache.binindex = binindex;
+    cache.timestep = globals::nts_global;
+
+#if defined TESTMODE && TESTMODE
+    // the sum must reproduce the bin opacity that the packet was absorbed by
+    const double nu_mid = std::sqrt(bin_nu_lower[binindex] * bin_nu_lower[binindex + 1]);
+    const double sum_kappa = get_kappa(modelgridindex, binindex) * (CLIGHT * t_current) *
+                             (bin_nu_lower[binindex + 1] - bin_nu_lower[binindex]) / nu_mid;
+    assert_always(std::fabs(sum_escapecomplement - sum_kappa) <= 1e-3 * sum_kappa);
+#endif
+  }
+
+  // lines with no opacity do not increase the running sum, so they are never the first entry above zrand
+  const double total = linecumulative[nbinlines - 1];
+  assert_always(total > 0.);
+  const double zrand = rng_uniform() * total;
+  const double *selected = std::upper_bound(linecumulative, linecumulative + nbinlines, zrand);
+  if (selected == linecumulative + nbinlines) {
+    // zrand was rounded up to the total, so take the last line that added to it
+    selected = std::lower_bound(linecumulative, linecumulative + nbinlines, total);
+  }
+  return firstline + (selected - linecumulative);
+}
+
+}  // namespace expansionopacity
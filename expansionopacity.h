@@ -0,0 +1,29 @@
+#ifndef EXPANSIONOPACITY_H
+#define EXPANSIONOPACITY_H
+
+#include "cuda.h"
+
+// Binned line expansion opacity (EXPANSION_OPACITY_BINNED). For every non-empty cell and timestep, the Sobolev optical
+// depths of the lines in each bin of a log-frequency grid from NU_MIN_R to NU_MAX_R are summed into an expansion
+// opacity kappa = nu / (dnu c t) * sum(1 - exp(-tau)). r-packets then see the lines as a continuous opacity within each
+// bin, and an absorbed packet activates a line of the bin chosen with probability proportional to 1 - exp(-tau).
+
+namespace expansionopacity {
+
+void init(void);
+
+// call for each cell of this rank after the populations have been updated in update_grid
+void calculate_cell(int modelgridindex, double t_current);
+
+void do_MPI_Bcast(int modelgridindex, int root_node_id);
+
+// bin containing nu_cmf, or -1 below the grid and EXPANSION_OPACITY_NBINS above it
+__host__ __device__ int get_bin(double nu_cmf);
+__host__ __device__ double get_bin_nu_lower(int binindex);
+__host__ __device__ double get_kappa(int modelgridindex, int binindex);
+// during packet propagation in modelgridindex (the level populations are taken from its cell history)
+__host__ __device__ int select_line(int modelgridindex, int binindex);
+
+}  // namespace expansionopacity
+
+#endif  // EXPANSIONOPACITY_H
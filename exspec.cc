@@ -17,6 +17,7 @@
 #include <cstdio>
 
 #include "decay.h"
+#include "escapelog.h"
 #include "grid.h"
 #include "input.h"
 #include "light_curve.h"
@@ -31,6 +32,7 @@ int tid = 0;
 bool use_cellhist = false;
 bool neutral_flag = false;
 gsl_rng *rng = NULL;
+std::uint64_t rng_xoshiro_state[4];
 gsl_integration_workspace *gslworkspace = NULL;
 
 int main(int argc, char **argv) {
@@ -45,6 +47,10 @@ int main(int argc, char **argv) {
   MPI_Comm_rank(globals::mpi_comm_node, &globals::rank_in_node);
   // get the number of ranks on the node
   MPI_Comm_size(globals::mpi_comm_node, &globals::node_nprocs);
+  // there is only one model, so the atomic data is shared between the same ranks as everything else
+  globals::mpi_comm_atomic_node = globals::mpi_comm_node;
+  globals::rank_in_atomic_node = globals::rank_in_node;
+  globals::atomic_node_nprocs = globals::node_nprocs;
   MPI_Barrier(MPI_COMM_WORLD);
 
   // make an inter-node communicator (using local rank as the key for group membership)
@@ -64,6 +70,8 @@ int main(int argc, char **argv) {
   globals::nprocs = 1;
   globals::rank_in_node = 0;
   globals::node_nprocs = 1;
+  globals::rank_in_atomic_node = 0;
+  globals::atomic_node_nprocs = 1;
   globals::node_id = 0;
   globals::node_count = 0;
 #endif
@@ -167,7 +175,10 @@ int main(int argc, char **argv) {
         snprintf(pktfilename, 128, "packets%.2d_%.4d.out", 0, p);
         printout("reading %s (file %d of %d)\n", pktfilename, p + 1, globals::nprocs_exspec);
 
-        if (!access(pktfilename, F_OK)) {
+        if (ESCAPED_PACKET_LOG && escapelog::read_escaped_packets(p, pkts_start)) {
+          // only the escaped packets are needed, and the log is much smaller than the packets file
+          printout("   using the escaped packet log escpkts_%.4d.bin instead\n", p);
+        } else if (!access(pktfilename, F_OK)) {
           read_packets(pktfilename, pkts_start);
         } else {
           printout("   WARNING %s does not exist - trying temp packets file at beginning of timestep %d...\n   ",
@@ -0,0 +1,85 @@
+#include "fastmath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "sn3d.h"
+
+namespace fastmath {
+
+template <typename Tfast, typename Tlibm>
+static void check_function(const char *name, const double *x, const double *y, const int count, Tfast fastfunc,
+                           Tlibm libmfunc)
+// compare an approximate function against libm on the given arguments, and time both
+{
+  double max_rel_error = 0.;
+  double sum_fast = 0.;
+  double sum_libm = 0.;
+
+  const auto fast_start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < count; i++) {
+    sum_fast += fastfunc(x[i], y[i]);
+  }
+  const auto fast_end = std::chrono::high_resolution_clock::now();
+
+  for (int i = 0; i < count; i++) {
+    sum_libm += libmfunc(x[i], y[i]);
+  }
+  const auto libm_end = std::chrono::high_resolution_clock::now();
+
+  for (int i = 0; i < count; i++) {
+    const double exact = libmfunc(x[i], y[i]);
+    if (exact != 0.) {
+      max_rel_error = std::max(max_rel_error, std::fabs(fastfunc(x[i], y[i]) / exact - 1.));
+    }
+  }
+
+  const double ns_fast = std::chrono::duration<double, std::nano>(fast_end - fast_start).count() / count;
+  const double ns_libm = std::chrono::duration<double, std::nano>(libm_end - fast_end).count() / count;
+  printout("fastmath: %4s max rel error %.2e, %.2f ns/call vs libm %.2f ns/call (speedup %.1fx, checksums %g %g)\n",
+           name, max_rel_error, ns_fast, ns_libm, ns_libm / ns_fast, sum_fast, sum_libm);
+
+  assert_always(max_rel_error < MAX_REL_ERROR);
+}
+
+void check_accuracy(void)
+// compare the approximate transcendental functions against libm on random arguments covering the ranges used in
+// the transport code. A scratch RNG state is used so that the simulation random number sequence is unchanged.
+{
+  constexpr int count = 1000000;
+  auto x = std::make_unique<double[]>(count);
+  auto y = std::make_unique<double[]>(count);
+
+  std::uint64_t s[4];
+  rng_xoshiro_seed(s, 4);
+  auto zrand = [&s]() { return (static_cast<double>(rng_xoshiro_next(s) >> 12) + 0.5) * 0x1.0p-52; };
+
+  // exp(-tau) and exp(-h nu / kT) factors
+  for (int i = 0; i < count; i++) {
+    x[i] = -700. + 1400. * zrand();
+    y[i] = 0.;
+  }
+  check_function(
+      "exp", x.get(), y.get(), count, [](const double a, const double) { return fastmath::exp(a); },
+      [](const double a, const double) { return std::exp(a); });
+
+  // -log(zrand) optical depths and log-spaced frequency binning
+  for (int i = 0; i < count; i++) {
+    x[i] = (i % 2 == 0) ? zrand() : std::exp(-300. + 600. * zrand());
+  }
+  check_function(
+      "log", x.get(), y.get(), count, [](const double a, const double) { return fastmath::log(a); },
+      [](const double a, const double) { return std::log(a); });
+
+  // power laws in the gamma-ray cross sections
+  for (int i = 0; i < count; i++) {
+    x[i] = std::exp(-20. + 40. * zrand());
+    y[i] = -4. + 8. * zrand();
+  }
+  check_function(
+      "pow", x.get(), y.get(), count, [](const double a, const double b) { return fastmath::pow(a, b); },
+      [](const double a, const double b) { return std::pow(a, b); });
+}
+
+}  // namespace fastmath
@@ -0,0 +1,107 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "artisoptions.h"
+#include "cuda.h"
+
+// Approximate exp/log/pow for the packet transport kernels, where a relative error of ~1e-7 is far below the
+// Monte Carlo noise. These are branch-free in the normal range so that loops over them can be vectorised.
+// With USE_FAST_TRANSPORT_MATH off, the fastmath:: functions are just the std:: functions.
+
+namespace fastmath {
+
+// relative error bound of the approximations (checked in TESTMODE by check_accuracy())
+constexpr double MAX_REL_ERROR = 1e-7;
+
+__host__ __device__ inline double bits_to_double(const std::uint64_t bits) {
+  double x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+__host__ __device__ inline std::uint64_t double_to_bits(const double x) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+__host__ __device__ inline double exp_approx(const double x)
+// exp(x) = 2^n * exp(r) with x = n ln2 + r and |r| <= ln2/2, then a degree 8 Taylor polynomial for exp(r)
+// (truncation error < 1e-9)
+{
+  constexpr double LOG2E = 1.4426950408889634;
+  constexpr double LN2_HI = 6.93147180369123816490e-01;  // upper bits of ln2, so that n * LN2_HI is exact
+  constexpr double LN2_LO = 1.90821492927058770002e-10;
+
+  const double xc = std::fmin(std::fmax(x, -708.), 709.);
+  const double n = std::nearbyint(xc * LOG2E);
+  const double r = (xc - (n * LN2_HI)) - (n * LN2_LO);
+
+  const double p =
+      1. + r * (1. + r * (1. / 2 + r * (1. / 6 + r * (1. / 24 + r * (1. / 120 + r * (1. / 720 + r * (1. / 5040 +
+                                                                                                     r / 40320.)))))));
+
+  const double twopown = bits_to_double(static_cast<std::uint64_t>(static_cast<std::int64_t>(n) + 1023) << 52);
+
+  return p * twopown;
+}
+
+__host__ __device__ inline double log_approx(const double x)
+// log(x) = e ln2 + log(m) with x = m 2^e and m in [sqrt(1/2), sqrt(2)), then log(m) = 2 atanh(s) with s = (m-1)/(m+1)
+// and |s| < 0.172, using the odd series up to s^11 (truncation error < 1e-10). x must be a normal positive number.
+{
+  constexpr double LN2 = 0.6931471805599453;
+  constexpr std::uint64_t SQRTHALF_BITS = 0x3fe6a09e667f3bcdULL;
+  // offsetting the bits by those of sqrt(1/2) puts the mantissa in [sqrt(1/2), sqrt(2)) instead of [1, 2)
+  const std::uint64_t hx = double_to_bits(x) + (0x3ff0000000000000ULL - SQRTHALF_BITS);
+  const std::int64_t e = static_cast<std::int64_t>(hx >> 52) - 0x3ff;
+  const double m = bits_to_double((hx & 0x000fffffffffffffULL) + SQRTHALF_BITS);
+
+  const double s = (m - 1.) / (m + 1.);
+  const double s2 = s * s;
+  const double atanh_s = s * (1. + s2 * (1. / 3 + s2 * (1. / 5 + s2 * (1. / 7 + s2 * (1. / 9 + s2 * (1. / 11))))));
+
+  return (static_cast<double>(e) * LN2) + (2. * atanh_s);
+}
+
+__host__ __device__ inline double exp(const double x) {
+  if constexpr (USE_FAST_TRANSPORT_MATH) {
+    if (std::isnan(x)) {
+      return x;
+    }
+    return (x < -708.) ? 0. : ((x > 709.) ? std::numeric_limits<double>::infinity() : exp_approx(x));
+  }
+  return std::exp(x);
+}
+
+__host__ __device__ inline double log(const double x) {
+  if constexpr (USE_FAST_TRANSPORT_MATH) {
+    // zero, negative, subnormal, infinite, and NaN arguments are handled by libm
+    if (x >= std::numeric_limits<double>::min() && x <= std::numeric_limits<double>::max()) {
+      return log_approx(x);
+    }
+  }
+  return std::log(x);
+}
+
+__host__ __device__ inline double pow(const double x, const double y)
+// only for x > 0. The relative error grows with |y log(x)|, which is small for the power laws in the transport code
+{
+  if constexpr (USE_FAST_TRANSPORT_MATH) {
+    if (x >= std::numeric_limits<double>::min() && x <= std::numeric_limits<double>::max()) {
+      return exp(y * log_approx(x));
+    }
+  }
+  return std::pow(x, y);
+}
+
+void check_accuracy(void);
+
+}  // namespace fastmath
+
+#endif  // FASTMATH_H
@@ -0,0 +1,300 @@
+#include "formalint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#include "atomic.h"
+#include "exspec.h"
+#include "grid.h"
+#include "ltepop.h"
+#include "sn3d.h"
+#include "spectrum.h"
+#include "vectors.h"
+
+namespace formalint {
+
+// resonances with a smaller Sobolev optical depth than this are skipped
+constexpr double TAU_MIN = 1e-8;
+
+// without continuum opacity, the formal integral is only valid when the ejecta are optically thin to electron
+// scattering along every ray (the nebular phase)
+constexpr double TAU_ES_MAX = 0.1;
+
+// number of samples along a ray for the electron-scattering optical depth
+constexpr int TAU_ES_NSTEPS = 200;
+
+struct ray {
+  double p[3];  // offset of the ray from the origin, perpendicular to the observer direction (at tmin)
+  double area;  // projected area represented by the ray (at tmin)
+};
+
+static std::vector<struct ray> get_rays(const double obsdir[3], const double rmax_tmin)
+// a square grid of rays covering the projected ejecta, or rings of impact parameter for a spherical grid
+{
+  const int nrays = FORMAL_INTEGRAL_NRAYS;
+  std::vector<struct ray> rays;
+
+  // unit vectors spanning the plane of the sky
+  const double xhat[3] = {1., 0., 0.};
+  const double zhat[3] = {0., 0., 1.};
+  double e1[3];
+  cross_prod(obsdir, (std::fabs(obsdir[2]) < 0.9) ? zhat : xhat, e1);
+  vec_norm(e1, e1);
+  double e2[3];
+  cross_prod(obsdir, e1, e2);
+
+  if constexpr (GRID_TYPE == GRID_SPHERICAL1D) {
+    const double dp = rmax_tmin / nrays;
+    for (int i = 0; i < nrays; i++) {
+      const double p = (i + 0.5) * dp;
+      struct ray r;
+      for (int d = 0; d < 3; d++) {
+        r.p[d] = p * e1[d];
+      }
+      r.area = 2 * PI * p * dp;
+      rays.push_back(r);
+    }
+  } else {
+    const double dp = 2 * rmax_tmin / nrays;
+    for (int i = 0; i < nrays; i++) {
+      for (int j = 0; j < nrays; j++) {
+        const double p1 = -rmax_tmin + (i + 0.5) * dp;
+        const double p2 = -rmax_tmin + (j + 0.5) * dp;
+        if ((p1 * p1) + (p2 * p2) > rmax_tmin * rmax_tmin) {
+          continue;
+        }
+        struct ray r;
+        for (int d = 0; d < 3; d++) {
+          r.p[d] = (p1 * e1[d]) + (p2 * e2[d]);
+        }
+        r.area = dp * dp;
+        rays.push_back(r);
+      }
+    }
+  }
+
+  return rays;
+}
+
+static void get_line_tau_source(const int lineindex, const int mgi, const double t_current, double *tau,
+                                double *source)
+// Sobolev optical depth and line source function from the level populations of a cell
+{
+  const struct linelist_entry *line = &globals::linelist[lineindex];
+  const int element = line->elementindex;
+  const int ion = line->ionindex;
+  const double n_l = calculate_levelpop(mgi, element, ion, line->lowerlevelindex);
+  const double n_u = calculate_levelpop(mgi, element, ion, line->upperlevelindex);
+  const double g_l = statw_lower(line);
+  const double g_u = statw_upper(line);
+
+  const double nu_trans = line->nu;
+  const double A_ul = einstein_spontaneous_emission(lineindex);
+  const double B_ul = CLIGHTSQUAREDOVERTWOH / pow(nu_trans, 3) * A_ul;
+  const double B_lu = g_u / g_l * B_ul;
+
+  *tau = (B_lu * n_l - B_ul * n_u) * HCLIGHTOVERFOURPI * t_current;
+  *source = (*tau > 0. && n_u > 0.) ? TWOHOVERCLIGHTSQUARED * pow(nu_trans, 3) / ((g_u * n_l) / (g_l * n_u) - 1.) : 0.;
+}
+
+static double get_ray_tau_es(const struct ray *r, const double obsdir[3], const double rmax_tmin,
+                             const double t_current)
+// electron-scattering optical depth through the ejecta along a ray
+{
+  const double p2 = dot(r->p, r->p);
+  if (p2 >= rmax_tmin * rmax_tmin) {
+    return 0.;
+  }
+  const double zmax = std::sqrt(rmax_tmin * rmax_tmin - p2);
+  const double dz = 2 * zmax / TAU_ES_NSTEPS;
+  double tau_es = 0.;
+  for (int i = 0; i < TAU_ES_NSTEPS; i++) {
+    const double z = -zmax + (i + 0.5) * dz;
+    double pos[3];
+    for (int d = 0; d < 3; d++) {
+      pos[d] = r->p[d] + z * obsdir[d];
+    }
+    const int cellindex = grid::get_cellindex_at_pos(pos);
+    if (cellindex < 0) {
+      continue;
+    }
+    const int mgi = grid::get_cell_modelgridindex(cellindex);
+    if (mgi == grid::get_npts_model()) {
+      continue;
+    }
+    // path lengths are in tmin coordinates
+    tau_es += grid::get_nne(mgi) * SIGMA_T * dz * t_current / globals::tmin;
+  }
+  return tau_es;
+}
+
+static void integrate_ray(const struct ray *r, const double obsdir[3], const double rmax_tmin, const double t_current,
+                          const std::vector<double> &nu_mid, const double dlognu, std::vector<double> &intensity)
+// integrate the transfer equation along a ray from the back to the front of the ejecta, for every frequency bin.
+// In homologous flow, a line resonates with observer-frame frequency nu at z = c tmin (1 - nu_line / nu) along the
+// ray (in tmin coordinates). The linelist is in order of decreasing frequency, so for each bin the lines are applied
+// in order from the back to the front.
+{
+  const int nnubins = nu_mid.size();
+  const double p2 = dot(r->p, r->p);
+  if (p2 >= rmax_tmin * rmax_tmin) {
+    return;
+  }
+  const double zmax = std::sqrt(rmax_tmin * rmax_tmin - p2);
+  const double ctmin = CLIGHT * globals::tmin;
+  const double lognumin = std::log(nu_mid[0]) - 0.5 * dlognu;
+
+  for (int b = 0; b < nnubins; b++) {
+    intensity[b] = 0.;
+  }
+
+  for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
+    const double nu_line = globals::linelist[lineindex].nu;
+
+    // range of observer-frame frequencies that come into resonance with this line along the ray
+    const double nu_obs_min = nu_line / (1. + zmax / ctmin);
+    const double nu_obs_max = (zmax < ctmin) ? nu_line / (1. - zmax / ctmin) : nu_mid[nnubins - 1] * 2;
+    const int bin_min = std::max(0, static_cast<int>(std::floor((std::log(nu_obs_min) - lognumin) / dlognu)));
+    const int bin_max = std::min(nnubins - 1, static_cast<int>(std::floor((std::log(nu_obs_max) - lognumin) / dlognu)));
+
+    int mgi_prev = -1;
+    double tau = 0.;
+    double source = 0.;
+    for (int b = bin_min; b <= bin_max; b++) {
+      const double z = ctmin * (1. - nu_line / nu_mid[b]);
+      if (std::fabs(z) > zmax) {
+        continue;
+      }
+      double pos[3];
+      for (int d = 0; d < 3; d++) {
+        pos[d] = r->p[d] + z * obsdir[d];
+      }
+      const int cellindex = grid::get_cellindex_at_pos(pos);
+      if (cellindex < 0) {
+        continue;
+      }
+      const int mgi = grid::get_cell_modelgridindex(cellindex);
+      if (mgi == grid::get_npts_model()) {
+        continue;
+      }
+
+      // neighbouring bins usually resonate in the same cell
+      if (mgi != mgi_prev) {
+        get_line_tau_source(lineindex, mgi, t_current, &tau, &source);
+        mgi_prev = mgi;
+      }
+
+      if (tau > TAU_MIN) {
+        const double escape_prob = std::exp(-tau);
+        intensity[b] = (intensity[b] * escape_prob) + (source * (1. - escape_prob));
+      }
+    }
+  }
+}
+
+void write_spectrum(const int my_rank, const int nts) {
+  const time_t time_start = time(NULL);
+  const double t_current = globals::time_step[nts].mid;
+
+  double obsdir[3];
+  vec_norm(globals::syn_dir, obsdir);
+
+  // the corners of a Cartesian grid are further out than rmax
+  const double rmax_tmin = (GRID_TYPE == GRID_SPHERICAL1D) ? globals::rmax : std::sqrt(3.) * globals::rmax;
+  const std::vector<struct ray> rays = get_rays(obsdir, rmax_tmin);
+  const int nrays = rays.size();
+
+  // same frequency bins as the packet spectra
+  const int nnubins = MNUBINS;
+  const double dlognu = (std::log(globals::nu_max_r) - std::log(globals::nu_min_r)) / nnubins;
+  std::vector<double> nu_mid(nnubins);
+  std::vector<double> nu_lower(nnubins + 1);
+  for (int b = 0; b <= nnubins; b++) {
+    nu_lower[b] = std::exp(std::log(globals::nu_min_r) + (b * dlognu));
+  }
+  for (int b = 0; b < nnubins; b++) {
+    nu_mid[b] = std::sqrt(nu_lower[b] * nu_lower[b + 1]);
+  }
+
+  // sum of I_nu * dA (at time t_current) over rays handled by this rank
+  std::vector<double> flux(nnubins, 0.);
+  const double areafactor = (t_current / globals::tmin) * (t_current / globals::tmin);
+  double tau_es_max = 0.;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    std::vector<double> flux_thread(nnubins, 0.);
+    std::vector<double> intensity(nnubins, 0.);
+    double tau_es_max_thread = 0.;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int i = my_rank; i < nrays; i += globals::nprocs) {
+      tau_es_max_thread = std::max(tau_es_max_thread, get_ray_tau_es(&rays[i], obsdir, rmax_tmin, t_current));
+      integrate_ray(&rays[i], obsdir, rmax_tmin, t_current, nu_mid, dlognu, intensity);
+      for (int b = 0; b < nnubins; b++) {
+        flux_thread[b] += intensity[b] * rays[i].area * areafactor;
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      for (int b = 0; b < nnubins; b++) {
+        flux[b] += flux_thread[b];
+      }
+      tau_es_max = std::max(tau_es_max, tau_es_max_thread);
+    }
+  }
+
+#ifdef MPI_ON
+  MPI_Allreduce(MPI_IN_PLACE, &tau_es_max, 1, MPI_DOUBLE, MPI_MAX, globals::mpi_comm_model);
+#endif
+
+  printout("timestep %d: formal integral max electron-scattering optical depth along a ray %g\n", nts, tau_es_max);
+  assert_always(tau_es_max < TAU_ES_MAX);
+
+#ifdef MPI_ON
+  MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : flux.data(), flux.data(), nnubins, MPI_DOUBLE, MPI_SUM, 0,
+             globals::mpi_comm_model);
+#endif
+
+  if (my_rank == 0) {
+    char filename[128];
+    snprintf(filename, sizeof(filename), "spec_formal_ts%.4d.out", nts);
+    FILE *spec_file = fopen_required(filename, "w");
+    fprintf(spec_file, "%g %g\n", 0.0, t_current / DAY);
+
+    // flux at 1 Mpc in the same units as spec.out, and the isotropic-equivalent luminosity for the printout
+    double lum = 0.;
+    for (int b = 0; b < nnubins; b++) {
+      const double flux_1mpc = flux[b] / 1.e12 / PARSEC / PARSEC;
+      fprintf(spec_file, "%g %g\n", nu_mid[b], flux_1mpc);
+      lum += 4 * PI * flux[b] * (nu_lower[b + 1] - nu_lower[b]);
+    }
+    fclose(spec_file);
+
+    printout("timestep %d: formal integral spectrum with %d rays written to %s (L = %g erg/s)\n", nts, nrays,
+             filename, lum);
+
+    // check against the packet spectrum of the same timestep. There is no continuum opacity or emission in the formal
+    // integral, so the ratio should be close to one only in the nebular phase
+    const double lum_packets = get_partial_spectrum_lum(nts);
+    printout("timestep %d: formal integral (lines only) L = %g erg/s, packet spectrum L = %g erg/s, ratio %g\n", nts,
+             lum, lum_packets, (lum_packets > 0.) ? lum / lum_packets : 0.);
+  }
+
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_model);
+#endif
+
+  printout("timestep %d: formal integral took %lds\n", nts, time(NULL) - time_start);
+}
+
+}  // namespace formalint
@@ -0,0 +1,20 @@
+#ifndef FORMALINT_H
+#define FORMALINT_H
+
+// Formal-integral synthesis of the UVOIR spectrum towards the observer direction globals::syn_dir (FORMAL_INTEGRAL).
+// Rays on a grid of impact parameters are traced through the ejecta at the middle of a timestep, and the transfer
+// equation is integrated through the Sobolev resonances of every line in the linelist, using the optical depths and
+// source functions from the current level populations. The result has no Monte Carlo noise. Only bound-bound
+// transitions are included: there is no continuum opacity or emission (bound-free, free-free, electron scattering)
+// and no inner boundary, so it is only valid in the nebular phase: write_spectrum asserts that the electron-scattering
+// optical depth along every ray is small.
+
+namespace formalint {
+
+// compute and write spec_formal_ts<nts>.out (same frequency grid and units as spec.out). Call on all ranks after the
+// grid properties of timestep nts have been communicated
+void write_spectrum(int my_rank, int nts);
+
+}  // namespace formalint
+
+#endif  // FORMALINT_H
@@ -0,0 +1,240 @@
+#include "gammadeposition.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <vector>
+
+#include "decay.h"
+#include "grid.h"
+#include "sn3d.h"
+#include "vectors.h"
+
+namespace gammadeposition {
+
+// number of integration steps per (smallest) cell width along a ray
+constexpr int STEPS_PER_CELL = 4;
+
+// a ray stops when the fraction of its energy that has not been deposited falls below this
+constexpr double RAY_FRACTION_MIN = 1e-6;
+
+static std::vector<double> deposition_rate_density;
+static int deposition_rate_density_timestep = -1;
+
+// cumulative deposited power over the model cells, and the fraction of the emitted gamma-ray power that is deposited
+static std::vector<double> deposition_cumulative;
+static double deposited_fraction = 0.;
+
+// non-empty propagation cells grouped by model cell (modelcell_cells_start[mgi] is the first entry of cell mgi)
+static std::vector<int> modelcell_cells;
+static std::vector<int> modelcell_cells_start;
+
+static void setup_modelcell_cells(void) {
+  const int npts_model = grid::get_npts_model();
+  modelcell_cells_start.assign(npts_model + 1, 0);
+  for (int cellindex = 0; cellindex < grid::ngrid; cellindex++) {
+    const int mgi = grid::get_cell_modelgridindex(cellindex);
+    if (mgi < npts_model) {
+      modelcell_cells_start[mgi + 1]++;
+    }
+  }
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    modelcell_cells_start[mgi + 1] += modelcell_cells_start[mgi];
+  }
+  modelcell_cells.resize(modelcell_cells_start[npts_model]);
+  std::vector<int> nfilled(npts_model, 0);
+  for (int cellindex = 0; cellindex < grid::ngrid; cellindex++) {
+    const int mgi = grid::get_cell_modelgridindex(cellindex);
+    if (mgi < npts_model) {
+      modelcell_cells[modelcell_cells_start[mgi] + nfilled[mgi]++] = cellindex;
+    }
+  }
+}
+
+static std::vector<std::array<double, 3>> get_raydirs(void)
+// directions on a Fibonacci lattice, which each represent the same solid angle
+{
+  const int nrays = GAMMA_DEPOSITION_RAYTRACE_NRAYS;
+  std::vector<std::array<double, 3>> raydirs(nrays);
+  const double goldenangle = PI * (3. - std::sqrt(5.));
+  for (int i = 0; i < nrays; i++) {
+    const double mu = 1. - (2. * (i + 0.5) / nrays);
+    const double sintheta = std::sqrt(1. - (mu * mu));
+    raydirs[i] = {sintheta * std::cos(goldenangle * i), sintheta * std::sin(goldenangle * i), mu};
+  }
+  return raydirs;
+}
+
+static void get_cell_centre(const int cellindex, double pos[3])
+// source position of a cell (at tmin). For a spherical grid, any point on the shell gives the same deposition in each
+// shell by symmetry
+{
+  if constexpr (GRID_TYPE == GRID_SPHERICAL1D) {
+    pos[0] = 0.;
+    pos[1] = 0.;
+    pos[2] = grid::get_cellradialpos(cellindex);
+  } else {
+    for (int axis = 0; axis < 3; axis++) {
+      pos[axis] = grid::get_cellcoordmin(cellindex, axis) + (0.5 * grid::wid_init(cellindex));
+    }
+  }
+}
+
+void calculate(const int my_rank, const int nts) {
+  const time_t time_start = time(NULL);
+  const double t_mid = globals::time_step[nts].mid;
+  const int npts_model = grid::get_npts_model();
+
+  // absorption coefficient per unit path length in tmin coordinates: the density scales as (tmin / t)^3 and the path
+  // length as t / tmin
+  const double kappa = (globals::gamma_grey > 0) ? globals::gamma_grey : GAMMA_DEPOSITION_RAYTRACE_KAPPA;
+  std::vector<double> alpha_tmin(npts_model + 1, 0.);
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    alpha_tmin[mgi] = kappa * grid::get_rhoinit(mgi) * pow(globals::tmin / t_mid, 2);
+  }
+
+  // gamma-ray sources are the non-empty propagation cells
+  std::vector<int> sourcecells;
+  double ds = std::numeric_limits<double>::max();
+  for (int cellindex = 0; cellindex < grid::ngrid; cellindex++) {
+    if (grid::get_numassociatedcells(grid::get_cell_modelgridindex(cellindex)) > 0) {
+      sourcecells.push_back(cellindex);
+    }
+    ds = std::min(ds, grid::wid_init(cellindex) / STEPS_PER_CELL);
+  }
+  const int nsources = sourcecells.size();
+  const std::vector<std::array<double, 3>> raydirs = get_raydirs();
+  const int nrays = raydirs.size();
+
+  // deposited power [erg/s] in each model cell, and the power that escapes
+  std::vector<double> deposition(npts_model + 1, 0.);
+  double power_emitted = 0.;
+  double power_escaped = 0.;
+
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : power_emitted, power_escaped)
+#endif
+  {
+    std::vector<double> deposition_thread(npts_model + 1, 0.);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int i = my_rank; i < nsources; i += globals::nprocs) {
+      const int cellindex = sourcecells[i];
+      const int mgi = grid::get_cell_modelgridindex(cellindex);
+      const double cellmass =
+          grid::get_rhoinit(mgi) * grid::vol_init_modelcell(mgi) / grid::get_numassociatedcells(mgi);
+      const double power_ray = decay::get_gamma_emission_rate(mgi, t_mid) * cellmass / nrays;
+      if (power_ray <= 0.) {
+        continue;
+      }
+      power_emitted += power_ray * nrays;
+
+      double sourcepos[3];
+      get_cell_centre(cellindex, sourcepos);
+      for (const auto &dir : raydirs) {
+        double fraction = 1.;
+        for (int step = 0; fraction > RAY_FRACTION_MIN; step++) {
+          const double s = (step + 0.5) * ds;
+          const double pos[3] = {sourcepos[0] + (s * dir[0]), sourcepos[1] + (s * dir[1]), sourcepos[2] + (s * dir[2])};
+          const int raycellindex = grid::get_cellindex_at_pos(pos);
+          if (raycellindex < 0) {
+            break;
+          }
+          const int raymgi = grid::get_cell_modelgridindex(raycellindex);
+          const double depfraction = -fraction * std::expm1(-alpha_tmin[raymgi] * ds);
+          deposition_thread[raymgi] += power_ray * depfraction;
+          fraction -= depfraction;
+        }
+        power_escaped += power_ray * fraction;
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    for (int mgi = 0; mgi < npts_model; mgi++) {
+      deposition[mgi] += deposition_thread[mgi];
+    }
+  }
+
+#ifdef MPI_ON
+  MPI_Allreduce(MPI_IN_PLACE, deposition.data(), npts_model, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &power_emitted, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &power_escaped, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+#endif
+
+  if (modelcell_cells_start.empty()) {
+    setup_modelcell_cells();
+  }
+
+  deposition_rate_density.assign(npts_model, 0.);
+  deposition_cumulative.assign(npts_model, 0.);
+  double power_deposited = 0.;
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    if (grid::get_numassociatedcells(mgi) > 0) {
+      const double volume = grid::vol_init_modelcell(mgi) * pow(t_mid / globals::tmin, 3);
+      deposition_rate_density[mgi] = deposition[mgi] / volume;
+      power_deposited += deposition[mgi];
+    }
+    deposition_cumulative[mgi] = power_deposited;
+  }
+  deposited_fraction = (power_emitted > 0.) ? power_deposited / power_emitted : 0.;
+  deposition_rate_density_timestep = nts;
+
+  // the path-length estimator column of deposition.out is otherwise only filled with do_rlc_est
+  if (globals::do_rlc_est == 0) {
+    globals::time_step[nts].gamma_dep_pathint = power_deposited * globals::time_step[nts].width;
+  }
+
+  printout(
+      "timestep %d: ray-traced gamma deposition from %d sources with %d rays each: emitted %g erg/s, deposited %g "
+      "erg/s, escaped fraction %g (took %lds)\n",
+      nts, nsources, nrays, power_emitted, power_deposited, (power_emitted > 0.) ? power_escaped / power_emitted : 0.,
+      time(NULL) - time_start);
+}
+
+double get_deposition_rate_density(const int modelgridindex) {
+  assert_always(deposition_rate_density_timestep == globals::nts_global);
+  return deposition_rate_density[modelgridindex];
+}
+
+bool select_deposition_position(struct packet *pkt_ptr) {
+  assert_always(deposition_rate_density_timestep == globals::nts_global);
+  if (rng_uniform() >= deposited_fraction) {
+    return false;
+  }
+
+  const double power_deposited = deposition_cumulative.back();
+  const double targetpower = rng_uniform() * power_deposited;
+  const int mgi = std::upper_bound(deposition_cumulative.begin(), deposition_cumulative.end(), targetpower) -
+                  deposition_cumulative.begin();
+  assert_always(mgi < grid::get_npts_model());
+  const int ncells = modelcell_cells_start[mgi + 1] - modelcell_cells_start[mgi];
+  assert_always(ncells > 0);
+  const int cellnum = std::min(ncells - 1, static_cast<int>(rng_uniform() * ncells));
+  const int cellindex = modelcell_cells[modelcell_cells_start[mgi] + cellnum];
+
+  // the pellet moves with the homologous flow, so choose the position at tmin and scale it to the decay time
+  if constexpr (GRID_TYPE == GRID_SPHERICAL1D) {
+    const double zrand = rng_uniform();
+    const double r_inner = grid::get_cellcoordmin(cellindex, 0);
+    const double r_outer = grid::get_cellcoordmin(cellindex, 0) + grid::wid_init(cellindex);
+    const double radius = pow(zrand * pow(r_inner, 3) + (1. - zrand) * pow(r_outer, 3), 1 / 3.);
+    get_rand_isotropic_unitvec(pkt_ptr->pos);
+    vec_scale(pkt_ptr->pos, radius);
+  } else {
+    for (int axis = 0; axis < 3; axis++) {
+      pkt_ptr->pos[axis] = grid::get_cellcoordmin(cellindex, axis) + (rng_uniform_pos() * grid::wid_init(cellindex));
+    }
+  }
+  vec_scale(pkt_ptr->pos, pkt_ptr->tdecay / globals::tmin);
+  pkt_ptr->where = cellindex;
+
+  return true;
+}
+
+}  // namespace gammadeposition
@@ -0,0 +1,27 @@
+#ifndef GAMMADEPOSITION_H
+#define GAMMADEPOSITION_H
+
+// Deterministic gamma-ray deposition (GAMMA_DEPOSITION_RAYTRACE). At the middle of each timestep, the gamma-ray power
+// of every non-empty propagation cell is sent along a fixed set of GAMMA_DEPOSITION_RAYTRACE_NRAYS directions, and the
+// rays are attenuated by a grey absorption opacity (globals::gamma_grey if positive, otherwise
+// GAMMA_DEPOSITION_RAYTRACE_KAPPA). The resulting deposition field has no Monte Carlo noise and replaces the gamma-ray
+// path-length estimator in the deposition rates used by the non-thermal solver and the heating rates. It is also the
+// only deposition path for the gamma-ray packet energy (see select_deposition_position).
+
+#include "packet.h"
+
+namespace gammadeposition {
+
+// call on all ranks before update_grid for timestep nts
+void calculate(int my_rank, int nts);
+
+// gamma-ray energy deposition rate [erg/s/cm^3] at the middle of the current timestep
+double get_deposition_rate_density(int modelgridindex);
+
+// with a probability equal to the deposited fraction of the ray-traced gamma-ray power, move a decaying gamma-ray
+// pellet to a random position drawn from the deposition field and return true. Otherwise the gamma ray escapes.
+bool select_deposition_position(struct packet *pkt_ptr);
+
+}  // namespace gammadeposition
+
+#endif  // GAMMADEPOSITION_H
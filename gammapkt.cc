@@ -10,6 +10,8 @@
 #include "boundary.h"
 #include "decay.h"
 #include "emissivities.h"
+#include "fastmath.h"
+#include "gammadeposition.h"
 #include "grey_emissivities.h"
 #include "grid.h"
 #include "nonthermal.h"
@@ -26,6 +28,9 @@ struct gamma_spec {
   std::unique_ptr<double[]> energy;  // in erg
   std::unique_ptr<double[]> probability;
   int nlines;
+  // alias table for choosing a line in proportion to its share of the gamma-ray energy (see choose_gamma_ray)
+  std::unique_ptr<double[]> alias_threshold;
+  std::unique_ptr<int[]> alias_index;
 };
 
 static struct gamma_spec *gamma_spectra;
@@ -40,6 +45,13 @@ struct gammaline {
 
 static std::vector<struct gammaline> allnuc_gamma_line_list;
 
+// frequencies of the lines in allnuc_gamma_line_list, and a guide table for get_nul() over NUL_GUIDE_PER_LINE uniform
+// frequency buckets per line, each holding the number of lines below the lower edge of the bucket
+constexpr int NUL_GUIDE_PER_LINE = 4;
+static std::vector<double> allnuc_gamma_line_freq;
+static std::vector<int> nul_guide;
+static double nul_guide_dfreq = 0.;
+
 constexpr bool operator<(const struct gammaline &g1, const struct gammaline &g2) {
   // true if d1 < d2
   if (g1.energy < g2.energy) {
@@ -174,6 +186,97 @@ static void read_decaydata(void) {
   }
 }
 
+static void setup_alias_table(const int nucindex)
+// Vose's alias method: line n is chosen with probability proportional to probability[n] * energy[n]
+{
+  struct gamma_spec *spec = &gamma_spectra[nucindex];
+  const int nlines = spec->nlines;
+
+  double weightsum = 0.;
+  for (int n = 0; n < nlines; n++) {
+    weightsum += spec->probability[n] * spec->energy[n];
+  }
+  if (nlines == 0 || !(weightsum > 0.)) {
+    return;
+  }
+
+  const double E_gamma = decay::nucdecayenergygamma(decay::get_nuc_z(nucindex), decay::get_nuc_a(nucindex));
+  if (E_gamma > 0. && std::fabs(weightsum / E_gamma - 1.) > 1e-3) {
+    printout("WARNING: gamma line energies of nuclide Z=%d A=%d sum to %g of the gamma decay energy\n",
+             decay::get_nuc_z(nucindex), decay::get_nuc_a(nucindex), weightsum / E_gamma);
+  }
+
+  spec->alias_threshold = std::make_unique<double[]>(nlines);
+  spec->alias_index = std::make_unique<int[]>(nlines);
+
+  // scaled so that the mean is one
+  std::vector<double> scaledprob(nlines);
+  std::vector<int> small;
+  std::vector<int> large;
+  for (int n = 0; n < nlines; n++) {
+    scaledprob[n] = spec->probability[n] * spec->energy[n] / weightsum * nlines;
+    spec->alias_index[n] = n;
+    if (scaledprob[n] < 1.) {
+      small.push_back(n);
+    } else {
+      large.push_back(n);
+    }
+  }
+
+  while (!small.empty() && !large.empty()) {
+    const int n_small = small.back();
+    small.pop_back();
+    const int n_large = large.back();
+    large.pop_back();
+
+    spec->alias_threshold[n_small] = scaledprob[n_small];
+    spec->alias_index[n_small] = n_large;
+
+    scaledprob[n_large] = (scaledprob[n_large] + scaledprob[n_small]) - 1.;
+    if (scaledprob[n_large] < 1.) {
+      small.push_back(n_large);
+    } else {
+      large.push_back(n_large);
+    }
+  }
+
+  // whatever remains has probability one up to rounding
+  for (const int n : large) {
+    spec->alias_threshold[n] = 1.;
+  }
+  for (const int n : small) {
+    spec->alias_threshold[n] = 1.;
+  }
+}
+
+static void setup_nul_guide(void) {
+  const int nlines = allnuc_gamma_line_list.size();
+  allnuc_gamma_line_freq.resize(nlines);
+  for (int i = 0; i < nlines; i++) {
+    const int nucindex = allnuc_gamma_line_list[i].nucindex;
+    const int lineid = allnuc_gamma_line_list[i].nucgammaindex;
+    assert_always(nucindex < decay::get_num_nuclides() && lineid < gamma_spectra[nucindex].nlines);
+    allnuc_gamma_line_freq[i] = gamma_spectra[nucindex].energy[lineid] / H;
+  }
+
+  nul_guide.clear();
+  if (nlines == 0) {
+    return;
+  }
+  const double freq_min = allnuc_gamma_line_freq[0];
+  const int nbuckets = NUL_GUIDE_PER_LINE * nlines;
+  nul_guide_dfreq = (allnuc_gamma_line_freq[nlines - 1] - freq_min) / nbuckets;
+  nul_guide.resize(nbuckets);
+  int nbelow = 0;
+  for (int k = 0; k < nbuckets; k++) {
+    const double bucket_freq_min = freq_min + k * nul_guide_dfreq;
+    while (nbelow < nlines && allnuc_gamma_line_freq[nbelow] < bucket_freq_min) {
+      nbelow++;
+    }
+    nul_guide[k] = nbelow;
+  }
+}
+
 // construct an energy ordered gamma ray line list.
 void init_gamma_linelist(void) {
   read_decaydata();
@@ -209,6 +312,15 @@ void init_gamma_linelist(void) {
   allnuc_gamma_line_list.shrink_to_fit();
   assert_always(static_cast<int>(allnuc_gamma_line_list.size()) == total_lines);
   std::sort(allnuc_gamma_line_list.begin(), allnuc_gamma_line_list.end());
+  setup_nul_guide();
+
+  if constexpr (GAMMA_LINE_ALIAS_SAMPLING) {
+    for (int nucindex = 0; nucindex < decay::get_num_nuclides(); nucindex++) {
+      if (nucindex != FAKE_GAM_LINE_ID) {
+        setup_alias_table(nucindex);
+      }
+    }
+  }
 
   FILE *const line_list = fopen_required("gammalinelist.out", "w+");
 
@@ -228,11 +340,27 @@ static void choose_gamma_ray(struct packet *pkt_ptr) {
   // Routine to choose which gamma ray line it'll be.
 
   const int nucindex = pkt_ptr->pellet_nucindex;
+
+  if constexpr (GAMMA_LINE_ALIAS_SAMPLING) {
+    const struct gamma_spec *spec = &gamma_spectra[nucindex];
+    assert_always(spec->alias_threshold != nullptr);
+
+    // the integer part of the scaled random number picks a column and the fractional part decides between the
+    // column's own line and its alias
+    const double zrandscaled = rng_uniform() * spec->nlines;
+    const int column = std::min(static_cast<int>(zrandscaled), spec->nlines - 1);
+    const int nselected =
+        (zrandscaled - column < spec->alias_threshold[column]) ? column : spec->alias_index[column];
+
+    pkt_ptr->nu_cmf = spec->energy[nselected] / H;
+    return;
+  }
+
   const int z = decay::get_nuc_z(nucindex);
   const int a = decay::get_nuc_a(nucindex);
   double E_gamma = decay::nucdecayenergygamma(z, a);  // Average energy per gamma line of a decay
 
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
   int nselected = -1;
   double runtot = 0.;
   for (int n = 0; n < gamma_spectra[nucindex].nlines; n++) {
@@ -269,6 +397,19 @@ void pellet_gamma_decay(const int nts, struct packet *pkt_ptr) {
     return;
   }
 
+  // the ray-traced deposition field is the only deposition path for the gamma-ray energy, so the deposited share of
+  // the pellets goes straight to non-thermal leptons, and the rest is emitted as gamma rays that escape freely
+  if constexpr (GAMMA_DEPOSITION_RAYTRACE) {
+    if (gammadeposition::select_deposition_position(pkt_ptr)) {
+      pkt_ptr->prop_time = pkt_ptr->tdecay;
+      pkt_ptr->type = TYPE_NTLEPTON;
+      pkt_ptr->absorptiontype = -4;
+      safeadd(globals::time_step[nts].gamma_dep, pkt_ptr->e_cmf);
+      stats::increment(stats::COUNTER_NT_STAT_FROM_GAMMA);
+      return;
+    }
+  }
+
   // Now let's give the gamma ray a direction.
   // Assuming isotropic emission in cmf
 
@@ -399,7 +540,7 @@ static double choose_f(double xx, double zrand)
 static double thomson_angle(void) {
   // For Thomson scattering we can get the new angle from a random number very easily.
 
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
 
   const double B_coeff = (8. * zrand) - 4.;
 
@@ -445,7 +586,7 @@ static void compton_scatter(struct packet *pkt_ptr)
     f = 1.0;  // no energy loss
     stay_gamma = true;
   } else {
-    const double zrand = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
     f = choose_f(xx, zrand);
 
     // Check that f lies between 1.0 and (2xx  + 1)
@@ -459,7 +600,7 @@ static void compton_scatter(struct packet *pkt_ptr)
 
     const double prob_gamma = 1. / f;
 
-    const double zrand2 = gsl_rng_uniform(rng);
+    const double zrand2 = rng_uniform();
     stay_gamma = (zrand2 < prob_gamma);
   }
 
@@ -537,8 +678,8 @@ void do_gamma(struct packet *pkt_ptr, double t2)
 {
   // Assign optical depth to next physical event. And start counter of
   // optical depth for this path.
-  double zrand = gsl_rng_uniform_pos(rng);
-  const double tau_next = -1. * log(zrand);
+  double zrand = rng_uniform_pos();
+  const double tau_next = -1. * fastmath::log(zrand);
   const double tau_current = 0.0;
 
   // Start by finding the distance to the crossing of the grid cell
@@ -577,13 +718,14 @@ void do_gamma(struct packet *pkt_ptr, double t2)
   /* Compton scattering - need to determine the scattering co-efficient.*/
   /* Routine returns the value in the rest frame. */
 
+  // with GAMMA_DEPOSITION_RAYTRACE, the deposition was already chosen at pellet decay and gamma rays stream freely
   double kap_compton = 0.0;
-  if (globals::gamma_grey < 0) {
+  if (globals::gamma_grey < 0 && !GAMMA_DEPOSITION_RAYTRACE) {
     kap_compton = sig_comp(pkt_ptr);
   }
 
-  const double kap_photo_electric = sig_photo_electric(pkt_ptr);
-  const double kap_pair_prod = sig_pair_prod(pkt_ptr);
+  const double kap_photo_electric = GAMMA_DEPOSITION_RAYTRACE ? 0. : sig_photo_electric(pkt_ptr);
+  const double kap_pair_prod = GAMMA_DEPOSITION_RAYTRACE ? 0. : sig_pair_prod(pkt_ptr);
   const double kap_tot = kap_compton + kap_photo_electric + kap_pair_prod;
 
   assert_testmodeonly(std::isfinite(kap_compton));
@@ -592,7 +734,7 @@ void do_gamma(struct packet *pkt_ptr, double t2)
 
   // So distance before physical event is...
 
-  double edist = (tau_next - tau_current) / kap_tot;
+  double edist = (kap_tot > 0) ? (tau_next - tau_current) / kap_tot : std::numeric_limits<double>::max();
 
   if (edist < 0) {
     printout("Negative distance (edist). Abort. \n");
@@ -663,7 +805,7 @@ void do_gamma(struct packet *pkt_ptr, double t2)
     move_pkt(pkt_ptr, edist / 2.);
 
     // event occurs. Choose which event and call the appropriate subroutine.
-    zrand = gsl_rng_uniform(rng);
+    zrand = rng_uniform();
     if (kap_compton > (zrand * kap_tot)) {
       // Compton scattering.
       compton_scatter(pkt_ptr);
@@ -705,42 +847,33 @@ double get_gam_freq(const int n) {
   }
 
   // returns the frequency of line n
-  const int nucindex = allnuc_gamma_line_list[n].nucindex;
-  const int lineid = allnuc_gamma_line_list[n].nucgammaindex;
-
-  if (nucindex >= decay::get_num_nuclides() || lineid >= gamma_spectra[nucindex].nlines) {
-    printout("Unknown line. %d Abort.\n", n);
-    printout("line_list->nucindex[n] %d line_list->index[n] %d\n", nucindex, lineid);
-    abort();
-  }
-
-  return gamma_spectra[nucindex].energy[lineid] / H;
+  assert_always(n >= 0 && n < static_cast<int>(allnuc_gamma_line_freq.size()));
+  return allnuc_gamma_line_freq[n];
 }
 
-int get_nul(double freq) {
-  const double freq_max = get_gam_freq(allnuc_gamma_line_list.size() - 1);
-  const double freq_min = get_gam_freq(0);
+int get_nul(double freq)
+// index of the highest line with frequency below freq (or zero), or RED_OF_LIST if freq is below all lines
+{
+  const int nlines = allnuc_gamma_line_freq.size();
+  const double freq_max = allnuc_gamma_line_freq[nlines - 1];
+  const double freq_min = allnuc_gamma_line_freq[0];
 
   if (freq > freq_max) {
-    return (allnuc_gamma_line_list.size() - 1);
+    return (nlines - 1);
   } else if (freq < freq_min) {
     return RED_OF_LIST;
-  } else {
-    int too_high = allnuc_gamma_line_list.size() - 1;
-    int too_low = 0;
-
-    while (too_high != too_low + 1) {
-      const int tryindex = (too_high + too_low) / 2;
-      const double freq_try = get_gam_freq(tryindex);
-      if (freq_try >= freq) {
-        too_high = tryindex;
-      } else {
-        too_low = tryindex;
-      }
-    }
+  }
 
-    return too_low;
+  // start from the lines below the bucket containing freq and step up
+  const int nbuckets = nul_guide.size();
+  const int bucket =
+      (nul_guide_dfreq > 0.) ? std::min(static_cast<int>((freq - freq_min) / nul_guide_dfreq), nbuckets - 1) : 0;
+  int nbelow = nul_guide[bucket];
+  while (nbelow < nlines && allnuc_gamma_line_freq[nbelow] < freq) {
+    nbelow++;
   }
+
+  return std::max(nbelow - 1, 0);
 }
 
 }  // namespace gammapkt
\ No newline at end of file
@@ -113,16 +113,22 @@ __managed__ struct cellhistory *cellhistory = NULL;
 __managed__ int debuglevel;
 
 #ifdef MPI_ON
+MPI_Comm mpi_comm_model = MPI_COMM_WORLD;  // the ranks simulating this model (differs from world in ensemble mode)
 MPI_Comm mpi_comm_node = MPI_COMM_NULL;
 MPI_Comm mpi_comm_internode = MPI_COMM_NULL;
+MPI_Comm mpi_comm_atomic_node = MPI_COMM_NULL;  // all ranks on this node, which share the atomic data
 #endif
 
-__managed__ int nprocs = -1;       // number of MPI processes
-__managed__ int rank_global = -1;  // rank of the active MPI process
+__managed__ int nprocs = -1;       // number of MPI processes simulating this model
+__managed__ int rank_global = -1;  // rank of the active MPI process within this model
 
 __managed__ int node_nprocs = -1;   // number of MPI processes on this node
 __managed__ int rank_in_node = -1;  // local rank within this node
 
+// the same for all models of an ensemble on this node, which share the node-shared atomic data
+__managed__ int atomic_node_nprocs = -1;
+__managed__ int rank_in_atomic_node = -1;
+
 __managed__ int node_count = -1;  // number of MPI nodes
 __managed__ int node_id = -1;     // unique number for each node
 
@@ -167,6 +173,8 @@ __managed__ double cell_is_optically_thick;
 __managed__ int num_grey_timesteps;
 __managed__ int n_titer;
 __managed__ bool initial_iteration;
+// update_grid is solving one cell at a time with all threads working within the cell (INTRA_CELL_PARALLEL)
+__managed__ bool intracell_parallel = false;
 __managed__ int max_bf_continua;
 __managed__ int n_kpktdiffusion_timesteps;
 __managed__ float kpktdiffusion_timescale;
@@ -303,8 +303,10 @@ extern __managed__ struct cellhistory *cellhistory;
 extern __managed__ int debuglevel;
 
 #ifdef MPI_ON
+extern MPI_Comm mpi_comm_model;
 extern MPI_Comm mpi_comm_node;
 extern MPI_Comm mpi_comm_internode;
+extern MPI_Comm mpi_comm_atomic_node;
 #endif
 
 extern __managed__ int nprocs;
@@ -313,6 +315,9 @@ extern __managed__ int rank_global;
 extern __managed__ int node_nprocs;
 extern __managed__ int rank_in_node;
 
+extern __managed__ int atomic_node_nprocs;
+extern __managed__ int rank_in_atomic_node;
+
 extern __managed__ int node_count;
 extern __managed__ int node_id;
 
@@ -354,6 +359,7 @@ extern __managed__ double cell_is_optically_thick;
 extern __managed__ int num_grey_timesteps;
 extern __managed__ int n_titer;
 extern __managed__ bool initial_iteration;
+extern __managed__ bool intracell_parallel;
 extern __managed__ int max_bf_continua;
 extern __managed__ int n_kpktdiffusion_timesteps;
 extern __managed__ float kpktdiffusion_timescale;
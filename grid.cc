@@ -13,6 +13,7 @@
 
 #include "atomic.h"
 #include "decay.h"
+#include "expansionopacity.h"
 #include "input.h"
 #include "nltepop.h"
 #include "nonthermal.h"
@@ -605,6 +606,40 @@ __host__ __device__ double get_cellradialpos(const int cellindex)
   return vec_len(dcen);
 }
 
+__host__ __device__ int get_cellindex_at_pos(const double pos[3])
+// propagation cell containing the position pos (at tmin), or -1 if outside the grid
+{
+  if constexpr (GRID_TYPE == GRID_SPHERICAL1D) {
+    // shells are in order of increasing radius
+    const double r = vec_len(pos);
+    int low = 0;
+    int high = ngrid - 1;
+    if (r > get_cellcoordmax(high, 0)) {
+      return -1;
+    }
+    while (low < high) {
+      const int mid = (low + high) / 2;
+      if (get_cellcoordmax(mid, 0) < r) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  } else {
+    int cellindex = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      const double cellwidth = get_cellcoordmax(0, axis) - get_cellcoordmin(0, axis);
+      const int n = static_cast<int>(std::floor((pos[axis] - get_cellcoordmin(0, axis)) / cellwidth));
+      if (n < 0 || n >= ncoordgrid[axis]) {
+        return -1;
+      }
+      cellindex += n * get_coordcellindexincrement(axis);
+    }
+    return cellindex;
+  }
+}
+
 __host__ __device__ int get_elements_uppermost_ion(const int modelgridindex, const int element) {
   return modelgrid[modelgridindex].elements_uppermost_ion[element];
 }
@@ -894,7 +929,7 @@ static void allocate_nonemptymodelcells(void) {
 
 #ifdef MPI_ON
   // barrier to make sure node master has set abundance values to node shared memory
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   printout("[info] mem_usage: the modelgrid array occupies %.3f MB\n",
@@ -1007,7 +1042,7 @@ static void map_3dmodeltogrid(void) {
 static void abundances_read(void) {
 #ifdef MPI_ON
   // barrier to make sure node master has set values in node shared memory
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   printout("reading abundances.txt...");
   const bool threedimensional = (get_model_type() == RHO_3D_READ);
@@ -1067,7 +1102,7 @@ static void abundances_read(void) {
   abundance_file.close();
 #ifdef MPI_ON
   // barrier to make sure node master has set values in node shared memory
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   printout("done.\n");
 }
@@ -1880,7 +1915,7 @@ static void assign_initial_temperatures(void)
 /// Routine for assigning temperatures to the grid cells at the start of the simulation.
 {
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   /// For a simulation started from scratch we estimate the initial temperatures
 
@@ -2189,6 +2224,9 @@ void grid_init(int my_rank)
 
   radfield::init(my_rank, ndo, ndo_nonempty);
   nonthermal::init(my_rank, ndo, ndo_nonempty);
+  if constexpr (EXPANSION_OPACITY_BINNED) {
+    expansionopacity::init();
+  }
 
   /// and assign a temperature to the cells
   if (globals::simulation_continued_from_saved) {
@@ -2224,7 +2262,7 @@ void grid_init(int my_rank)
     }
   }
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 }
 
@@ -104,6 +104,7 @@ __host__ __device__ void set_TJ(int modelgridindex, float x);
 __host__ __device__ void set_W(int modelgridindex, float x);
 void grid_init(int my_rank);
 __host__ __device__ double get_cellradialpos(int cellindex);
+__host__ __device__ int get_cellindex_at_pos(const double pos[3]);
 __host__ __device__ float get_modelinitradioabund(int modelgridindex, int z, int a);
 __host__ __device__ float get_stable_initabund(int mgi, int anumber);
 __host__ __device__ float get_element_meanweight(int mgi, int element);
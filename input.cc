@@ -3,6 +3,7 @@
 #include <gsl/gsl_spline.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
@@ -11,7 +12,9 @@
 #include <sstream>
 #include <vector>
 
+#include "arena.h"
 #include "atomic.h"
+#include "ensemble.h"
 #include "exspec.h"
 #include "gammapkt.h"
 #include "grid.h"
@@ -77,7 +80,7 @@ static void read_phixs_data_table(FILE *phixsdata, const int nphixspoints_inputt
 
     assert_always(globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets == NULL);
     globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets =
-        static_cast<phixstarget_entry *>(calloc(1, sizeof(phixstarget_entry)));
+        arena::alloc_array<phixstarget_entry>(1, arena::ARENA_PHIXSTARGETS);
     assert_always(globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets != NULL);
 
     if (single_level_top_ion &&
@@ -99,7 +102,7 @@ static void read_phixs_data_table(FILE *phixsdata, const int nphixspoints_inputt
       *mem_usage_phixs += in_nphixstargets * sizeof(phixstarget_entry);
 
       globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets =
-          static_cast<phixstarget_entry *>(calloc(in_nphixstargets, sizeof(phixstarget_entry)));
+          arena::alloc_array<phixstarget_entry>(in_nphixstargets, arena::ARENA_PHIXSTARGETS);
       assert_always(globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets != NULL);
 
       double probability_sum = 0.;
@@ -123,7 +126,7 @@ static void read_phixs_data_table(FILE *phixsdata, const int nphixspoints_inputt
       globals::elements[element].ions[lowerion].levels[lowerlevel].nphixstargets = 1;
       *mem_usage_phixs += sizeof(phixstarget_entry);
       globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets =
-          static_cast<phixstarget_entry *>(calloc(1, sizeof(phixstarget_entry)));
+          arena::alloc_array<phixstarget_entry>(1, arena::ARENA_PHIXSTARGETS);
       assert_always(globals::elements[element].ions[lowerion].levels[lowerlevel].phixstargets != NULL);
 
       for (int i = 0; i < in_nphixstargets; i++) {
@@ -543,22 +546,22 @@ static void add_transitions_to_linelist(const int element, const int ion, const
       struct level_transition *alltransblock = nullptr;
 
 #ifdef MPI_ON
-      MPI_Barrier(MPI_COMM_WORLD);
+      MPI_Barrier(globals::mpi_comm_atomic_node);
       MPI_Win win;
 
-      int my_rank_trans = totupdowntrans / globals::node_nprocs;
-      // rank_in_node 0 gets any remainder
-      if (globals::rank_in_node == 0) {
-        my_rank_trans += totupdowntrans - (my_rank_trans * globals::node_nprocs);
+      int my_rank_trans = totupdowntrans / globals::atomic_node_nprocs;
+      // rank_in_atomic_node 0 gets any remainder
+      if (globals::rank_in_atomic_node == 0) {
+        my_rank_trans += totupdowntrans - (my_rank_trans * globals::atomic_node_nprocs);
       }
 
       MPI_Aint size = my_rank_trans * sizeof(linelist_entry);
       int disp_unit = sizeof(linelist_entry);
-      MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &alltransblock, &win);
+      MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_atomic_node, &alltransblock, &win);
 
       MPI_Win_shared_query(win, 0, &size, &disp_unit, &alltransblock);
 #else
-      alltransblock = static_cast<struct level_transition *>(malloc(totupdowntrans * sizeof(struct level_transition)));
+      alltransblock = arena::alloc_array<struct level_transition>(totupdowntrans, arena::ARENA_TRANSITIONS);
 #endif
 
       for (int level = 0; level < nlevelsmax; level++) {
@@ -607,7 +610,7 @@ static void add_transitions_to_linelist(const int element, const int ion, const
 
         totupdowntrans += 2;
 
-        if (pass == 1 && globals::rank_in_node == 0) {
+        if (pass == 1 && globals::rank_in_atomic_node == 0) {
           const double A_ul = transitiontable[ii].A;
           const float coll_str = transitiontable[ii].coll_str;
           // globals::elements[element].ions[ion].levels[level].transitions[level-targetlevel-1].einstein_A = A_ul;
@@ -645,7 +648,7 @@ static void add_transitions_to_linelist(const int element, const int ion, const
 
         (*lineindex)++;
 
-      } else if (pass == 1 && globals::rank_in_node == 0) {
+      } else if (pass == 1 && globals::rank_in_atomic_node == 0) {
         // This is a new branch to deal with lines that have different types of transition. It should trip after a
         // transition is already known.
         const int linelistindex = transitions[level].to[level - targetlevel - 1];
@@ -684,7 +687,7 @@ static void add_transitions_to_linelist(const int element, const int ion, const
     }
   }
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_atomic_node);
 #endif
 }
 
@@ -758,7 +761,7 @@ static void read_atomicdata_files(void) {
   int nelements_in;
   assert_always(fscanf(compositiondata, "%d", &nelements_in) == 1);
   set_nelements(nelements_in);
-  globals::elements = static_cast<elementlist_entry *>(calloc(get_nelements(), sizeof(elementlist_entry)));
+  globals::elements = arena::alloc_array<elementlist_entry>(get_nelements(), arena::ARENA_ELEMENTS);
   assert_always(globals::elements != NULL);
 
   /// Initialize the linelist
@@ -811,7 +814,7 @@ static void read_atomicdata_files(void) {
     increase_includedions(nions);
 
     /// Initialize the elements ionlist
-    globals::elements[element].ions = static_cast<ionlist_entry *>(calloc(nions, sizeof(ionlist_entry)));
+    globals::elements[element].ions = arena::alloc_array<ionlist_entry>(nions, arena::ARENA_IONS);
     assert_always(globals::elements[element].ions != NULL);
 
     /// now read in data for all ions of the current element. before doing so initialize
@@ -935,10 +938,10 @@ static void read_atomicdata_files(void) {
       globals::elements[element].ions[ion].nlevels_groundterm = -1;
       globals::elements[element].ions[ion].uniqueionindex = uniqueionindex;
 
-      globals::elements[element].ions[ion].Alpha_sp = static_cast<float *>(calloc(TABLESIZE, sizeof(float)));
+      globals::elements[element].ions[ion].Alpha_sp = arena::alloc_array<float>(TABLESIZE, arena::ARENA_RATECOEFF);
       assert_always(globals::elements[element].ions[ion].Alpha_sp != NULL);
       globals::elements[element].ions[ion].levels =
-          static_cast<struct levellist_entry *>(calloc(nlevelsmax, sizeof(struct levellist_entry)));
+          arena::alloc_array<struct levellist_entry>(nlevelsmax, arena::ARENA_LEVELS);
       assert_always(globals::elements[element].ions[ion].levels != NULL);
 
       /// now we need to readout the data for all those levels, write them to memory
@@ -980,7 +983,7 @@ static void read_atomicdata_files(void) {
   /// Save the linecounters value to the global variable containing the number of lines
   globals::nlines = lineindex;
   printout("nlines %d\n", globals::nlines);
-  if (globals::rank_in_node == 0) {
+  if (globals::rank_in_atomic_node == 0) {
     assert_always(globals::nlines == static_cast<int>(temp_linelist.size()));
   }
 
@@ -995,7 +998,7 @@ static void read_atomicdata_files(void) {
            (totaluptrans + totaldowntrans) * sizeof(struct level_transition) / 1024. / 1024.);
 
   /// then sort the linelist by decreasing frequency
-  if (globals::rank_in_node == 0) {
+  if (globals::rank_in_atomic_node == 0) {
     qsort(temp_linelist.data(), globals::nlines, sizeof(linelist_entry), compare_linelistentry);
     // std::sort(globals::linelist, globals::linelist + globals::nlines);
 
@@ -1052,28 +1055,28 @@ static void read_atomicdata_files(void) {
 #ifdef MPI_ON
   MPI_Win win;
 
-  int my_rank_lines = globals::nlines / globals::node_nprocs;
-  // rank_in_node 0 gets any remainder
-  if (globals::rank_in_node == 0) {
-    my_rank_lines += globals::nlines - (my_rank_lines * globals::node_nprocs);
+  int my_rank_lines = globals::nlines / globals::atomic_node_nprocs;
+  // rank_in_atomic_node 0 gets any remainder
+  if (globals::rank_in_atomic_node == 0) {
+    my_rank_lines += globals::nlines - (my_rank_lines * globals::atomic_node_nprocs);
   }
 
   MPI_Aint size = my_rank_lines * sizeof(linelist_entry);
   int disp_unit = sizeof(linelist_entry);
-  MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &nonconstlinelist, &win);
+  MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_atomic_node, &nonconstlinelist, &win);
 
   MPI_Win_shared_query(win, 0, &size, &disp_unit, &nonconstlinelist);
 #else
-  nonconstlinelist = static_cast<struct linelist_entry *>(malloc(globals::nlines * sizeof(linelist_entry)));
+  nonconstlinelist = arena::alloc_array<struct linelist_entry>(globals::nlines, arena::ARENA_LINELIST);
 #endif
 
-  if (globals::rank_in_node == 0) {
+  if (globals::rank_in_atomic_node == 0) {
     memcpy(static_cast<void *>(nonconstlinelist), temp_linelist.data(), globals::nlines * sizeof(linelist_entry));
     temp_linelist.clear();
   }
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_atomic_node);
 #endif
   globals::linelist = nonconstlinelist;
   nonconstlinelist = nullptr;
@@ -1098,32 +1101,92 @@ static void read_atomicdata_files(void) {
 
   /// Establish connection between transitions and sorted linelist
   // printout("[debug] init line counter list\n");
+  // the transition lists are in node-shared memory, so one rank per node fills them in. The lines are grouped by the
+  // unique index of their upper and lower levels, so that the transition lists of a level are only written by the
+  // thread that handles that level, and in increasing line index order as in a serial loop over lines
   printout("establish connection between transitions and sorted linelist...");
   time_t time_start_establish_linelist_connections = time(NULL);
-  for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
-    const int element = globals::linelist[lineindex].elementindex;
-    const int ion = globals::linelist[lineindex].ionindex;
-    const int lowerlevel = globals::linelist[lineindex].lowerlevelindex;
-    const int upperlevel = globals::linelist[lineindex].upperlevelindex;
+  if (globals::rank_in_atomic_node == 0) {
+    const int nlevels_total = uniquelevelindex;
+    std::vector<int> uniquelevel_element(nlevels_total);
+    std::vector<int> uniquelevel_ion(nlevels_total);
+    std::vector<int> uniquelevel_level(nlevels_total);
+    for (int element = 0; element < get_nelements(); element++) {
+      for (int ion = 0; ion < get_nions(element); ion++) {
+        for (int level = 0; level < get_nlevels(element, ion); level++) {
+          const int uniquelevel = globals::elements[element].ions[ion].levels[level].uniquelevelindex;
+          uniquelevel_element[uniquelevel] = element;
+          uniquelevel_ion[uniquelevel] = ion;
+          uniquelevel_level[uniquelevel] = level;
+        }
+      }
+    }
 
-    const int nupperdowntrans = get_ndowntrans(element, ion, upperlevel);
-    for (int ii = 0; ii < nupperdowntrans; ii++) {
-      // negative indicates a level instead of a lineindex
-      if (globals::elements[element].ions[ion].levels[upperlevel].downtrans[ii].lineindex == -lowerlevel) {
-        globals::elements[element].ions[ion].levels[upperlevel].downtrans[ii].lineindex = lineindex;
-        break;  // should be safe to end here if there is max. one transition per pair of levels
+    // lines of unique upper level u are lines_byupper[upper_linestart[u]] to lines_byupper[upper_linestart[u + 1] - 1]
+    std::vector<int> upper_linestart(nlevels_total + 1, 0);
+    std::vector<int> lower_linestart(nlevels_total + 1, 0);
+    for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
+      const auto &line = globals::linelist[lineindex];
+      const auto *levels = globals::elements[line.elementindex].ions[line.ionindex].levels;
+      upper_linestart[levels[line.upperlevelindex].uniquelevelindex + 1]++;
+      lower_linestart[levels[line.lowerlevelindex].uniquelevelindex + 1]++;
+    }
+    for (int uniquelevel = 0; uniquelevel < nlevels_total; uniquelevel++) {
+      upper_linestart[uniquelevel + 1] += upper_linestart[uniquelevel];
+      lower_linestart[uniquelevel + 1] += lower_linestart[uniquelevel];
+    }
+    std::vector<int> lines_byupper(globals::nlines);
+    std::vector<int> lines_bylower(globals::nlines);
+    {
+      std::vector<int> upper_nextpos(upper_linestart.begin(), upper_linestart.end() - 1);
+      std::vector<int> lower_nextpos(lower_linestart.begin(), lower_linestart.end() - 1);
+      for (int lineindex = 0; lineindex < globals::nlines; lineindex++) {
+        const auto &line = globals::linelist[lineindex];
+        const auto *levels = globals::elements[line.elementindex].ions[line.ionindex].levels;
+        lines_byupper[upper_nextpos[levels[line.upperlevelindex].uniquelevelindex]++] = lineindex;
+        lines_bylower[lower_nextpos[levels[line.lowerlevelindex].uniquelevelindex]++] = lineindex;
       }
     }
 
-    const int nloweruptrans = get_nuptrans(element, ion, lowerlevel);
-    for (int ii = 0; ii < nloweruptrans; ii++) {
-      // negative indicates a level instead of a lineindex
-      if (globals::elements[element].ions[ion].levels[lowerlevel].uptrans[ii].lineindex == -upperlevel) {
-        globals::elements[element].ions[ion].levels[lowerlevel].uptrans[ii].lineindex = lineindex;
-        break;  // should be safe to end here if there is max. one transition per pair of levels
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int uniquelevel = 0; uniquelevel < nlevels_total; uniquelevel++) {
+      const int element = uniquelevel_element[uniquelevel];
+      const int ion = uniquelevel_ion[uniquelevel];
+      const int level = uniquelevel_level[uniquelevel];
+      struct levellist_entry *levelentry = &globals::elements[element].ions[ion].levels[level];
+
+      const int ndowntrans = get_ndowntrans(element, ion, level);
+      for (int i = upper_linestart[uniquelevel]; i < upper_linestart[uniquelevel + 1]; i++) {
+        const int lineindex = lines_byupper[i];
+        const int lowerlevel = globals::linelist[lineindex].lowerlevelindex;
+        for (int ii = 0; ii < ndowntrans; ii++) {
+          // negative indicates a level instead of a lineindex
+          if (levelentry->downtrans[ii].lineindex == -lowerlevel) {
+            levelentry->downtrans[ii].lineindex = lineindex;
+            break;  // should be safe to end here if there is max. one transition per pair of levels
+          }
+        }
+      }
+
+      const int nuptrans = get_nuptrans(element, ion, level);
+      for (int i = lower_linestart[uniquelevel]; i < lower_linestart[uniquelevel + 1]; i++) {
+        const int lineindex = lines_bylower[i];
+        const int upperlevel = globals::linelist[lineindex].upperlevelindex;
+        for (int ii = 0; ii < nuptrans; ii++) {
+          // negative indicates a level instead of a lineindex
+          if (levelentry->uptrans[ii].lineindex == -upperlevel) {
+            levelentry->uptrans[ii].lineindex = lineindex;
+            break;  // should be safe to end here if there is max. one transition per pair of levels
+          }
+        }
       }
     }
   }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_atomic_node);
+#endif
   printout("took %ds\n", time(NULL) - time_start_establish_linelist_connections);
 
   for (int element = 0; element < get_nelements(); element++) {
@@ -1383,7 +1446,7 @@ static void setup_cellhistory(void) {
 }
 
 static void write_bflist_file(int includedphotoiontransitions) {
-  globals::bflist = static_cast<struct bflist_t *>(malloc(includedphotoiontransitions * sizeof(struct bflist_t)));
+  globals::bflist = arena::alloc_array<struct bflist_t>(includedphotoiontransitions, arena::ARENA_PHIXS);
   assert_always(globals::bflist != NULL);
 
   FILE *bflist_file = NULL;
@@ -1436,6 +1499,58 @@ static bool operator<(const groundphixslist &a, const groundphixslist &b)
   return a.nu_edge < b.nu_edge;
 }
 
+static void setup_phixslist_for_thread(const int itid) {
+  /// Number of ground level bf-continua equals the total number of included ions minus the number
+  /// of included elements, because the uppermost ionisation stages can't ionise.
+#if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
+  globals::phixslist[itid].groundcont_gamma_contr =
+      static_cast<double *>(malloc(globals::nbfcontinua_ground * sizeof(double)));
+  assert_always(globals::phixslist[itid].groundcont_gamma_contr != NULL);
+
+  for (int groundcontindex = 0; groundcontindex < globals::nbfcontinua_ground; groundcontindex++) {
+    globals::phixslist[itid].groundcont_gamma_contr[groundcontindex] = 0.;
+  }
+#endif
+
+  globals::phixslist[itid].kappa_bf_sum = static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
+  assert_always(globals::phixslist[itid].kappa_bf_sum != NULL);
+
+#if (DETAILED_BF_ESTIMATORS_ON)
+  globals::phixslist[itid].gamma_contr = static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
+  assert_always(globals::phixslist[itid].gamma_contr != NULL);
+#endif
+
+  for (int allcontindex = 0; allcontindex < globals::nbfcontinua; allcontindex++) {
+    globals::phixslist[itid].kappa_bf_sum[allcontindex] = 0.;
+
+#if (DETAILED_BF_ESTIMATORS_ON)
+    globals::phixslist[itid].gamma_contr[allcontindex] = 0.;
+#endif
+  }
+
+  printout("[info] mem_usage: phixslist[tid].kappa_bf_contr for thread %d occupies %.3f MB\n", itid,
+           globals::nbfcontinua * sizeof(double) / 1024. / 1024.);
+}
+
+static double *alloc_ratecoeff_table(void)
+// a rate coefficient lookup table of TABLESIZE * nbfcontinua values. With MPI, it is in node-shared memory and only
+// rank_in_atomic_node 0 writes to it (see ratecoefficients_init)
+{
+#ifdef MPI_ON
+  double *table = NULL;
+  MPI_Win win = MPI_WIN_NULL;
+  const MPI_Aint tablebytes = static_cast<MPI_Aint>(TABLESIZE) * globals::nbfcontinua * sizeof(double);
+  MPI_Aint size = (globals::rank_in_atomic_node == 0) ? tablebytes : 0;
+  int disp_unit = sizeof(double);
+  MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_atomic_node, &table, &win);
+  MPI_Win_shared_query(win, 0, &size, &disp_unit, &table);
+#else
+  double *table = arena::alloc_array<double>(TABLESIZE * globals::nbfcontinua, arena::ARENA_RATECOEFF);
+#endif
+  assert_always(table != NULL || globals::nbfcontinua == 0);
+  return table;
+}
+
 static void setup_phixs_list(void) {
   // set up the photoionisation transition lists
   // and temporary gamma/kappa lists for each thread
@@ -1455,42 +1570,20 @@ static void setup_phixs_list(void) {
   //   #pragma omp parallel private(i,element,ion,level,nions,nlevels,epsilon_upper,E_threshold,nu_edge)
   //   {
   // #endif
-  for (int itid = 0; itid < get_max_threads(); itid++) {
-    /// Number of ground level bf-continua equals the total number of included ions minus the number
-    /// of included elements, because the uppermost ionisation stages can't ionise.
-#if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
-    globals::phixslist[itid].groundcont_gamma_contr =
-        static_cast<double *>(malloc(globals::nbfcontinua_ground * sizeof(double)));
-    assert_always(globals::phixslist[itid].groundcont_gamma_contr != NULL)
-
-        for (int groundcontindex = 0; groundcontindex < globals::nbfcontinua_ground; groundcontindex++) {
-      globals::phixslist[tid].groundcont_gamma_contr[groundcontindex] = 0.;
-    }
-#endif
-
-    globals::phixslist[itid].kappa_bf_sum = static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
-    assert_always(globals::phixslist[itid].kappa_bf_sum != NULL);
-
-#if (DETAILED_BF_ESTIMATORS_ON)
-    globals::phixslist[itid].gamma_contr = static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
-    assert_always(globals::phixslist[itid].gamma_contr != NULL);
-#endif
-
-    for (int allcontindex = 0; allcontindex < globals::nbfcontinua; allcontindex++) {
-      globals::phixslist[itid].kappa_bf_sum[allcontindex] = 0.;
-
-#if (DETAILED_BF_ESTIMATORS_ON)
-      globals::phixslist[itid].gamma_contr[allcontindex] = 0.;
+  if constexpr (NUMA_AWARE_MEMORY) {
+    // allocate and first touch each thread's lists from the thread that uses them
+#ifdef _OPENMP
+#pragma omp parallel
 #endif
+    { setup_phixslist_for_thread(tid); }
+  } else {
+    for (int itid = 0; itid < get_max_threads(); itid++) {
+      setup_phixslist_for_thread(itid);
     }
-
-    printout("[info] mem_usage: phixslist[tid].kappa_bf_contr for thread %d occupies %.3f MB\n", itid,
-             globals::nbfcontinua * sizeof(double) / 1024. / 1024.);
   }
 
 #if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
-  globals::groundcont =
-      static_cast<struct groundphixslist *>(malloc(globals::nbfcontinua_ground * sizeof(struct groundphixslist)));
+  globals::groundcont = arena::alloc_array<struct groundphixslist>(globals::nbfcontinua_ground, arena::ARENA_PHIXS);
   assert_always(globals::groundcont != NULL);
 #endif
 
@@ -1523,7 +1616,7 @@ static void setup_phixs_list(void) {
 #endif
 
   struct fullphixslist *nonconstallcont =
-      static_cast<struct fullphixslist *>(malloc(globals::nbfcontinua * sizeof(struct fullphixslist)));
+      arena::alloc_array<struct fullphixslist>(globals::nbfcontinua, arena::ARENA_PHIXS);
   printout("[info] mem_usage: photoionisation list occupies %.3f MB\n",
            globals::nbfcontinua * (sizeof(fullphixslist)) / 1024. / 1024.);
   int nbftables = 0;
@@ -1551,14 +1644,6 @@ static void setup_phixs_list(void) {
           nonconstallcont[allcontindex].phixstargetindex = phixstargetindex;
           nonconstallcont[allcontindex].probability = get_phixsprobability(element, ion, level, phixstargetindex);
           nonconstallcont[allcontindex].upperlevel = get_phixsupperlevel(element, ion, level, phixstargetindex);
-
-#if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
-          int index_in_groundlevelcontestimator;
-          nonconstallcont[allcontindex].index_in_groundphixslist =
-              search_groundphixslist(nu_edge, &index_in_groundlevelcontestimator, element, ion, level);
-
-          globals::elements[element].ions[ion].levels[level].closestgroundlevelcont = index_in_groundlevelcontestimator;
-#endif
           allcontindex++;
         }
       }
@@ -1566,27 +1651,48 @@ static void setup_phixs_list(void) {
   }
 
   assert_always(allcontindex == globals::nbfcontinua);
+
+#if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
+  // the ground continuum search is a linear scan for each continuum, so do it in parallel. Only the last target of
+  // each level sets the level's closestgroundlevelcont, as it was the last to overwrite it in the serial loop
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (int i = 0; i < globals::nbfcontinua; i++) {
+    const int element = nonconstallcont[i].element;
+    const int ion = nonconstallcont[i].ion;
+    const int level = nonconstallcont[i].level;
+    int index_in_groundlevelcontestimator;
+    nonconstallcont[i].index_in_groundphixslist =
+        search_groundphixslist(nonconstallcont[i].nu_edge, &index_in_groundlevelcontestimator, element, ion, level);
+
+    if (nonconstallcont[i].phixstargetindex == get_nphixstargets(element, ion, level) - 1) {
+      globals::elements[element].ions[ion].levels[level].closestgroundlevelcont = index_in_groundlevelcontestimator;
+    }
+  }
+#endif
   assert_always(globals::nbfcontinua >= 0);  // was initialised as -1 before startup
 
   if (globals::nbfcontinua > 0) {
     // indicies above were temporary only. continum index should be to the sorted list
     std::sort(nonconstallcont, nonconstallcont + globals::nbfcontinua);
 
-    globals::allcont_nu_edge = static_cast<double *>(malloc(globals::nbfcontinua * sizeof(double)));
+    globals::allcont_nu_edge = arena::alloc_array<double>(globals::nbfcontinua, arena::ARENA_PHIXS);
 
 // copy the photoionisation tables into one contiguous block of memory
 #ifdef MPI_ON
     float *allphixsblock;
     MPI_Win win_allphixsblock;
-    MPI_Aint size = (globals::rank_in_node == 0) ? nbftables * globals::NPHIXSPOINTS * sizeof(float) : 0;
+    MPI_Aint size = (globals::rank_in_atomic_node == 0) ? nbftables * globals::NPHIXSPOINTS * sizeof(float) : 0;
     int disp_unit = sizeof(linelist_entry);
 
-    MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_node, &allphixsblock, &win_allphixsblock);
+    MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, globals::mpi_comm_atomic_node, &allphixsblock,
+                            &win_allphixsblock);
     MPI_Win_shared_query(win_allphixsblock, MPI_PROC_NULL, &size, &disp_unit, &allphixsblock);
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_atomic_node);
 #else
-    float *allphixsblock = static_cast<float *>(malloc(nbftables * globals::NPHIXSPOINTS * sizeof(float)));
+    float *allphixsblock = arena::alloc_array<float>(nbftables * globals::NPHIXSPOINTS, arena::ARENA_PHIXS);
 #endif
 
     assert_always(allphixsblock != NULL);
@@ -1601,7 +1707,7 @@ static void setup_phixs_list(void) {
 
       // different targets share the same cross section table, so don't repeat this process
       if (phixstargetindex == 0) {
-        if (globals::rank_in_node == 0) {
+        if (globals::rank_in_atomic_node == 0) {
           memcpy(allphixsblock, globals::elements[element].ions[ion].levels[level].photoion_xs,
                  globals::NPHIXSPOINTS * sizeof(float));
         }
@@ -1615,7 +1721,7 @@ static void setup_phixs_list(void) {
     }
     assert_always(nbftableschanged == nbftables);
 #ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_atomic_node);
 #endif
     for (int i = 0; i < globals::nbfcontinua; i++) {
       const int element = nonconstallcont[i].element;
@@ -1628,33 +1734,77 @@ static void setup_phixs_list(void) {
   nonconstallcont = nullptr;
 
   long mem_usage_photoionluts = 2 * TABLESIZE * globals::nbfcontinua * sizeof(double);
-  globals::spontrecombcoeff = static_cast<double *>(malloc(TABLESIZE * globals::nbfcontinua * sizeof(double)));
-  assert_always(globals::spontrecombcoeff != NULL);
+  globals::spontrecombcoeff = alloc_ratecoeff_table();
 
 #if (!NO_LUT_PHOTOION)
-  globals::corrphotoioncoeff = static_cast<double *>(malloc(TABLESIZE * globals::nbfcontinua * sizeof(double)));
-  assert_always(globals::corrphotoioncoeff != NULL);
+  globals::corrphotoioncoeff = alloc_ratecoeff_table();
   mem_usage_photoionluts += TABLESIZE * globals::nbfcontinua * sizeof(double);
 #endif
 #if (!NO_LUT_BFHEATING)
-  globals::bfheating_coeff = static_cast<double *>(malloc(TABLESIZE * globals::nbfcontinua * sizeof(double)));
-  assert_always(globals::bfheating_coeff != NULL);
+  globals::bfheating_coeff = alloc_ratecoeff_table();
   mem_usage_photoionluts += TABLESIZE * globals::nbfcontinua * sizeof(double);
 #endif
 
-  globals::bfcooling_coeff = static_cast<double *>(malloc(TABLESIZE * globals::nbfcontinua * sizeof(double)));
-  assert_always(globals::bfcooling_coeff != NULL);
+  globals::bfcooling_coeff = alloc_ratecoeff_table();
 
   printout(
       "[info] mem_usage: lookup tables derived from photoionisation (spontrecombcoeff, bfcooling and "
-      "corrphotoioncoeff/bfheating if enabled) occupy %.3f MB\n",
+      "corrphotoioncoeff/bfheating if enabled) occupy %.3f MB (node shared memory)\n",
       mem_usage_photoionluts / 1024. / 1024.);
 }
 
+static std::vector<std::pair<std::string, double>> setup_stage_seconds;
+static auto setup_stage_start = std::chrono::steady_clock::now();
+
+void setup_stage_done(const char *stagename)
+// record the wall time taken by a startup stage since the previous stage finished
+{
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(now - setup_stage_start).count();
+  setup_stage_seconds.emplace_back(stagename, seconds);
+  printout("[info] setup stage '%s' took %.2f s\n", stagename, seconds);
+  setup_stage_start = now;
+}
+
+void print_setup_stage_summary(void)
+// print a table of the startup stage times on this rank and the slowest rank. Must be called by all ranks.
+{
+  double totalseconds = 0.;
+  for (const auto &[stagename, seconds] : setup_stage_seconds) {
+    totalseconds += seconds;
+  }
+
+  printout("setup stage summary:\n");
+  printout("  %-28s %10s %10s %7s\n", "stage", "this rank", "max rank", "frac");
+  for (const auto &[stagename, seconds] : setup_stage_seconds) {
+    double maxseconds = seconds;
+#ifdef MPI_ON
+    MPI_Allreduce(&seconds, &maxseconds, 1, MPI_DOUBLE, MPI_MAX, globals::mpi_comm_model);
+#endif
+    printout("  %-28s %9.2fs %9.2fs %6.1f%%\n", stagename.c_str(), seconds, maxseconds,
+             totalseconds > 0. ? 100. * seconds / totalseconds : 0.);
+  }
+  printout("  %-28s %9.2fs\n", "total", totalseconds);
+}
+
 static void read_atomicdata(void)
 /// Subroutine to read in input parameters.
 {
+  ensemble::enter_shared_data_dir();
   read_atomicdata_files();
+  ensemble::leave_shared_data_dir();
+#ifdef MPI_ON
+  if (ensemble::active()) {
+    // the node-shared atomic data is only consistent if every model on the node selected the same lines
+    int nlines_min = 0;
+    int nlines_max = 0;
+    MPI_Allreduce(&globals::nlines, &nlines_min, 1, MPI_INT, MPI_MIN, globals::mpi_comm_atomic_node);
+    MPI_Allreduce(&globals::nlines, &nlines_max, 1, MPI_INT, MPI_MAX, globals::mpi_comm_atomic_node);
+    assert_always(nlines_min == nlines_max);
+  }
+#endif
+  setup_atomic_index_tables();
+  setup_stage_done("read atomic data files");
 
   printout("included ions %d\n", get_includedions());
 
@@ -1672,8 +1822,11 @@ static void read_atomicdata(void)
 #endif
 
   kpkt::setup_coolinglist();
+  kpkt::setup_planck_sampler();
+  setup_stage_done("cooling list");
 
   setup_cellhistory();
+  setup_stage_done("cellhistory");
 
   /// Printout some information about the read-in model atom
 
@@ -1707,6 +1860,9 @@ static void read_atomicdata(void)
   write_bflist_file(globals::nbfcontinua);
 
   setup_phixs_list();
+  setup_stage_done("photoionisation lists");
+
+  arena::report();
 
   /// set-up/gather information for nlte stuff
 
@@ -1749,12 +1905,14 @@ static void read_atomicdata(void)
 
   printout("[input.c] Total NLTE levels: %d, of which %d are superlevels\n", globals::total_nlte_levels,
            n_super_levels);
+  setup_stage_done("NLTE level setup");
 }
 
 void input(int rank)
 /// To govern the input. For now hardwire everything.
 {
   globals::homogeneous_abundances = false;
+  setup_stage_start = std::chrono::steady_clock::now();
 
   globals::npkts = MPKTS;
   /*  #ifdef FORCE_LTE
@@ -1791,6 +1949,7 @@ void input(int rank)
 
   /// Read in parameters from input.txt
   read_parameterfile(rank);
+  setup_stage_done("parameter file");
 
 /// Read in parameters from vpkt.txt
 #ifdef VPKT_ON
@@ -1802,11 +1961,13 @@ void input(int rank)
 #ifdef MPI_ON
   const time_t time_before_barrier = time(NULL);
   printout("barrier after read_atomicdata(): time before barrier %d, ", (int)time_before_barrier);
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   printout("time after barrier %d (waited %d seconds)\n", (int)time(NULL), (int)(time(NULL) - time_before_barrier));
+  setup_stage_done("barrier after atomic data");
 #endif
 
   grid::read_ejecta_model();
+  setup_stage_done("ejecta model");
 
   /// Now that the list exists use it to find values for spectral synthesis
   /// stuff.
@@ -1871,6 +2032,39 @@ static void init_curand(unsigned long int pre_zseed, int rank) {
 #endif
 
 #ifndef __CUDA_ARCH__
+#if defined TESTMODE && TESTMODE
+static void time_rng_generators(void)
+// compare the cost of a uniform draw from the GSL generator against the inline generator on scratch copies of the
+// states (the sequences used by the simulation are unaffected)
+{
+  constexpr int ndraws = 1000000;
+  double zsum = 0.;
+
+  gsl_rng *rng_gsl = gsl_rng_alloc(gsl_rng_ran3);
+  gsl_rng_set(rng_gsl, 1);
+  const auto gsl_start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < ndraws; i++) {
+    zsum += gsl_rng_uniform(rng_gsl);
+  }
+  const auto gsl_end = std::chrono::high_resolution_clock::now();
+  const std::string gsl_name(gsl_rng_name(rng_gsl));
+  gsl_rng_free(rng_gsl);
+
+  std::uint64_t s[4];
+  rng_xoshiro_seed(s, 1);
+  const auto xoshiro_start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < ndraws; i++) {
+    zsum += static_cast<double>(rng_xoshiro_next(s) >> 11) * 0x1.0p-53;
+  }
+  const auto xoshiro_end = std::chrono::high_resolution_clock::now();
+
+  const double ns_gsl = std::chrono::duration<double, std::nano>(gsl_end - gsl_start).count() / ndraws;
+  const double ns_xoshiro = std::chrono::duration<double, std::nano>(xoshiro_end - xoshiro_start).count() / ndraws;
+  printout("rng timing: %s %.2f ns/draw, xoshiro256++ %.2f ns/draw (speedup %.1fx, checksum %g)\n",
+           gsl_name.c_str(), ns_gsl, ns_xoshiro, ns_gsl / ns_xoshiro, zsum);
+}
+#endif
+
 void read_parameterfile(int rank)
 /// Subroutine to read in input parameters from input.txt.
 {
@@ -1910,15 +2104,24 @@ void read_parameterfile(int rank)
     /// start by setting up the randon number generator
     rng = gsl_rng_alloc(gsl_rng_ran3);
     gsl_rng_set(rng, zseed);
+    rng_xoshiro_seed(rng_xoshiro_state, zseed);
     /// call it a few times to get it in motion.
     for (int n = 0; n < 100; n++) {
-      gsl_rng_uniform(rng);
+      rng_uniform();
+    }
+    if constexpr (USE_XOSHIRO_RNG) {
+      printout("rng is an inline xoshiro256++ generator\n");
+    } else {
+      printout("rng is a '%s' generator\n", gsl_rng_name(rng));
     }
-    printout("rng is a '%s' generator\n", gsl_rng_name(rng));
 #ifdef _OPENMP
   }
 #endif
 
+#if defined TESTMODE && TESTMODE
+  time_rng_generators();
+#endif
+
   assert_always(get_noncommentline(file, line));
   std::stringstream(line) >> globals::ntstep;  // number of time steps
   assert_always(globals::ntstep > 0);
@@ -2002,8 +2205,8 @@ void read_parameterfile(int rank)
     globals::syn_dir[1] = syn_dir_in[1] / sqrt(rr);
     globals::syn_dir[2] = syn_dir_in[2] / sqrt(rr);
   } else {
-    const double z1 = 1. - (2 * gsl_rng_uniform(rng));
-    const double z2 = gsl_rng_uniform(rng) * 2.0 * PI;
+    const double z1 = 1. - (2 * rng_uniform());
+    const double z2 = rng_uniform() * 2.0 * PI;
     globals::syn_dir[2] = z1;
     globals::syn_dir[0] = sqrt((1. - (z1 * z1))) * cos(z2);
     globals::syn_dir[1] = sqrt((1. - (z1 * z1))) * sin(z2);
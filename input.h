@@ -11,6 +11,8 @@ void read_parameterfile(int rank);
 void update_parameterfile(int nts);
 void time_init(void);
 void write_timestep_file(void);
+void setup_stage_done(const char *stagename);
+void print_setup_stage_summary(void);
 bool get_noncommentline(std::istream &input, std::string &line);
 
 static inline bool lineiscommentonly(const std::string &line)
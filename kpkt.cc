@@ -2,7 +2,9 @@
 
 #include <gsl/gsl_integration.h>
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "atomic.h"
 #include "grid.h"
@@ -81,6 +83,246 @@ __host__ __device__ static double get_bfcoolingcoeff(int element, int ion, int l
     return globals::bfcooling_coeff[get_bflutindex(TABLESIZE - 1, element, ion, level, phixstargetindex)];
 }
 
+// With COOLING_RATES_FACTORISED, the temperature-independent factors of the collisional ionisation and free-bound
+// cooling of each continuum are stored in flat arrays, in the order of the level and phixstargetindex loops of
+// calculate_cooling_rates. The continua of an ion are [bfcont_start[uniqueionindex], bfcont_start[uniqueionindex + 1])
+static __managed__ int *bfcont_start = NULL;
+static __managed__ int *bfcont_level = NULL;             // lower level of the continuum
+static __managed__ double *bfcont_epsilon_trans = NULL;  // ionisation energy from the lower level to the target
+static __managed__ double *bfcont_colion_factor = NULL;  // Gaunt factor times the threshold cross section
+static __managed__ int *bfcont_lutindex = NULL;          // index of the continuum in the bfcooling_coeff table rows
+static __managed__ int max_ionisinglevels = 0;
+// per-thread work buffers of max_ionisinglevels level populations, indexed by the thread number in the current team
+// (the threads of the cell loop, or of the intra-cell team in intracell_parallel mode)
+static __managed__ double *nnlevels_thread = NULL;
+
+__host__ __device__ static double *get_thread_nnlevels(void) {
+  return (nnlevels_thread != NULL) ? &nnlevels_thread[get_thread_num() * max_ionisinglevels] : NULL;
+}
+
+static void setup_factorised_continua(void) {
+  const int nincludedions = get_includedions();
+  bfcont_start = static_cast<int *>(malloc((nincludedions + 1) * sizeof(int)));
+
+  int ncont = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    // first pass counts the continua, second pass fills in the factors
+    ncont = 0;
+    for (int element = 0; element < get_nelements(); element++) {
+      const int nions = get_nions(element);
+      for (int ion = 0; ion < nions; ion++) {
+        if (pass == 0) {
+          bfcont_start[get_uniqueionindex(element, ion)] = ncont;
+          max_ionisinglevels = std::max(max_ionisinglevels, get_ionisinglevels(element, ion));
+        }
+        if (ion >= nions - 1) {
+          continue;
+        }
+
+        // Seaton approximation gaunt factor according to ionic charge (as in col_ionization_ratecoeff)
+        const int ionstage = get_ionstage(element, ion);
+        const double g = (ionstage == 1) ? 0.1 : ((ionstage == 2) ? 0.2 : 0.3);
+
+        for (int level = 0; level < get_ionisinglevels(element, ion); level++) {
+          for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level);
+               phixstargetindex++) {
+            if (pass == 1) {
+              const int upper = get_phixsupperlevel(element, ion, level, phixstargetindex);
+              bfcont_level[ncont] = level;
+              bfcont_epsilon_trans[ncont] = epsilon(element, ion + 1, upper) - epsilon(element, ion, level);
+              bfcont_colion_factor[ncont] = g * globals::elements[element].ions[ion].levels[level].photoion_xs[0] *
+                                            get_phixsprobability(element, ion, level, phixstargetindex);
+              bfcont_lutindex[ncont] = get_bflutindex(0, element, ion, level, phixstargetindex);
+            }
+            ncont++;
+          }
+        }
+      }
+    }
+
+    if (pass == 0) {
+      bfcont_start[nincludedions] = ncont;
+      bfcont_level = static_cast<int *>(malloc(ncont * sizeof(int)));
+      bfcont_epsilon_trans = static_cast<double *>(malloc(ncont * sizeof(double)));
+      bfcont_colion_factor = static_cast<double *>(malloc(ncont * sizeof(double)));
+      bfcont_lutindex = static_cast<int *>(malloc(ncont * sizeof(int)));
+    }
+  }
+
+  nnlevels_thread = static_cast<double *>(malloc(get_max_threads() * max_ionisinglevels * sizeof(double)));
+
+  printout("[info] mem_usage: factorised cooling continua (%d) occupy %.3f MB\n", ncont,
+           ncont * (2 * sizeof(int) + 2 * sizeof(double)) / 1024. / 1024.);
+}
+
+static void check_factorised_continua(void)
+// compare the factorised collisional ionisation cooling of each continuum with col_ionization_ratecoeff at a few
+// temperatures (this catches cross sections that changed after the factors were stored)
+{
+  const double nne = 1.;
+  double maxreldiff = 0.;
+  for (const double T_e : {3000., 1e4, 3e4}) {
+    const double colion_prefactor = nne * 1.55e13 * KB * std::sqrt(T_e);
+    int c = 0;
+    for (int element = 0; element < get_nelements(); element++) {
+      const int nions = get_nions(element);
+      for (int ion = 0; ion < nions - 1; ion++) {
+        for (int level = 0; level < get_ionisinglevels(element, ion); level++) {
+          for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level);
+               phixstargetindex++) {
+            const double epsilon_trans = bfcont_epsilon_trans[c];
+            const double C_factorised = colion_prefactor * bfcont_colion_factor[c] * exp(-epsilon_trans / KB / T_e);
+            const double C_direct =
+                col_ionization_ratecoeff(T_e, nne, element, ion, level, phixstargetindex, epsilon_trans) *
+                epsilon_trans;
+            if (C_direct > 0.) {
+              maxreldiff = std::max(maxreldiff, std::fabs(C_factorised - C_direct) / C_direct);
+            }
+            c++;
+          }
+        }
+      }
+    }
+    assert_always(c == bfcont_start[get_includedions()]);
+  }
+  printout("factorised collisional ionisation cooling: max relative difference from col_ionization_ratecoeff %g\n",
+           maxreldiff);
+  assert_always(maxreldiff < 1e-6);
+}
+
+void setup_factorised_cooling(void) {
+  if constexpr (COOLING_RATES_FACTORISED) {
+    setup_factorised_continua();
+    check_factorised_continua();
+  }
+}
+
+__host__ __device__ static void get_cooling_ion_bf_factorised(const int modelgridindex, const int element,
+                                                              const int ion, const double T_e, const double nne,
+                                                              double *nnlevels, double *C_ionization, double *C_fb)
+// collisional ionisation and free-bound cooling of an ion from the flat continuum arrays. Only the factors that
+// depend on T_e are evaluated per continuum, and the populations are looked up once per level and ion
+{
+  const int uniqueionindex = get_uniqueionindex(element, ion);
+  const int cont_start = bfcont_start[uniqueionindex];
+  const int cont_end = bfcont_start[uniqueionindex + 1];
+  *C_ionization = 0.;
+  *C_fb = 0.;
+  if (cont_end == cont_start) {
+    return;
+  }
+
+  const int nionisinglevels = get_ionisinglevels(element, ion);
+  for (int level = 0; level < nionisinglevels; level++) {
+    nnlevels[level] = get_levelpop(modelgridindex, element, ion, level);
+  }
+  const double nnupperion = ionstagepop(modelgridindex, element, ion + 1);
+
+  // col_ionization_ratecoeff * epsilon_trans = nne * 1.55e13 * KB * sqrt(T_e) * g * sigma_bf * exp(-epsilon_trans/kT)
+  const double colion_prefactor = nne * 1.55e13 * KB * std::sqrt(T_e);
+  const double oneoverkT = 1. / KB / T_e;
+
+  // linear interpolation in T_e of the bf cooling coefficient table (as in get_bfcoolingcoeff)
+  const int lowerindex = std::max(0, static_cast<int>(floor(log(T_e / MINTEMP) / T_step_log)));
+  const int upperindex = std::min(lowerindex + 1, TABLESIZE - 1);
+  double upperweight = 0.;
+  if (lowerindex < TABLESIZE - 1) {
+    const double T_lower = MINTEMP * exp(lowerindex * T_step_log);
+    const double T_upper = MINTEMP * exp(upperindex * T_step_log);
+    upperweight = (T_e - T_lower) / (T_upper - T_lower);
+  }
+  const double *bfcooling_lower = &globals::bfcooling_coeff[std::min(lowerindex, TABLESIZE - 1) * globals::nbfcontinua];
+  const double *bfcooling_upper = &globals::bfcooling_coeff[upperindex * globals::nbfcontinua];
+
+  double colion_sum = 0.;
+  double fb_sum = 0.;
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : colion_sum, fb_sum)
+#endif
+  for (int c = cont_start; c < cont_end; c++) {
+    colion_sum += nnlevels[bfcont_level[c]] * bfcont_colion_factor[c] * exp(-bfcont_epsilon_trans[c] * oneoverkT);
+
+    const double f_lower = bfcooling_lower[bfcont_lutindex[c]];
+    const double f_upper = bfcooling_upper[bfcont_lutindex[c]];
+    fb_sum += f_lower + (f_upper - f_lower) * upperweight;
+  }
+
+  *C_ionization = colion_prefactor * colion_sum;
+  *C_fb = nnupperion * nne * fb_sum;
+}
+
+__host__ __device__ static double calculate_cooling_rates_ion(const int modelgridindex, const int element,
+                                                              const int ion, const float T_e, const float nne,
+                                                              double *nnlevels, double *C_ff, double *C_fb,
+                                                              double *C_exc, double *C_ionization)
+// return the total cooling rate of an ion and add its components to the totals. nnlevels is a work buffer of
+// max_ionisinglevels entries for the factorised bound-free cooling
+{
+  const int nions = get_nions(element);
+  double C_ion = 0.;  /// all cooling for an ion
+  const int nionisinglevels = get_ionisinglevels(element, ion);
+  const double nncurrention = ionstagepop(modelgridindex, element, ion);
+
+  /// ff creation of rpkt
+  const int ioncharge = get_ionstage(element, ion) - 1;
+  if (ioncharge > 0) {
+    const double C_ff_ion = 1.426e-27 * sqrt(T_e) * pow(ioncharge, 2) * nncurrention * nne;
+    *C_ff += C_ff_ion;
+    C_ion += C_ff_ion;
+  }
+
+  const double C_exc_ion = get_cooling_ion_coll_exc(modelgridindex, element, ion, T_e, nne);
+  *C_exc += C_exc_ion;
+  C_ion += C_exc_ion;
+
+  if constexpr (COOLING_RATES_FACTORISED) {
+    if (ion < nions - 1) {
+      double C_ionization_ion = 0.;
+      double C_fb_ion = 0.;
+      get_cooling_ion_bf_factorised(modelgridindex, element, ion, T_e, nne, nnlevels, &C_ionization_ion, &C_fb_ion);
+      *C_ionization += C_ionization_ion;
+      *C_fb += C_fb_ion;
+      C_ion += C_ionization_ion + C_fb_ion;
+    }
+  } else if (ion < nions - 1) {
+    for (int level = 0; level < nionisinglevels; level++) {
+      // printout("[debug] do_kpkt: element %d, ion %d, level %d\n",element,ion,level);
+      const double epsilon_current = epsilon(element, ion, level);
+      const double nnlevel = get_levelpop(modelgridindex, element, ion, level);
+      // printout("    ionisation possible\n");
+      /// ionization to higher ionization stage
+      /// -------------------------------------
+      for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level); phixstargetindex++) {
+        const int upper = get_phixsupperlevel(element, ion, level, phixstargetindex);
+        const double epsilon_trans = epsilon(element, ion + 1, upper) - epsilon_current;
+        // printout("cooling list: col_ionization\n");
+        const double C_ionization_ion_thistarget =
+            nnlevel * col_ionization_ratecoeff(T_e, nne, element, ion, level, phixstargetindex, epsilon_trans) *
+            epsilon_trans;
+        *C_ionization += C_ionization_ion_thistarget;
+        C_ion += C_ionization_ion_thistarget;
+      }
+
+      /// fb creation of r-pkt
+      /// free bound rates are calculated from the lower ion, but associated to the higher ion
+      /// --------------------
+      for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level); phixstargetindex++) {
+        // const int upper = get_phixsupperlevel(element,ion,level,phixstargetindex);
+        // const double nnupperlevel = get_levelpop(modelgridindex, element, ion + 1, upper);
+        const double nnupperion = ionstagepop(modelgridindex, element, ion + 1);
+
+        const double C_fb_ion_thistarget =
+            get_bfcoolingcoeff(element, ion, level, phixstargetindex, T_e) * nnupperion * nne;
+        *C_fb += C_fb_ion_thistarget;
+        C_ion += C_fb_ion_thistarget;
+      }
+    }
+  }
+
+  grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion] = C_ion;
+  return C_ion;
+}
+
 __host__ __device__ void calculate_cooling_rates(const int modelgridindex,
                                                  struct heatingcoolingrates *heatingcoolingrates)
 // Calculate the cooling rates for a given cell and store them for each ion
@@ -94,64 +336,27 @@ __host__ __device__ void calculate_cooling_rates(const int modelgridindex,
   double C_fb_all = 0.;          /// free-bound creation of rpkt
   double C_exc_all = 0.;         /// collisional excitation of macroatoms
   double C_ionization_all = 0.;  /// collisional ionisation of macroatoms
-  for (int element = 0; element < get_nelements(); element++) {
-    const int nions = get_nions(element);
-    for (int ion = 0; ion < nions; ion++) {
-      double C_ion = 0.;  /// all cooling for an ion
-      const int nionisinglevels = get_ionisinglevels(element, ion);
-      const double nncurrention = ionstagepop(modelgridindex, element, ion);
 
-      /// ff creation of rpkt
-      const int ioncharge = get_ionstage(element, ion) - 1;
-      if (ioncharge > 0) {
-        const double C_ff_ion = 1.426e-27 * sqrt(T_e) * pow(ioncharge, 2) * nncurrention * nne;
-        C_ff_all += C_ff_ion;
-        C_ion += C_ff_ion;
-      }
-
-      const double C_exc_ion = get_cooling_ion_coll_exc(modelgridindex, element, ion, T_e, nne);
-      C_exc_all += C_exc_ion;
-      C_ion += C_exc_ion;
-
-      if (ion < nions - 1) {
-        for (int level = 0; level < nionisinglevels; level++) {
-          // printout("[debug] do_kpkt: element %d, ion %d, level %d\n",element,ion,level);
-          const double epsilon_current = epsilon(element, ion, level);
-          const double nnlevel = get_levelpop(modelgridindex, element, ion, level);
-          // printout("    ionisation possible\n");
-          /// ionization to higher ionization stage
-          /// -------------------------------------
-          for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level);
-               phixstargetindex++) {
-            const int upper = get_phixsupperlevel(element, ion, level, phixstargetindex);
-            const double epsilon_trans = epsilon(element, ion + 1, upper) - epsilon_current;
-            // printout("cooling list: col_ionization\n");
-            const double C_ionization_ion_thistarget =
-                nnlevel * col_ionization_ratecoeff(T_e, nne, element, ion, level, phixstargetindex, epsilon_trans) *
-                epsilon_trans;
-            C_ionization_all += C_ionization_ion_thistarget;
-            C_ion += C_ionization_ion_thistarget;
-          }
-
-          /// fb creation of r-pkt
-          /// free bound rates are calculated from the lower ion, but associated to the higher ion
-          /// --------------------
-          for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level);
-               phixstargetindex++) {
-            // const int upper = get_phixsupperlevel(element,ion,level,phixstargetindex);
-            // const double nnupperlevel = get_levelpop(modelgridindex, element, ion + 1, upper);
-            const double nnupperion = ionstagepop(modelgridindex, element, ion + 1);
-
-            const double C_fb_ion_thistarget =
-                get_bfcoolingcoeff(element, ion, level, phixstargetindex, T_e) * nnupperion * nne;
-            C_fb_all += C_fb_ion_thistarget;
-            C_ion += C_fb_ion_thistarget;
-          }
-        }
+  if (globals::intracell_parallel) {
+    // the ions are independent, so they are divided between the threads
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+ : C_total, C_ff_all, C_fb_all, C_exc_all, C_ionization_all)
+#endif
+    for (int uniqueionindex = 0; uniqueionindex < get_includedions(); uniqueionindex++) {
+      int element = 0;
+      int ion = 0;
+      get_ionfromuniqueionindex(uniqueionindex, &element, &ion);
+      C_total += calculate_cooling_rates_ion(modelgridindex, element, ion, T_e, nne, get_thread_nnlevels(), &C_ff_all,
+                                             &C_fb_all, &C_exc_all, &C_ionization_all);
+    }
+  } else {
+    double *nnlevels = get_thread_nnlevels();
+    for (int element = 0; element < get_nelements(); element++) {
+      const int nions = get_nions(element);
+      for (int ion = 0; ion < nions; ion++) {
+        C_total += calculate_cooling_rates_ion(modelgridindex, element, ion, T_e, nne, nnlevels, &C_ff_all, &C_fb_all,
+                                               &C_exc_all, &C_ionization_all);
       }
-
-      C_total += C_ion;
-      grid::modelgrid[modelgridindex].cooling_contrib_ion[element][ion] = C_ion;
     }
   }
   grid::modelgrid[modelgridindex].totalcooling = C_total;
@@ -425,10 +630,111 @@ void setup_coolinglist(void) {
   printout("[info] read_atomicdata: number of coolingterms %d\n", globals::ncoolingterms);
 }
 
+// tabulated cumulative distribution of the dimensionless Planck function x^3 / (e^x - 1) with x = h nu / kT on a
+// uniform grid in x. planck_cdf_upper is the complementary distribution (1 - CDF), kept separately so that the Wien
+// tail keeps full relative precision
+constexpr double PLANCK_CDF_XMAX = 700.;
+constexpr int PLANCK_CDF_NX = 35001;
+constexpr double PLANCK_CDF_DX = PLANCK_CDF_XMAX / (PLANCK_CDF_NX - 1);
+static __managed__ double *planck_cdf = NULL;
+static __managed__ double *planck_cdf_upper = NULL;
+
+static double planck_x3_over_expm1(const double x) { return (x > 0.) ? x * x * x / std::expm1(x) : 0.; }
+
+void setup_planck_sampler(void)
+// tabulate the dimensionless Planck CDF for sample_planck()
+{
+  if constexpr (!PLANCK_INVERSE_CDF_SAMPLING) {
+    return;
+  }
+
+  planck_cdf = static_cast<double *>(malloc(PLANCK_CDF_NX * sizeof(double)));
+  planck_cdf_upper = static_cast<double *>(malloc(PLANCK_CDF_NX * sizeof(double)));
+  assert_always(planck_cdf != NULL);
+  assert_always(planck_cdf_upper != NULL);
+
+  constexpr double norm = 15. / (PI * PI * PI * PI);  // integral of x^3 / (e^x - 1) from 0 to infinity is pi^4 / 15
+
+  // Simpson's rule over each interval
+  auto interval_integral = [](const double x_a, const double x_b) {
+    return (x_b - x_a) / 6. *
+           (planck_x3_over_expm1(x_a) + 4 * planck_x3_over_expm1((x_a + x_b) / 2) + planck_x3_over_expm1(x_b));
+  };
+
+  planck_cdf[0] = 0.;
+  for (int i = 1; i < PLANCK_CDF_NX; i++) {
+    planck_cdf[i] = planck_cdf[i - 1] + norm * interval_integral((i - 1) * PLANCK_CDF_DX, i * PLANCK_CDF_DX);
+  }
+
+  // the part above XMAX is given by the Wien limit, integral of x^3 e^-x from X to infinity
+  const double X = PLANCK_CDF_XMAX;
+  planck_cdf_upper[PLANCK_CDF_NX - 1] = norm * std::exp(-X) * (X * X * X + 3 * X * X + 6 * X + 6);
+  for (int i = PLANCK_CDF_NX - 2; i >= 0; i--) {
+    planck_cdf_upper[i] =
+        planck_cdf_upper[i + 1] + norm * interval_integral(i * PLANCK_CDF_DX, (i + 1) * PLANCK_CDF_DX);
+  }
+
+  printout("[info] setup_planck_sampler: tabulated Planck CDF at %d points (total %.8f)\n", PLANCK_CDF_NX,
+           planck_cdf[PLANCK_CDF_NX - 1] + planck_cdf_upper[PLANCK_CDF_NX - 1]);
+}
+
+__host__ __device__ static double get_planck_cdf(const double x, const bool upper)
+// the Planck CDF (or 1 - CDF if upper) at x, interpolating linearly in the CDF or in the log of 1 - CDF
+{
+  const double xclamped = std::min(std::max(x, 0.), PLANCK_CDF_XMAX);
+  const int i = std::min(static_cast<int>(xclamped / PLANCK_CDF_DX), PLANCK_CDF_NX - 2);
+  const double frac = (xclamped - i * PLANCK_CDF_DX) / PLANCK_CDF_DX;
+  if (upper) {
+    return std::exp(std::log(planck_cdf_upper[i]) +
+                    frac * (std::log(planck_cdf_upper[i + 1]) - std::log(planck_cdf_upper[i])));
+  }
+  return planck_cdf[i] + frac * (planck_cdf[i + 1] - planck_cdf[i]);
+}
+
+__host__ __device__ static double sample_planck_inverse_cdf(const double T)
+// sample x = h nu / kT from the Planck distribution truncated to [nu_min_r, nu_max_r] with a single random number,
+// by inverting the tabulated CDF. Truncated ranges above the peak are inverted in 1 - CDF.
+{
+  const double x_min = HOVERKB * globals::nu_min_r / T;
+  const double x_max = HOVERKB * globals::nu_max_r / T;
+  const bool upper = get_planck_cdf(x_min, false) > 0.5;
+
+  const double cdf_min = get_planck_cdf(x_min, upper);
+  const double cdf_max = get_planck_cdf(x_max, upper);
+  const double cdf_target = cdf_min + rng_uniform() * (cdf_max - cdf_min);
+
+  // find the interval with the target between its endpoints (planck_cdf increases and planck_cdf_upper decreases)
+  const double *table = upper ? planck_cdf_upper : planck_cdf;
+  int low = 0;
+  int high = PLANCK_CDF_NX - 1;
+  while (high - low > 1) {
+    const int mid = (low + high) / 2;
+    if ((table[mid] < cdf_target) != upper) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  double frac = 0.;
+  if (upper) {
+    frac = (std::log(cdf_target) - std::log(table[low])) / (std::log(table[high]) - std::log(table[low]));
+  } else if (table[high] > table[low]) {
+    frac = (cdf_target - table[low]) / (table[high] - table[low]);
+  }
+  const double x = std::min(std::max((low + frac) * PLANCK_CDF_DX, x_min), x_max);
+
+  return x * T / HOVERKB;
+}
+
 __host__ __device__ static double sample_planck(const double T)
 /// returns a randomly chosen frequency according to the Planck
 /// distribution of temperature T
 {
+  if constexpr (PLANCK_INVERSE_CDF_SAMPLING) {
+    return sample_planck_inverse_cdf(T);
+  }
+
   const double nu_peak = 5.879e10 * T;
   if (nu_peak > globals::nu_max_r || nu_peak < globals::nu_min_r) {
     printout("[warning] sample_planck: intensity peaks outside frequency range\n");
@@ -437,8 +743,8 @@ __host__ __device__ static double sample_planck(const double T)
   const double B_peak = radfield::dbb(nu_peak, T, 1);
 
   while (true) {
-    const double zrand = gsl_rng_uniform(rng);
-    const double zrand2 = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
+    const double zrand2 = rng_uniform();
     const double nu = globals::nu_min_r + zrand * (globals::nu_max_r - globals::nu_min_r);
     if (zrand2 * B_peak <= radfield::dbb(nu, T, 1)) return nu;
     // printout("[debug] sample_planck: planck_sampling %d\n", i);
@@ -517,7 +823,7 @@ __host__ __device__ double do_kpkt(struct packet *pkt_ptr, double t2, int nts)
 
     /// Randomly select the occuring cooling process out of the important ones
     double coolingsum = 0.;
-    double zrand = gsl_rng_uniform(rng);
+    double zrand = rng_uniform();
 
     const double rndcool = zrand * grid::modelgrid[modelgridindex].totalcooling;
     // printout("rndcool %g totalcooling %g\n",rndcool, grid::modelgrid[modelgridindex].totalcooling);
@@ -605,9 +911,9 @@ __host__ __device__ double do_kpkt(struct packet *pkt_ptr, double t2, int nts)
       // kdecay.to_r++;
 
       /// Sample the packets comoving frame frequency according to paperII 5.4.3 eq.41
-      // zrand = gsl_rng_uniform(rng);   /// delivers zrand in [0,1[
+      // zrand = rng_uniform();   /// delivers zrand in [0,1[
       // zrand = 1. - zrand;             /// make sure that log gets a zrand in ]0,1]
-      zrand = gsl_rng_uniform_pos(rng);  /// delivers zrand in ]0,1[
+      zrand = rng_uniform_pos();  /// delivers zrand in ]0,1[
       pkt_ptr->nu_cmf = -KB * T_e / H * log(zrand);
 
       if (!std::isfinite(pkt_ptr->nu_cmf)) {
@@ -648,14 +954,14 @@ __host__ __device__ double do_kpkt(struct packet *pkt_ptr, double t2, int nts)
 
       /// then randomly sample the packets frequency according to the continuums
       /// energy distribution and set some flags
-      // zrand = gsl_rng_uniform(rng);   /// delivers zrand in [0,1[
+      // zrand = rng_uniform();   /// delivers zrand in [0,1[
       // zrand = 1. - zrand;   /// convert it to ]0,1]
       // pkt_ptr->nu_cmf = nu_threshold * (1 - KB*T_e/H/nu_threshold*log(zrand));
       // pkt_ptr->nu_cmf = nu_threshold * (1+sqrt(1+(4*KB*T_e/H/nu_threshold)))/2 * (1 -
       // KB*T_e/H/nu_threshold*log(zrand)); pkt_ptr->nu_cmf = nu_threshold;
 
       // Sample the packets comoving frame frequency according to paperII 4.2.2
-      // zrand = gsl_rng_uniform(rng);
+      // zrand = rng_uniform();
       // if (zrand < 0.5)
       { pkt_ptr->nu_cmf = select_continuum_nu(element, lowerion, level, upper, T_e); }
       // else
@@ -9,6 +9,9 @@
 namespace kpkt {
 
 void setup_coolinglist(void);
+// with COOLING_RATES_FACTORISED: call after ratecoefficients_init, which can rescale the photoionisation cross sections
+void setup_factorised_cooling(void);
+void setup_planck_sampler(void);
 __host__ __device__ void calculate_cooling_rates(int modelgridindex, struct heatingcoolingrates *heatingcoolingrates);
 __host__ __device__ double do_kpkt_bb(struct packet *pkt_ptr);
 __host__ __device__ double do_kpkt(struct packet *pkt_ptr, double t2, int nts);
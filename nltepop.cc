@@ -6,9 +6,11 @@
 #include <gsl/gsl_matrix_double.h>
 #include <gsl/gsl_vector_double.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <memory>
+#include <vector>
 
 #include "atomic.h"
 #include "grid.h"
@@ -676,6 +678,42 @@ static bool lumatrix_is_singular(const gsl_matrix *LU, const int element) {
   return is_singular;
 }
 
+static void nltepop_popvec_from_normed_solution(const int element, const gsl_matrix *rate_matrix, const gsl_vector *x,
+                                                gsl_vector *popvec, const gsl_vector *pop_normfactor_vec)
+// get the real populations using the x vector and the normalisation factors
+{
+  const unsigned int nlte_dimension = x->size;
+
+  gsl_vector_memcpy(popvec, x);
+  gsl_vector_mul(popvec, pop_normfactor_vec);
+  // popvec will be used contains the real population densities
+
+  for (unsigned int row = 0; row < nlte_dimension; row++) {
+    double recovered_balance_vector_elem = 0.;
+    gsl_vector_const_view row_view = gsl_matrix_const_row(rate_matrix, row);
+    gsl_blas_ddot(&row_view.vector, x, &recovered_balance_vector_elem);
+
+    int ion, level;
+    get_ion_level_of_nlte_vector_index(row, element, &ion, &level);
+
+    // printout("index %4d (ion_stage %d level%4d): recovered balance: %+.2e normed pop %.2e pop %.2e
+    // departure ratio %.4f\n",
+    //          row,get_ionstage(element,ion),level,
+    //          recovered_balance_vector_elem, gsl_vector_get(x,row),
+    //          gsl_vector_get(popvec, row),
+    //          gsl_vector_get(x, row) / gsl_vector_get(x,get_nlte_vector_index(element,ion,0)));
+
+    if (gsl_vector_get(popvec, row) < 0.0) {
+      printout(
+          "  WARNING: NLTE solver gave negative population to index %ud (Z=%d ion_stage %d level %d), pop = %g. "
+          "Replacing with LTE pop of %g\n",
+          row, get_element(element), get_ionstage(element, ion), level,
+          gsl_vector_get(x, row) * gsl_vector_get(pop_normfactor_vec, row), gsl_vector_get(pop_normfactor_vec, row));
+      gsl_vector_set(popvec, row, gsl_vector_get(pop_normfactor_vec, row));
+    }
+  }
+}
+
 static bool nltepop_matrix_solve(const int element, const gsl_matrix *rate_matrix, const gsl_vector *balance_vector,
                                  gsl_vector *popvec, const gsl_vector *pop_normfactor_vec)
 // solve rate_matrix * x = balance_vector,
@@ -754,47 +792,495 @@ static bool nltepop_matrix_solve(const int element, const gsl_matrix *rate_matri
     gsl_vector_free(x_best);
     gsl_vector_free(gsl_work_vector);
 
-    // get the real populations using the x vector and the normalisation factors
-    gsl_vector_memcpy(popvec, x);
-    gsl_vector_mul(popvec, pop_normfactor_vec);
-    // popvec will be used contains the real population densities
+    nltepop_popvec_from_normed_solution(element, rate_matrix, x, popvec, pop_normfactor_vec);
 
-    for (unsigned int row = 0; row < nlte_dimension; row++) {
-      double recovered_balance_vector_elem = 0.;
-      gsl_vector_const_view row_view = gsl_matrix_const_row(rate_matrix, row);
-      gsl_blas_ddot(&row_view.vector, x, &recovered_balance_vector_elem);
+    gsl_vector_free(residual_vector);
+    completed_solution = true;
+  }
 
-      int ion, level;
-      get_ion_level_of_nlte_vector_index(row, element, &ion, &level);
+  gsl_vector_free(x);
+  gsl_matrix_free(rate_matrix_LU_decomp);
+  gsl_permutation_free(p);
 
-      // printout("index %4d (ion_stage %d level%4d): residual %+.2e recovered balance: %+.2e normed pop %.2e pop %.2e
-      // departure ratio %.4f\n",
-      //          row,get_ionstage(element,ion),level, gsl_vector_get(residual_vector,row),
-      //          recovered_balance_vector_elem, gsl_vector_get(x,row),
-      //          gsl_vector_get(popvec, row),
-      //          gsl_vector_get(x, row) / gsl_vector_get(x,get_nlte_vector_index(element,ion,0)));
+  return completed_solution;
+}
 
-      if (gsl_vector_get(popvec, row) < 0.0) {
-        printout(
-            "  WARNING: NLTE solver gave negative population to index %ud (Z=%d ion_stage %d level %d), pop = %g. "
-            "Replacing with LTE pop of %g\n",
-            row, get_element(element), get_ionstage(element, ion), level,
-            gsl_vector_get(x, row) * gsl_vector_get(pop_normfactor_vec, row), gsl_vector_get(pop_normfactor_vec, row));
-        gsl_vector_set(popvec, row, gsl_vector_get(pop_normfactor_vec, row));
+static bool nltepop_matrix_solve_blockwise(const int element, gsl_matrix *A, gsl_vector *b, gsl_vector *x)
+// solve A * x = b by block Gaussian elimination over the ion blocks of the NLTE vector (A and b are overwritten).
+// Each diagonal ion block is LU factorised on its own. The off-diagonal blocks (ionisation and recombination)
+// only have non-zero entries in a few rows and columns (phixs target levels, recombining levels, and ground states),
+// so the Schur complement updates are low rank and the cost grows with the sum of the per-ion costs
+// instead of the cube of the total number of levels.
+// There is no pivoting between blocks, so A must not contain the dense normalisation row
+{
+  const int nions = get_nions(element);
+  const int nlte_dimension = b->size;
+
+  std::vector<int> block_start(nions + 1);
+  for (int ion = 0; ion < nions; ion++) {
+    block_start[ion] = get_nlte_vector_index(element, ion, 0);
+  }
+  block_start[nions] = nlte_dimension;
+
+  std::vector<gsl_permutation *> block_perm(nions, NULL);
+  std::vector<std::vector<int>> block_couplecols(nions);
+  bool singular = false;
+
+  // forward elimination
+  for (int ion = 0; ion < nions && !singular; ion++) {
+    const int start = block_start[ion];
+    const int end = block_start[ion + 1];
+    const int nk = end - start;
+
+    gsl_matrix_view diagblock = gsl_matrix_submatrix(A, start, start, nk, nk);
+    block_perm[ion] = gsl_permutation_alloc(nk);
+    int signum;
+    gsl_linalg_LU_decomp(&diagblock.matrix, block_perm[ion], &signum);
+
+    for (int i = 0; i < nk; i++) {
+      if (gsl_matrix_get(&diagblock.matrix, i, i) == 0.) {
+        printout("  NLTE blockwise solver: singular diagonal block for Z=%d ionstage %d\n", get_element(element),
+                 get_ionstage(element, ion));
+        singular = true;
+        break;
       }
     }
+    if (singular) {
+      break;
+    }
 
-    gsl_vector_free(residual_vector);
-    completed_solution = true;
+    // columns after this block that couple to it (needed again during back substitution)
+    for (int col = end; col < nlte_dimension; col++) {
+      for (int row = start; row < end; row++) {
+        if (gsl_matrix_get(A, row, col) != 0.) {
+          block_couplecols[ion].push_back(col);
+          break;
+        }
+      }
+    }
+
+    // rows after this block that couple to it and need to be eliminated
+    std::vector<int> couplerows;
+    for (int row = end; row < nlte_dimension; row++) {
+      for (int col = start; col < end; col++) {
+        if (gsl_matrix_get(A, row, col) != 0.) {
+          couplerows.push_back(row);
+          break;
+        }
+      }
+    }
+
+    if (couplerows.empty()) {
+      continue;
+    }
+
+    // Z = D^-1 [A_couplecols | b] for this block
+    const int ncouplecols = block_couplecols[ion].size();
+    gsl_matrix *Z = gsl_matrix_alloc(ncouplecols + 1, nk);
+    for (int c = 0; c <= ncouplecols; c++) {
+      gsl_vector_view zvec = gsl_matrix_row(Z, c);
+      if (c < ncouplecols) {
+        gsl_vector_view acol = gsl_matrix_column(A, block_couplecols[ion][c]);
+        gsl_vector_view acol_block = gsl_vector_subvector(&acol.vector, start, nk);
+        gsl_linalg_LU_solve(&diagblock.matrix, block_perm[ion], &acol_block.vector, &zvec.vector);
+      } else {
+        gsl_vector_view b_block = gsl_vector_subvector(b, start, nk);
+        gsl_linalg_LU_solve(&diagblock.matrix, block_perm[ion], &b_block.vector, &zvec.vector);
+      }
+    }
+
+    // Schur complement update of the coupled rows
+    for (const int row : couplerows) {
+      gsl_vector_view arow = gsl_matrix_row(A, row);
+      gsl_vector_view arow_block = gsl_vector_subvector(&arow.vector, start, nk);
+      for (int c = 0; c <= ncouplecols; c++) {
+        gsl_vector_const_view zvec = gsl_matrix_const_row(Z, c);
+        double product = 0.;
+        gsl_blas_ddot(&arow_block.vector, &zvec.vector, &product);
+        if (c < ncouplecols) {
+          *gsl_matrix_ptr(A, row, block_couplecols[ion][c]) -= product;
+        } else {
+          *gsl_vector_ptr(b, row) -= product;
+        }
+      }
+      gsl_vector_set_zero(&arow_block.vector);
+    }
+
+    gsl_matrix_free(Z);
+  }
+
+  // back substitution
+  if (!singular) {
+    gsl_error_handler_t *previous_handler = gsl_set_error_handler(gsl_error_handler_printout);
+    for (int ion = nions - 1; ion >= 0; ion--) {
+      const int start = block_start[ion];
+      const int nk = block_start[ion + 1] - start;
+
+      gsl_vector *rhs = gsl_vector_alloc(nk);
+      for (int i = 0; i < nk; i++) {
+        double rhs_i = gsl_vector_get(b, start + i);
+        for (const int col : block_couplecols[ion]) {
+          rhs_i -= gsl_matrix_get(A, start + i, col) * gsl_vector_get(x, col);
+        }
+        gsl_vector_set(rhs, i, rhs_i);
+      }
+
+      gsl_matrix_view diagblock = gsl_matrix_submatrix(A, start, start, nk, nk);
+      gsl_vector_view x_block = gsl_vector_subvector(x, start, nk);
+      gsl_linalg_LU_solve(&diagblock.matrix, block_perm[ion], rhs, &x_block.vector);
+      gsl_vector_free(rhs);
+    }
+    gsl_set_error_handler(previous_handler);
+  }
+
+  for (int ion = 0; ion < nions; ion++) {
+    if (block_perm[ion] != NULL) {
+      gsl_permutation_free(block_perm[ion]);
+    }
+  }
+
+  return !singular;
+}
+
+static double get_max_row_relative_residual(const gsl_matrix *rate_matrix, const gsl_vector *balance_vector,
+                                           const gsl_vector *x)
+// largest residual of rate_matrix * x = balance_vector in any row, relative to the sum of the magnitudes of that row's
+// terms
+{
+  const unsigned int nlte_dimension = balance_vector->size;
+  gsl_vector *residual_vector = gsl_vector_alloc(nlte_dimension);
+  gsl_vector_memcpy(residual_vector, balance_vector);
+  gsl_blas_dgemv(CblasNoTrans, 1.0, rate_matrix, x, -1.0, residual_vector);
+  double max_rel_residual = 0.;
+  for (unsigned int row = 0; row < nlte_dimension; row++) {
+    double rowscale = fabs(gsl_vector_get(balance_vector, row));
+    for (unsigned int col = 0; col < nlte_dimension; col++) {
+      rowscale += fabs(gsl_matrix_get(rate_matrix, row, col) * gsl_vector_get(x, col));
+    }
+    if (rowscale > 0.) {
+      max_rel_residual = std::max(max_rel_residual, fabs(gsl_vector_get(residual_vector, row)) / rowscale);
+    }
+  }
+  gsl_vector_free(residual_vector);
+  return max_rel_residual;
+}
+
+static bool nltepop_matrix_solve_structured(const int modelgridindex, const int element, const gsl_matrix *rate_matrix,
+                                            const gsl_vector *rate_matrix_firstrow, const gsl_vector *balance_vector,
+                                            gsl_vector *popvec, const gsl_vector *pop_normfactor_vec)
+// solve the same system as nltepop_matrix_solve, but exploit the block structure of the ions.
+// rate_matrix is the normalised matrix with the element population constraint in the first row, and
+// rate_matrix_firstrow contains the (unnormalised) rates of the first row that were replaced by that constraint.
+// The constraint row couples all levels, so instead the rate equation row of the dominant ion's ground state is
+// replaced with a fixed normed population of one (any single rate equation is redundant because the columns sum to
+// zero), and the solution is rescaled to satisfy the population constraint afterwards.
+{
+  const int nions = get_nions(element);
+  const unsigned int nlte_dimension = balance_vector->size;
+  const double nnelement = gsl_vector_get(balance_vector, 0);
+
+  // pin the ground state with the largest previous normed population to avoid scaling over- and underflows
+  int pinned_index = 0;
+  double pinned_normpop = -1.;
+  for (int ion = 0; ion < nions; ion++) {
+    const int index_gs = get_nlte_vector_index(element, ion, 0);
+    const double normpop =
+        get_groundlevelpop(modelgridindex, element, ion) / gsl_vector_get(pop_normfactor_vec, index_gs);
+    if (normpop > pinned_normpop) {
+      pinned_normpop = normpop;
+      pinned_index = index_gs;
+    }
+  }
+
+  gsl_matrix *A = gsl_matrix_alloc(nlte_dimension, nlte_dimension);
+  gsl_matrix_memcpy(A, rate_matrix);
+  for (unsigned int col = 0; col < nlte_dimension; col++) {
+    gsl_matrix_set(A, 0, col, gsl_vector_get(rate_matrix_firstrow, col) * gsl_vector_get(pop_normfactor_vec, col));
+  }
+  gsl_vector_view pinned_row = gsl_matrix_row(A, pinned_index);
+  gsl_vector_set_zero(&pinned_row.vector);
+  gsl_matrix_set(A, pinned_index, pinned_index, 1.);
+
+  gsl_vector *b = gsl_vector_calloc(nlte_dimension);
+  gsl_vector_set(b, pinned_index, 1.);
+
+  gsl_vector *x = gsl_vector_calloc(nlte_dimension);
+
+  bool completed_solution = nltepop_matrix_solve_blockwise(element, A, b, x);
+
+  if (completed_solution) {
+    // rescale to the element population
+    double normsum = 0.;
+    gsl_blas_ddot(x, pop_normfactor_vec, &normsum);
+    gsl_vector_scale(x, nnelement / normsum);
+
+    // check the residual of the original system relative to the magnitude of the terms
+    const double max_rel_residual = get_max_row_relative_residual(rate_matrix, balance_vector, x);
+
+    if (!std::isfinite(normsum) || !(normsum > 0.) || !(max_rel_residual < 1e-8)) {
+      printout("  NLTE blockwise solver: bad solution (normsum %g, max relative residual %g) for Z=%d\n", normsum,
+               max_rel_residual, get_element(element));
+      completed_solution = false;
+    } else {
+      nltepop_popvec_from_normed_solution(element, rate_matrix, x, popvec, pop_normfactor_vec);
+    }
   }
 
   gsl_vector_free(x);
-  gsl_matrix_free(rate_matrix_LU_decomp);
-  gsl_permutation_free(p);
+  gsl_vector_free(b);
+  gsl_matrix_free(A);
 
   return completed_solution;
 }
 
+static bool nltepop_get_warmstart_normed_pops(const int modelgridindex, const int element,
+                                              const std::unique_ptr<double[]> &superlevel_partfunc,
+                                              const gsl_vector *pop_normfactor_vec, gsl_vector *x0)
+// fill x0 with the normed populations from the previous solution (stored in the modelgrid cell).
+// Returns false if there is no previous NLTE solution to start from
+{
+  const int nions = get_nions(element);
+  const double rho = grid::get_rho(modelgridindex);
+  bool found_previous_solution = false;
+
+  for (int ion = 0; ion < nions; ion++) {
+    const int nlte_start = globals::elements[element].ions[ion].first_nlte;
+    const int nlevels_nlte = get_nlevels_nlte(element, ion);
+    const int index_gs = get_nlte_vector_index(element, ion, 0);
+    const double x_gs = get_groundlevelpop(modelgridindex, element, ion) / gsl_vector_get(pop_normfactor_vec, index_gs);
+    gsl_vector_set(x0, index_gs, x_gs);
+
+    const int maxlevel = ion_has_superlevel(element, ion) ? nlevels_nlte + 1 : nlevels_nlte;
+    for (int level = 1; level <= maxlevel; level++) {
+      const int index = get_nlte_vector_index(element, ion, level);
+      const double storedpop = grid::modelgrid[modelgridindex].nlte_pops[nlte_start + level - 1];
+      if (storedpop >= 0.) {
+        // superlevel populations are stored divided by the superlevel partition function
+        const double pop = (level > nlevels_nlte) ? storedpop * rho * superlevel_partfunc[ion] : storedpop * rho;
+        gsl_vector_set(x0, index, pop / gsl_vector_get(pop_normfactor_vec, index));
+        found_previous_solution = true;
+      } else {
+        // no stored population, so assume the same departure from LTE as the ground state
+        gsl_vector_set(x0, index, x_gs);
+      }
+    }
+  }
+
+  return found_previous_solution;
+}
+
+static bool nltepop_matrix_solve_iterative(const int element, const gsl_matrix *rate_matrix,
+                                           const gsl_vector *balance_vector, gsl_vector *popvec,
+                                           const gsl_vector *pop_normfactor_vec, const gsl_vector *x0)
+// solve rate_matrix * x = balance_vector with right-preconditioned BiCGSTAB, starting from the normed populations x0
+// of the previous solution. The preconditioner is block Jacobi with an LU decomposition of each ion's diagonal block.
+// The iteration stops when the normwise backward error ||r|| / (||A|| ||x|| + ||b||) is below the tolerance, which
+// double precision can reach even though b only has one non-zero entry (the element population constraint).
+// Returns false if the iteration does not converge, or the solution fails the row residual check of the direct
+// solvers, so that the caller can use a direct solver instead
+{
+  const int nions = get_nions(element);
+  const int nlte_dimension = balance_vector->size;
+  const int maxiter = 200;
+  const double tolerance = 1e-12;
+
+  // LU decompose the diagonal blocks for the preconditioner
+  std::vector<int> block_start(nions + 1);
+  for (int ion = 0; ion < nions; ion++) {
+    block_start[ion] = get_nlte_vector_index(element, ion, 0);
+  }
+  block_start[nions] = nlte_dimension;
+
+  gsl_matrix *precond_LU = gsl_matrix_calloc(nlte_dimension, nlte_dimension);
+  std::vector<gsl_permutation *> block_perm(nions, NULL);
+  bool singular = false;
+  for (int ion = 0; ion < nions; ion++) {
+    const int start = block_start[ion];
+    const int nk = block_start[ion + 1] - start;
+    gsl_matrix_const_view srcblock = gsl_matrix_const_submatrix(rate_matrix, start, start, nk, nk);
+    gsl_matrix_view diagblock = gsl_matrix_submatrix(precond_LU, start, start, nk, nk);
+    gsl_matrix_memcpy(&diagblock.matrix, &srcblock.matrix);
+    block_perm[ion] = gsl_permutation_alloc(nk);
+    int signum;
+    gsl_linalg_LU_decomp(&diagblock.matrix, block_perm[ion], &signum);
+    for (int i = 0; i < nk; i++) {
+      if (gsl_matrix_get(&diagblock.matrix, i, i) == 0.) {
+        singular = true;
+      }
+    }
+  }
+
+  // apply the preconditioner: out = M^-1 in
+  auto precondition = [&](const gsl_vector *in, gsl_vector *out) {
+    for (int ion = 0; ion < nions; ion++) {
+      const int start = block_start[ion];
+      const int nk = block_start[ion + 1] - start;
+      gsl_matrix_view diagblock = gsl_matrix_submatrix(precond_LU, start, start, nk, nk);
+      gsl_vector_const_view in_block = gsl_vector_const_subvector(in, start, nk);
+      gsl_vector_view out_block = gsl_vector_subvector(out, start, nk);
+      gsl_linalg_LU_solve(&diagblock.matrix, block_perm[ion], &in_block.vector, &out_block.vector);
+    }
+  };
+
+  gsl_vector *x = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *r = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *rhat = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *p = gsl_vector_calloc(nlte_dimension);
+  gsl_vector *v = gsl_vector_calloc(nlte_dimension);
+  gsl_vector *phat = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *s = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *shat = gsl_vector_alloc(nlte_dimension);
+  gsl_vector *t = gsl_vector_alloc(nlte_dimension);
+
+  bool converged = false;
+  int iteration = 0;
+  double backward_error_initial = -1.;
+  double backward_error = -1.;
+
+  if (!singular) {
+    gsl_error_handler_t *previous_handler = gsl_set_error_handler(gsl_error_handler_printout);
+
+    const double bnorm = gsl_blas_dnrm2(balance_vector);
+    double anorm = 0.;  // Frobenius norm
+    for (int row = 0; row < nlte_dimension; row++) {
+      gsl_vector_const_view rowview = gsl_matrix_const_row(rate_matrix, row);
+      anorm += pow(gsl_blas_dnrm2(&rowview.vector), 2);
+    }
+    anorm = sqrt(anorm);
+    auto get_backward_error = [&](const gsl_vector *resid) {
+      return gsl_blas_dnrm2(resid) / (anorm * gsl_blas_dnrm2(x) + bnorm);
+    };
+
+    // r = b - A x0
+    gsl_vector_memcpy(x, x0);
+    gsl_vector_memcpy(r, balance_vector);
+    gsl_blas_dgemv(CblasNoTrans, -1.0, rate_matrix, x, 1.0, r);
+    gsl_vector_memcpy(rhat, r);
+
+    double rho = 1.;
+    double alpha = 1.;
+    double omega = 1.;
+    backward_error = get_backward_error(r);
+    backward_error_initial = backward_error;
+    converged = (backward_error < tolerance);
+
+    for (iteration = 1; iteration <= maxiter && !converged; iteration++) {
+      double rho_new = 0.;
+      gsl_blas_ddot(rhat, r, &rho_new);
+      if (rho_new == 0. || omega == 0. || !std::isfinite(rho_new)) {
+        break;  // breakdown
+      }
+
+      // p = r + beta * (p - omega * v)
+      const double beta = (rho_new / rho) * (alpha / omega);
+      gsl_blas_daxpy(-omega, v, p);
+      gsl_vector_scale(p, beta);
+      gsl_vector_add(p, r);
+      rho = rho_new;
+
+      precondition(p, phat);
+      gsl_blas_dgemv(CblasNoTrans, 1.0, rate_matrix, phat, 0.0, v);
+      double rhat_dot_v = 0.;
+      gsl_blas_ddot(rhat, v, &rhat_dot_v);
+      if (rhat_dot_v == 0.) {
+        break;
+      }
+      alpha = rho / rhat_dot_v;
+
+      // s = r - alpha * v
+      gsl_vector_memcpy(s, r);
+      gsl_blas_daxpy(-alpha, v, s);
+      gsl_blas_daxpy(alpha, phat, x);
+
+      backward_error = get_backward_error(s);
+      if (backward_error < tolerance) {
+        converged = true;
+        break;
+      }
+
+      precondition(s, shat);
+      gsl_blas_dgemv(CblasNoTrans, 1.0, rate_matrix, shat, 0.0, t);
+      double t_dot_s = 0.;
+      double t_dot_t = 0.;
+      gsl_blas_ddot(t, s, &t_dot_s);
+      gsl_blas_ddot(t, t, &t_dot_t);
+      if (t_dot_t == 0.) {
+        break;
+      }
+      omega = t_dot_s / t_dot_t;
+
+      gsl_blas_daxpy(omega, shat, x);
+
+      // r = s - omega * t
+      gsl_vector_memcpy(r, s);
+      gsl_blas_daxpy(-omega, t, r);
+
+      backward_error = get_backward_error(r);
+      converged = (backward_error < tolerance) && std::isfinite(backward_error);
+    }
+
+    gsl_set_error_handler(previous_handler);
+  }
+
+  if (converged) {
+    // the recurrence residual can drift from the true residual, so check the solution as the direct solvers do
+    const double max_rel_residual = get_max_row_relative_residual(rate_matrix, balance_vector, x);
+    printout(
+        "  NLTE iterative solver for Z=%d converged after %d iterations (backward error %.1e -> %.1e, max row "
+        "relative residual %.1e)\n",
+        get_element(element), iteration, backward_error_initial, backward_error, max_rel_residual);
+    if (max_rel_residual < 1e-8) {
+      nltepop_popvec_from_normed_solution(element, rate_matrix, x, popvec, pop_normfactor_vec);
+    } else {
+      converged = false;
+    }
+  } else {
+    printout(
+        "  NLTE iterative solver did not converge for Z=%d after %d iterations (backward error %.1e -> %.1e)\n",
+        get_element(element), iteration, backward_error_initial, backward_error);
+  }
+
+  for (int ion = 0; ion < nions; ion++) {
+    gsl_permutation_free(block_perm[ion]);
+  }
+  gsl_matrix_free(precond_LU);
+  gsl_vector_free(x);
+  gsl_vector_free(r);
+  gsl_vector_free(rhat);
+  gsl_vector_free(p);
+  gsl_vector_free(v);
+  gsl_vector_free(phat);
+  gsl_vector_free(s);
+  gsl_vector_free(shat);
+  gsl_vector_free(t);
+
+  return converged;
+}
+
+#if defined TESTMODE && TESTMODE
+static void check_against_dense_solution(const int element, const gsl_matrix *rate_matrix,
+                                         const gsl_vector *balance_vector, const gsl_vector *popvec,
+                                         const gsl_vector *pop_normfactor_vec, const double nnelement,
+                                         const char *solvername)
+// print the largest fractional difference of the populations from another solver to the full LU solution
+{
+  const int nlte_dimension = popvec->size;
+  gsl_vector *popvec_full = gsl_vector_alloc(nlte_dimension);
+  if (nltepop_matrix_solve(element, rate_matrix, balance_vector, popvec_full, pop_normfactor_vec)) {
+    double max_fracdiff = 0.;
+    for (int index = 0; index < nlte_dimension; index++) {
+      // only compare populations that are significant compared to the element population
+      if (gsl_vector_get(popvec_full, index) > 1e-10 * nnelement) {
+        max_fracdiff =
+            std::max(max_fracdiff, fabs(gsl_vector_get(popvec, index) / gsl_vector_get(popvec_full, index) - 1.));
+      }
+    }
+    printout("  NLTE %s solver: max fractional difference from full LU solution is %.2e\n", solvername, max_fracdiff);
+  }
+  gsl_vector_free(popvec_full);
+}
+#endif
+
 void solve_nlte_pops_element(const int element, const int modelgridindex, const int timestep, const int nlte_iter)
 // solves the statistical balance equations to find NLTE level populations for all ions of an element
 // (ionisation balance follows from this too)
@@ -910,6 +1396,8 @@ void solve_nlte_pops_element(const int element, const int modelgridindex, const
   // replace the first row of the matrix and balance vector with the normalisation
   // constraint on the total element population
   gsl_vector_view first_row_view = gsl_matrix_row(rate_matrix, 0);
+  gsl_vector *rate_matrix_firstrow = gsl_vector_alloc(nlte_dimension);  // rates that the constraint replaces
+  gsl_vector_memcpy(rate_matrix_firstrow, &first_row_view.vector);
   gsl_vector_set_all(&first_row_view.vector, 1.0);
   // set first balance vector entry to the element population (all other entries will be zero)
   gsl_vector_set(balance_vector, 0, nnelement);
@@ -941,8 +1429,41 @@ void solve_nlte_pops_element(const int element, const int modelgridindex, const
 
   gsl_vector *popvec = gsl_vector_alloc(nlte_dimension);  // the true population densities
 
-  const bool matrix_solve_success =
-      nltepop_matrix_solve(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec);
+  bool matrix_solve_success = false;
+  if (NLTE_POPS_ITERATIVE_SOLVER) {
+    gsl_vector *x0 = gsl_vector_alloc(nlte_dimension);
+    if (nltepop_get_warmstart_normed_pops(modelgridindex, element, superlevel_partfunc, pop_norm_factor_vec, x0)) {
+      matrix_solve_success =
+          nltepop_matrix_solve_iterative(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec, x0);
+    }
+    gsl_vector_free(x0);
+
+#if defined TESTMODE && TESTMODE
+    if (matrix_solve_success) {
+      check_against_dense_solution(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec, nnelement,
+                                   "iterative");
+    }
+#endif
+  }
+
+  if (NLTE_POPS_BLOCKWISE_SOLVER && !matrix_solve_success) {
+    matrix_solve_success = nltepop_matrix_solve_structured(modelgridindex, element, rate_matrix, rate_matrix_firstrow,
+                                                           balance_vector, popvec, pop_norm_factor_vec);
+    if (!matrix_solve_success) {
+      printout("  NLTE blockwise solver failed for Z=%d. Falling back to full LU decomposition\n", atomic_number);
+    }
+
+#if defined TESTMODE && TESTMODE
+    if (matrix_solve_success) {
+      check_against_dense_solution(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec, nnelement,
+                                   "blockwise");
+    }
+#endif
+  }
+
+  if (!matrix_solve_success) {
+    matrix_solve_success = nltepop_matrix_solve(element, rate_matrix, balance_vector, popvec, pop_norm_factor_vec);
+  }
 
   if (!matrix_solve_success) {
     printout(
@@ -1104,6 +1625,7 @@ void solve_nlte_pops_element(const int element, const int modelgridindex, const
   gsl_vector_free(popvec);
 
   gsl_matrix_free(rate_matrix);
+  gsl_vector_free(rate_matrix_firstrow);
   gsl_vector_free(balance_vector);
   gsl_vector_free(pop_norm_factor_vec);
   const int duration_nltesolver = time(NULL) - sys_time_start_nltesolver;
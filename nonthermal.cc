@@ -11,7 +11,9 @@
 #include <cmath>
 
 #include "atomic.h"
+#include "celloutput.h"
 #include "decay.h"
+#include "gammadeposition.h"
 #include "grid.h"
 #include "gsl_managed.h"
 #include "kpkt.h"
@@ -96,6 +98,7 @@ __managed__ static struct collionrow *colliondata = NULL;
 __managed__ static int colliondatacount = 0;
 
 static FILE *nonthermalfile = NULL;
+static struct celloutput::bufferedfile nonthermal_output;
 static bool nonthermal_initialized = false;
 
 __managed__ static gsl_vector *envec;      // energy grid on which solution is sampled
@@ -503,6 +506,7 @@ void init(const int my_rank, const int ndo, const int ndo_nonempty) {
     fprintf(nonthermalfile, "%8s %15s %8s %11s %11s %11s\n", "timestep", "modelgridindex", "index", "energy_ev",
             "source", "y");
     fflush(nonthermalfile);
+    celloutput::init(&nonthermal_output, nonthermalfile, grid::get_npts_model());
   }
 
   nt_solution = (struct nt_solution_struct *)calloc(grid::get_npts_model(), sizeof(struct nt_solution_struct));
@@ -626,7 +630,9 @@ void init(const int my_rank, const int ndo, const int ndo_nonempty) {
 void calculate_deposition_rate_density(const int modelgridindex, const int timestep)
 // should be in erg / s / cm^3
 {
-  const double gamma_deposition = globals::rpkt_emiss[modelgridindex] * 1.e20 * FOURPI;
+  const double gamma_deposition = GAMMA_DEPOSITION_RAYTRACE
+                                      ? gammadeposition::get_deposition_rate_density(modelgridindex)
+                                      : globals::rpkt_emiss[modelgridindex] * 1.e20 * FOURPI;
 
   const double tmid = globals::time_step[timestep].mid;
   const double rho = grid::get_rho(modelgridindex);
@@ -648,10 +654,10 @@ void calculate_deposition_rate_density(const int modelgridindex, const int times
       (gamma_deposition + positron_deposition + electron_deposition + alpha_deposition);
 
   printout(
-      "deposition rates [eV/s/cm^3] for mgi %d timestep %d: gamma %8.2e (Monte Carlo), positron %8.2e elec %8.2e alpha "
+      "deposition rates [eV/s/cm^3] for mgi %d timestep %d: gamma %8.2e (%s), positron %8.2e elec %8.2e alpha "
       "%8.2e (analytic t_mid)\n",
-      modelgridindex, timestep, gamma_deposition / EV, positron_deposition / EV, electron_deposition / EV,
-      alpha_deposition / EV);
+      modelgridindex, timestep, gamma_deposition / EV, GAMMA_DEPOSITION_RAYTRACE ? "ray traced" : "Monte Carlo",
+      positron_deposition / EV, electron_deposition / EV, alpha_deposition / EV);
 
   deposition_rate_density_timestep[modelgridindex] = timestep;
 }
@@ -684,16 +690,39 @@ __host__ __device__ static double get_y_sample(const int modelgridindex, const i
   }
 }
 
+static void nt_write_cell_to_stream(FILE *outfile, const int modelgridindex, const int timestep) {
+#ifndef yscalefactoroverride  // manual override can be defined
+  const double yscalefactor = (get_deposition_rate_density(modelgridindex) / (E_init_ev * EV));
+#else
+  const double yscalefactor = yscalefactoroverride(modelgridindex);
+#endif
+
+  for (int s = 0; s < SFPTS; s++) {
+    fprintf(outfile, "%8d %15d %8d %11.5e %11.5e %11.5e\n", timestep, modelgridindex, s, gsl_vector_get(envec, s),
+            gsl_vector_get(sourcevec, s), yscalefactor * get_y_sample(modelgridindex, s));
+  }
+  fflush(outfile);
+}
+
 static void nt_write_to_file(const int modelgridindex, const int timestep, const int iteration) {
+  if (!nonthermal_initialized) {
+    printout("Call to nonthermal_write_to_file before nonthermal_init");
+    abort();
+  }
+
+  if constexpr (BUFFERED_CELL_OUTPUT) {
+    // replace the non-thermal spectrum of a previous iteration of the same timestep and gridcell
+    if (iteration > 0) {
+      celloutput::discard_cell(&nonthermal_output, modelgridindex);
+    }
+    nt_write_cell_to_stream(celloutput::cellstream(&nonthermal_output, modelgridindex), modelgridindex, timestep);
+    return;
+  }
+
 #ifdef _OPENMP
 #pragma omp critical(nonthermal_out_file)
   {
 #endif
-    if (!nonthermal_initialized) {
-      printout("Call to nonthermal_write_to_file before nonthermal_init");
-      abort();
-    }
-
     static long nonthermalfile_offset_iteration_zero = 0;
 #ifdef _OPENMP
 #pragma omp threadprivate(nonthermalfile_offset_iteration_zero)
@@ -707,22 +736,18 @@ static void nt_write_to_file(const int modelgridindex, const int timestep, const
       }
     }
 
-#ifndef yscalefactoroverride  // manual override can be defined
-    const double yscalefactor = (get_deposition_rate_density(modelgridindex) / (E_init_ev * EV));
-#else
-  const double yscalefactor = yscalefactoroverride(modelgridindex);
-#endif
-
-    for (int s = 0; s < SFPTS; s++) {
-      fprintf(nonthermalfile, "%8d %15d %8d %11.5e %11.5e %11.5e\n", timestep, modelgridindex, s,
-              gsl_vector_get(envec, s), gsl_vector_get(sourcevec, s), yscalefactor * get_y_sample(modelgridindex, s));
-    }
-    fflush(nonthermalfile);
+    nt_write_cell_to_stream(nonthermalfile, modelgridindex, timestep);
 #ifdef _OPENMP
   }
 #endif
 }
 
+void flush_cell_output(void)
+// append the buffered non-thermal spectra of the cells to the file in modelgridindex order
+{
+  celloutput::flush(&nonthermal_output);
+}
+
 void close_file(void) {
   nonthermal_initialized = false;
 
@@ -732,6 +757,7 @@ void close_file(void) {
   if (!NT_ON || !NT_SOLVE_SPENCERFANO) return;
 
   if (nonthermalfile != NULL) {
+    celloutput::flush(&nonthermal_output);
     fclose(nonthermalfile);
     nonthermalfile = NULL;
   }
@@ -1659,7 +1685,7 @@ __host__ __device__ int nt_random_upperion(const int modelgridindex, const int e
   assert_testmodeonly(lowerion < get_nions(element) - 1);
   if (NT_SOLVE_SPENCERFANO && NT_MAX_AUGER_ELECTRONS > 0) {
     while (true) {
-      const double zrand = gsl_rng_uniform(rng);
+      const double zrand = rng_uniform();
 
       double prob_sum = 0.;
       for (int upperion = lowerion + 1; upperion <= nt_ionisation_maxupperion(element, lowerion); upperion++) {
@@ -1807,7 +1833,7 @@ double nt_excitation_ratecoeff(const int modelgridindex, const int element, cons
 static void select_nt_ionization(int modelgridindex, int *element, int *lowerion)
 // select based on stored frac_deposition for each ion
 {
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
   double frac_deposition_ion_sum = 0.;
   // zrand is between zero and frac_ionization
   // keep subtracting off deposition fractions of ionizations transitions until we hit the right one
@@ -1858,7 +1884,7 @@ __host__ __device__ static double get_ntion_energyrate(int modelgridindex) {
 __host__ __device__ static void select_nt_ionization2(int modelgridindex, int *element, int *lowerion) {
   const double ratetotal = get_ntion_energyrate(modelgridindex);
 
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
   double ratesum = 0.;
   for (int ielement = 0; ielement < get_nelements(); ielement++) {
     const int nions = get_nions(ielement);
@@ -1884,7 +1910,7 @@ __host__ __device__ void do_ntlepton(struct packet *pkt_ptr) {
     // here there is some probability to cause ionisation or excitation to a macroatom packet
     // instead of converting directly to k-packet (unless the heating channel is selected)
 
-    double zrand = gsl_rng_uniform(rng);
+    double zrand = rng_uniform();
     // zrand is initially between [0, 1), but we will subtract off each
     // component of the deposition fractions
     // until we end and select transition_ij when zrand < dep_frac_transition_ij
@@ -2280,9 +2306,11 @@ static void analyse_sf_solution(const int modelgridindex, const int timestep, co
 }
 
 static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelgridindex, const int element,
-                                    const int ion) {
-  // excitation terms
-  gsl_vector *vec_xs_excitation_deltae = gsl_vector_alloc(SFPTS);
+                                    const int ion, gsl_vector *const vec_xs_excitation_deltae, const int rowstart,
+                                    const int rowstride)
+// add the excitation terms to the Spencer-Fano matrix rows rowstart, rowstart + rowstride, ...
+// vec_xs_excitation_deltae is a work vector of SFPTS entries
+{
 
   const int nlevels_all = get_nlevels(element, ion);
   const int nlevels = (nlevels_all > NTEXCITATION_MAXNLEVELS_LOWER) ? NTEXCITATION_MAXNLEVELS_LOWER : nlevels_all;
@@ -2313,7 +2341,8 @@ static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelg
         gsl_blas_dscal(DELTA_E, vec_xs_excitation_deltae);
 #endif
 
-        for (int i = 0; i < SFPTS; i++) {
+        // every row loop uses the same stride, so each row of the matrix is only written by one thread
+        for (int i = rowstart; i < SFPTS; i += rowstride) {
           const double en = gsl_vector_get(envec, i);
           const int stopindex = get_energyindex_ev_lteq(en + epsilon_trans_ev);
 
@@ -2337,13 +2366,13 @@ static void sfmatrix_add_excitation(gsl_matrix *const sfmatrix, const int modelg
       }
     }
   }
-  gsl_vector_free(vec_xs_excitation_deltae);
 }
 
-static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, const int ionstage, const double nnion)
-// add the ionization terms to the Spencer-Fano matrix
+static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, const int ionstage, const double nnion,
+                                    gsl_vector *const vec_xs_ionization, const int rowstart, const int rowstride)
+// add the ionization terms to the Spencer-Fano matrix rows rowstart, rowstart + rowstride, ...
+// vec_xs_ionization is a work vector of SFPTS entries
 {
-  gsl_vector *const vec_xs_ionization = gsl_vector_alloc(SFPTS);
   for (int collionindex = 0; collionindex < colliondatacount; collionindex++) {
     if (colliondata[collionindex].Z == Z && colliondata[collionindex].nelec == Z - ionstage + 1) {
       const double ionpot_ev = colliondata[collionindex].ionpot_ev;
@@ -2371,7 +2400,8 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
         prefactors[j] = gsl_vector_get(vec_xs_ionization, j) * nnion / atan((endash - ionpot_ev) / 2 / J);
       }
 
-      for (int i = 0; i < SFPTS; i++) {
+      // the rows are independent, and the first integral over each row is O(SFPTS) inverse tangents
+      for (int i = rowstart; i < SFPTS; i += rowstride) {
         // i is the matrix row index, which corresponds to an energy E at which we are solve from y(E)
         const double en = gsl_vector_get(envec, i);
 
@@ -2432,7 +2462,10 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
           augerstopindex = get_energyindex_ev_gteq(en_auger_ev);
         }
 
-        for (int i = 0; i < augerstopindex; i++) {
+        for (int i = rowstart; i < SFPTS; i += rowstride) {
+          if (i >= augerstopindex) {
+            continue;
+          }
           const double en = gsl_vector_get(envec, i);
           const int jstart = i > xsstartindex ? i : xsstartindex;
           for (int j = jstart; j < SFPTS; j++) {
@@ -2455,7 +2488,48 @@ static void sfmatrix_add_ionization(gsl_matrix *const sfmatrix, const int Z, con
       }
     }
   }
-  gsl_vector_free(vec_xs_ionization);
+}
+
+static void sfmatrix_add_transitions(gsl_matrix *const sfmatrix, const int modelgridindex,
+                                     const bool enable_sfexcitation, const bool enable_sfionization,
+                                     const int rowstart, const int rowstride)
+// add the excitation and ionization terms of all included ions to the Spencer-Fano matrix rows rowstart,
+// rowstart + rowstride, ... Every thread of a parallel region goes through all ions and transitions for its own rows
+{
+  const bool is_master = (rowstart == 0);
+  gsl_vector *const vec_xs_work = gsl_vector_alloc(SFPTS);  // cross sections of the current transition
+  for (int element = 0; element < get_nelements(); element++) {
+    const int Z = get_element(element);
+    const int nions = get_nions(element);
+    bool first_included_ion_of_element = true;
+    for (int ion = 0; ion < nions; ion++) {
+      const double nnion = ionstagepop(modelgridindex, element, ion);  // hopefully ions per cm^3?
+
+      if (nnion < minionfraction * get_tot_nion(modelgridindex))  // skip negligible ions
+      {
+        continue;
+      }
+
+      const int ionstage = get_ionstage(element, ion);
+      if (is_master) {
+        if (first_included_ion_of_element) {
+          printout("  including Z=%2d ion_stages: ", Z);
+          for (int i = 1; i < get_ionstage(element, ion); i++) printout("  ");
+        }
+
+        printout("%d ", ionstage);
+      }
+      first_included_ion_of_element = false;
+
+      if (enable_sfexcitation)
+        sfmatrix_add_excitation(sfmatrix, modelgridindex, element, ion, vec_xs_work, rowstart, rowstride);
+
+      if (enable_sfionization && (ion < nions - 1))
+        sfmatrix_add_ionization(sfmatrix, Z, ionstage, nnion, vec_xs_work, rowstart, rowstride);
+    }
+    if (is_master && !first_included_ion_of_element) printout("\n");
+  }
+  gsl_vector_free(vec_xs_work);
 }
 
 static void sfmatrix_solve(const gsl_matrix *sfmatrix, const gsl_vector *rhsvec, gsl_vector *yvec) {
@@ -2644,32 +2718,15 @@ void solve_spencerfano(const int modelgridindex, const int timestep, const int i
   // gsl_vector_set_all(rhsvec, 1.); // alternative if all electrons are injected at SF_EMAX
 
   if (enable_sfexcitation || enable_sfionization) {
-    for (int element = 0; element < get_nelements(); element++) {
-      const int Z = get_element(element);
-      const int nions = get_nions(element);
-      bool first_included_ion_of_element = true;
-      for (int ion = 0; ion < nions; ion++) {
-        const double nnion = ionstagepop(modelgridindex, element, ion);  // hopefully ions per cm^3?
-
-        if (nnion < minionfraction * get_tot_nion(modelgridindex))  // skip negligible ions
-        {
-          continue;
-        }
-
-        const int ionstage = get_ionstage(element, ion);
-        if (first_included_ion_of_element) {
-          printout("  including Z=%2d ion_stages: ", Z);
-          for (int i = 1; i < get_ionstage(element, ion); i++) printout("  ");
-          first_included_ion_of_element = false;
-        }
-
-        printout("%d ", ionstage);
-
-        if (enable_sfexcitation) sfmatrix_add_excitation(sfmatrix, modelgridindex, element, ion);
-
-        if (enable_sfionization && (ion < nions - 1)) sfmatrix_add_ionization(sfmatrix, Z, ionstage, nnion);
-      }
-      if (!first_included_ion_of_element) printout("\n");
+    // in intracell_parallel mode, the matrix rows are divided between the threads
+    if (globals::intracell_parallel) {
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+      sfmatrix_add_transitions(sfmatrix, modelgridindex, enable_sfexcitation, enable_sfionization, get_thread_num(),
+                               get_num_threads());
+    } else {
+      sfmatrix_add_transitions(sfmatrix, modelgridindex, enable_sfexcitation, enable_sfionization, 0, 1);
     }
   }
 
@@ -2853,28 +2910,29 @@ void nt_MPI_Bcast(const int modelgridindex, const int root) {
   //          nt_ionization_ratecoeff_sf(modelgridindex, logged_element_index, logged_ion_index),
   //          get_eff_ionpot(modelgridindex, logged_element_index, logged_ion_index) / EV);
 
-  MPI_Bcast(&deposition_rate_density_timestep[modelgridindex], 1, MPI_INT, root, MPI_COMM_WORLD);
-  MPI_Bcast(&deposition_rate_density[modelgridindex], 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
+  MPI_Bcast(&deposition_rate_density_timestep[modelgridindex], 1, MPI_INT, root, globals::mpi_comm_model);
+  MPI_Bcast(&deposition_rate_density[modelgridindex], 1, MPI_DOUBLE, root, globals::mpi_comm_model);
 
   if (NT_ON && NT_SOLVE_SPENCERFANO) {
     assert_always(nonthermal_initialized);
-    MPI_Bcast(&nt_solution[modelgridindex].nneperion_when_solved, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].timestep_last_solved, 1, MPI_INT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_heating, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_ionization, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
-    MPI_Bcast(&nt_solution[modelgridindex].frac_excitation, 1, MPI_FLOAT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&nt_solution[modelgridindex].nneperion_when_solved, 1, MPI_FLOAT, root, globals::mpi_comm_model);
+    MPI_Bcast(&nt_solution[modelgridindex].timestep_last_solved, 1, MPI_INT, root, globals::mpi_comm_model);
+    MPI_Bcast(&nt_solution[modelgridindex].frac_heating, 1, MPI_FLOAT, root, globals::mpi_comm_model);
+    MPI_Bcast(&nt_solution[modelgridindex].frac_ionization, 1, MPI_FLOAT, root, globals::mpi_comm_model);
+    MPI_Bcast(&nt_solution[modelgridindex].frac_excitation, 1, MPI_FLOAT, root, globals::mpi_comm_model);
 
-    MPI_Bcast(nt_solution[modelgridindex].fracdep_ionization_ion, get_includedions(), MPI_DOUBLE, root, MPI_COMM_WORLD);
-    MPI_Bcast(nt_solution[modelgridindex].eff_ionpot, get_includedions(), MPI_FLOAT, root, MPI_COMM_WORLD);
+    MPI_Bcast(nt_solution[modelgridindex].fracdep_ionization_ion, get_includedions(), MPI_DOUBLE, root,
+              globals::mpi_comm_model);
+    MPI_Bcast(nt_solution[modelgridindex].eff_ionpot, get_includedions(), MPI_FLOAT, root, globals::mpi_comm_model);
 
     MPI_Bcast(nt_solution[modelgridindex].prob_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1), MPI_FLOAT,
-              root, MPI_COMM_WORLD);
+              root, globals::mpi_comm_model);
     MPI_Bcast(nt_solution[modelgridindex].ionenfrac_num_auger, get_includedions() * (NT_MAX_AUGER_ELECTRONS + 1),
-              MPI_FLOAT, root, MPI_COMM_WORLD);
+              MPI_FLOAT, root, globals::mpi_comm_model);
 
     // communicate NT excitations
     const int frac_excitations_list_size_old = nt_solution[modelgridindex].frac_excitations_list_size;
-    MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list_size, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list_size, 1, MPI_INT, root, globals::mpi_comm_model);
 
     if (nt_solution[modelgridindex].frac_excitations_list_size != frac_excitations_list_size_old) {
       assert_always(
@@ -2884,19 +2942,19 @@ void nt_MPI_Bcast(const int modelgridindex, const int root) {
     const int frac_excitations_list_size = nt_solution[modelgridindex].frac_excitations_list_size;
     for (int excitationindex = 0; excitationindex < frac_excitations_list_size; excitationindex++) {
       MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].frac_deposition, 1, MPI_DOUBLE,
-                root, MPI_COMM_WORLD);
+                root, globals::mpi_comm_model);
       MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].ratecoeffperdeposition, 1,
-                MPI_DOUBLE, root, MPI_COMM_WORLD);
+                MPI_DOUBLE, root, globals::mpi_comm_model);
       MPI_Bcast(&nt_solution[modelgridindex].frac_excitations_list[excitationindex].lineindex, 1, MPI_INT, root,
-                MPI_COMM_WORLD);
+                globals::mpi_comm_model);
     }
 
     if (STORE_NT_SPECTRUM) {
       assert_always(nt_solution[modelgridindex].yfunc != NULL);
-      MPI_Bcast(nt_solution[modelgridindex].yfunc, SFPTS, MPI_DOUBLE, root, MPI_COMM_WORLD);
+      MPI_Bcast(nt_solution[modelgridindex].yfunc, SFPTS, MPI_DOUBLE, root, globals::mpi_comm_model);
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_model);
 
     check_auger_probabilities(modelgridindex);
   }
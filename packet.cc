@@ -27,7 +27,7 @@ static void place_pellet(const double e0, const int cellindex, const int pktnumb
   pkt_ptr->originated_from_particlenotgamma = false;
 
   if (GRID_TYPE == GRID_SPHERICAL1D) {
-    const double zrand3 = gsl_rng_uniform(rng);
+    const double zrand3 = rng_uniform();
     const double r_inner = grid::get_cellcoordmin(cellindex, 0);
     const double r_outer = grid::get_cellcoordmin(cellindex, 0) + grid::wid_init(cellindex);
     const double radius = pow(zrand3 * pow(r_inner, 3) + (1. - zrand3) * pow(r_outer, 3), 1 / 3.);
@@ -38,7 +38,7 @@ static void place_pellet(const double e0, const int cellindex, const int pktnumb
     vec_scale(pkt_ptr->pos, radius);
   } else {
     for (int axis = 0; axis < 3; axis++) {
-      const double zrand = gsl_rng_uniform_pos(rng);
+      const double zrand = rng_uniform_pos();
       pkt_ptr->pos[axis] = grid::get_cellcoordmin(cellindex, axis) + (zrand * grid::wid_init(0));
     }
   }
@@ -62,7 +62,7 @@ void packet_init(int my_rank, struct packet *pkt)
 /// Subroutine that initialises the packets if we start a new simulation.
 {
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   printout("UNIFORM_PELLET_ENERGIES is %s\n", (UNIFORM_PELLET_ENERGIES ? "true" : "false"));
 #ifdef NO_INITIAL_PACKETS
@@ -119,7 +119,7 @@ void packet_init(int my_rank, struct packet *pkt)
 
   printout("Placing pellets...\n");
   for (int n = 0; n < globals::npkts; n++) {
-    const double zrand = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
     const double targetval = zrand * norm;
 
     // first cont[i] such that targetval < cont[i] is true
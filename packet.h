@@ -14,6 +14,7 @@ enum packet_type {
   TYPE_NONTHERMAL_PREDEPOSIT = 21,
   TYPE_PRE_KPKT = 120,
   TYPE_GAMMA_KPKT = 121,
+  TYPE_UNUSED = 99,  // free slot in the packet array after packets were combined (ADAPTIVE_PACKET_COUNT)
 };
 
 #include "boundary.h"
@@ -0,0 +1,238 @@
+#include "packetcount.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "grid.h"
+#include "radfield.h"
+#include "sn3d.h"
+
+namespace packetcount {
+
+static double get_cell_relnoise(const int mgi, const int npkts_cell)
+// relative noise of the estimators of a cell: the larger of the shot noise of the packets (on all ranks) that can
+// deposit energy in the cell and of the binned radiation field contributions in the last timestep
+{
+  double relnoise = (npkts_cell > 0) ? 1. / std::sqrt(static_cast<double>(npkts_cell) * globals::nprocs) : 1.;
+  if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
+    const int contribcount = radfield::get_total_contribcount(mgi);
+    relnoise = std::max(relnoise, (contribcount > 0) ? 1. / std::sqrt(contribcount) : 1.);
+  }
+  return relnoise;
+}
+
+static void combine_packets(struct packet *pkt1, struct packet *pkt2)
+// one of the packets is kept with probability proportional to its energy and carries the energy of both
+{
+  const double e_cmf_sum = pkt1->e_cmf + pkt2->e_cmf;
+  if (rng_uniform() * e_cmf_sum >= pkt1->e_cmf) {
+    std::swap(pkt1, pkt2);
+  }
+  pkt1->e_rf *= e_cmf_sum / pkt1->e_cmf;
+  pkt1->e_cmf = e_cmf_sum;
+
+  pkt2->type = TYPE_UNUSED;
+  pkt2->e_cmf = 0.;
+  pkt2->e_rf = 0.;
+}
+
+static void split_packet(struct packet *pkt, struct packet *pkt_new) {
+  pkt->e_cmf /= 2.;
+  pkt->e_rf /= 2.;
+  *pkt_new = *pkt;
+}
+
+void adjust_packets(const int nts, struct packet *packets) {
+  if (nts == 0) {
+    // no estimators from a previous timestep
+    return;
+  }
+
+  const int npts_model = grid::get_npts_model();
+
+  // non-escaped packets by cell (the last entry is for packets in empty cells), and the free slots
+  std::vector<std::vector<int>> cellpackets(npts_model + 1);
+  std::vector<int> freeslots;
+  for (int n = 0; n < globals::npkts; n++) {
+    if (packets[n].type == TYPE_UNUSED) {
+      freeslots.push_back(n);
+    } else if (packets[n].type != TYPE_ESCAPE) {
+      cellpackets[grid::get_cell_modelgridindex(packets[n].where)].push_back(n);
+    }
+  }
+
+  // combining halves the packets of a cell, so its noise increases by sqrt(2) and stays below the split threshold
+  int ncombined = 0;
+  int ncells_combined = 0;
+  std::vector<std::pair<double, int>> noisycells;
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    std::vector<int> &pktindices = cellpackets[mgi];
+    if (pktindices.empty()) {
+      continue;
+    }
+    const double relnoise = get_cell_relnoise(mgi, pktindices.size());
+    if (relnoise > ADAPTIVE_PACKET_COUNT_RELNOISE) {
+      noisycells.emplace_back(relnoise, mgi);
+    } else if (relnoise < ADAPTIVE_PACKET_COUNT_RELNOISE / 2.) {
+      // only packets of the same type are combined
+      std::stable_sort(pktindices.begin(), pktindices.end(),
+                       [packets](const int n1, const int n2) { return packets[n1].type < packets[n2].type; });
+      const int ncombined_before = ncombined;
+      for (size_t i = 0; i + 1 < pktindices.size(); i++) {
+        struct packet *pkt1 = &packets[pktindices[i]];
+        struct packet *pkt2 = &packets[pktindices[i + 1]];
+        if (pkt1->type == pkt2->type) {
+          combine_packets(pkt1, pkt2);
+          freeslots.push_back(pkt1->type == TYPE_UNUSED ? pktindices[i] : pktindices[i + 1]);
+          ncombined++;
+          i++;
+        }
+      }
+      if (ncombined > ncombined_before) {
+        ncells_combined++;
+      }
+    }
+  }
+
+  // the free slots go to the noisiest cells first
+  std::sort(noisycells.begin(), noisycells.end(), std::greater<>());
+  int nsplit = 0;
+  int ncells_split = 0;
+  for (const auto &[relnoise, mgi] : noisycells) {
+    if (freeslots.empty()) {
+      break;
+    }
+    for (const int n : cellpackets[mgi]) {
+      if (freeslots.empty()) {
+        break;
+      }
+      split_packet(&packets[n], &packets[freeslots.back()]);
+      freeslots.pop_back();
+      nsplit++;
+    }
+    ncells_split++;
+  }
+
+  printout(
+      "packetcount: timestep %d combined %d packet pairs in %d cells, split %d packets in %d of %zu noisy cells, %zu "
+      "free packet slots\n",
+      nts, ncombined, ncells_combined, nsplit, ncells_split, noisycells.size(), freeslots.size());
+}
+
+static std::vector<int> freeslots_rpkt;  // TYPE_UNUSED slots for copies of split r-packets
+static const struct packet *freeslots_rpkt_packets = NULL;  // the packet array that freeslots_rpkt indexes
+static std::vector<double> cell_importance;
+static int nrpkt_copies = 0;        // copies made by splitting
+static int nrpkt_split_noslot = 0;  // copies not made because there was no free slot
+static int nrpkt_roulette_survived = 0;
+static int nrpkt_roulette_killed = 0;
+
+static void setup_cell_importance(void)
+// (mean density / cell density)^RPKT_IMPORTANCE_DENSITY_EXPONENT, with the densities at tmin
+{
+  const int npts_model = grid::get_npts_model();
+  double mass = 0.;
+  double volume = 0.;
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    if (grid::get_numassociatedcells(mgi) > 0) {
+      mass += grid::get_rhoinit(mgi) * grid::vol_init_modelcell(mgi);
+      volume += grid::vol_init_modelcell(mgi);
+    }
+  }
+  const double rho_mean = mass / volume;
+
+  // the last entry is for empty cells
+  cell_importance.assign(npts_model + 1, 1.);
+  for (int mgi = 0; mgi < npts_model; mgi++) {
+    if (grid::get_numassociatedcells(mgi) > 0 && grid::get_rhoinit(mgi) > 0.) {
+      const double importance = std::pow(rho_mean / grid::get_rhoinit(mgi), RPKT_IMPORTANCE_DENSITY_EXPONENT);
+      cell_importance[mgi] = std::clamp(importance, 1. / RPKT_IMPORTANCE_MAX, RPKT_IMPORTANCE_MAX);
+    }
+  }
+}
+
+void start_timestep(const int nts, const struct packet *packets, const int npkts_nonescaped) {
+  if (cell_importance.empty()) {
+    setup_cell_importance();
+  }
+
+  freeslots_rpkt.clear();
+  freeslots_rpkt_packets = packets;
+  for (int n = 0; n < npkts_nonescaped; n++) {
+    if (packets[n].type == TYPE_UNUSED) {
+      freeslots_rpkt.push_back(n);
+    }
+  }
+  nrpkt_copies = 0;
+  nrpkt_split_noslot = 0;
+  nrpkt_roulette_survived = 0;
+  nrpkt_roulette_killed = 0;
+
+  printout("packetcount: timestep %d starts with %zu free packet slots for r-packet splitting\n", nts,
+           freeslots_rpkt.size());
+}
+
+double get_rpkt_importance(const struct packet *pkt_ptr) {
+  double importance = cell_importance[grid::get_cell_modelgridindex(pkt_ptr->where)];
+  if (pkt_ptr->nu_rf > RPKT_IMPORTANCE_NU_MIN && pkt_ptr->nu_rf < RPKT_IMPORTANCE_NU_MAX) {
+    importance *= RPKT_IMPORTANCE_NU_FACTOR;
+  }
+  return importance;
+}
+
+void split_roulette_rpkts(struct packet *packets, std::vector<int> &active_packets,
+                          const std::vector<double> &importance_before, const double t2) {
+  // the free slots and the active indices must refer to the rank's own packet array (not a borrowed batch)
+  assert_always(packets == freeslots_rpkt_packets);
+  const int nactive = importance_before.size();
+  for (int i = 0; i < nactive; i++) {
+    const int n = active_packets[i];
+    struct packet *pkt_ptr = &packets[n];
+    if (importance_before[i] <= 0. || pkt_ptr->type != TYPE_RPKT || pkt_ptr->prop_time >= t2) {
+      continue;
+    }
+
+    const double ratio = get_rpkt_importance(pkt_ptr) / importance_before[i];
+    if (ratio > 1.) {
+      // stochastic rounding of the ratio to a number of packets
+      const int nwanted = static_cast<int>(ratio) + ((rng_uniform() < ratio - static_cast<int>(ratio)) ? 1 : 0);
+      const int ncopies = std::min(nwanted - 1, static_cast<int>(freeslots_rpkt.size()));
+      nrpkt_split_noslot += nwanted - 1 - ncopies;
+      if (ncopies > 0) {
+        pkt_ptr->e_cmf /= (ncopies + 1);
+        pkt_ptr->e_rf /= (ncopies + 1);
+        for (int c = 0; c < ncopies; c++) {
+          const int n_new = freeslots_rpkt.back();
+          freeslots_rpkt.pop_back();
+          packets[n_new] = *pkt_ptr;
+          active_packets.push_back(n_new);
+        }
+        nrpkt_copies += ncopies;
+      }
+    } else if (ratio < 1.) {
+      if (rng_uniform() < ratio) {
+        pkt_ptr->e_cmf /= ratio;
+        pkt_ptr->e_rf /= ratio;
+        nrpkt_roulette_survived++;
+      } else {
+        pkt_ptr->type = TYPE_UNUSED;
+        pkt_ptr->e_cmf = 0.;
+        pkt_ptr->e_rf = 0.;
+        freeslots_rpkt.push_back(n);
+        nrpkt_roulette_killed++;
+      }
+    }
+  }
+}
+
+void end_timestep(const int nts) {
+  printout(
+      "packetcount: timestep %d r-packet splitting made %d copies (%d more without free slots), roulette killed %d "
+      "and kept %d r-packets\n",
+      nts, nrpkt_copies, nrpkt_split_noslot, nrpkt_roulette_killed, nrpkt_roulette_survived);
+}
+
+}  // namespace packetcount
@@ -0,0 +1,39 @@
+#ifndef PACKETCOUNT_H
+#define PACKETCOUNT_H
+
+#include <vector>
+
+#include "packet.h"
+
+// Noise-driven adjustment of the number of packets in each cell (ADAPTIVE_PACKET_COUNT). Before the packets of a
+// timestep are propagated, packets in cells where the estimator noise of the last timestep was well below
+// ADAPTIVE_PACKET_COUNT_RELNOISE are combined in pairs, and the freed slots of the packet array are used to split
+// the packets of the noisiest cells. The packet energy is conserved in both operations.
+//
+// Importance-weighted splitting and Russian roulette of r-packets (RPKT_SPLITTING_ROULETTE). When an r-packet moves
+// to a cell or rest-frame frequency of higher importance it is split into copies, and when the importance decreases it
+// survives with probability equal to the importance ratio and its energy is divided by that probability. The energy
+// is conserved exactly by splitting and in expectation by roulette, so the estimators remain unbiased.
+
+namespace packetcount {
+
+// call on each rank before the estimators of the last timestep are zeroed
+void adjust_packets(int nts, struct packet *packets);
+
+// call before the packets of timestep nts are propagated, with the escaped packets compacted to the end of the array
+void start_timestep(int nts, const struct packet *packets, int npkts_nonescaped);
+
+double get_rpkt_importance(const struct packet *pkt_ptr);
+
+// split or roulette the active r-packets, given their importance (or zero if they were not r-packets) at the start
+// of the update pass. Copies are appended to active_packets and killed packets become TYPE_UNUSED. Only for the
+// packet array passed to start_timestep
+void split_roulette_rpkts(struct packet *packets, std::vector<int> &active_packets,
+                          const std::vector<double> &importance_before, double t2);
+
+// print the splitting and roulette statistics of the timestep
+void end_timestep(int nts);
+
+}  // namespace packetcount
+
+#endif  // PACKETCOUNT_H
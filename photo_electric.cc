@@ -1,5 +1,6 @@
 #include "photo_electric.h"
 
+#include "fastmath.h"
 #include "grid.h"
 #include "sn3d.h"
 #include "stats.h"
@@ -18,9 +19,9 @@ __host__ __device__ double sig_photo_electric(const struct packet *pkt_ptr) {
   if (globals::gamma_grey < 0) {
     // double sigma_cmf_cno = 0.0448e-24 * pow(pkt_ptr->nu_cmf / 2.41326e19, -3.2);
 
-    double sigma_cmf_si = 1.16e-24 * pow(pkt_ptr->nu_cmf / 2.41326e19, -3.13);
+    double sigma_cmf_si = 1.16e-24 * fastmath::pow(pkt_ptr->nu_cmf / 2.41326e19, -3.13);
 
-    double sigma_cmf_fe = 25.7e-24 * pow(pkt_ptr->nu_cmf / 2.41326e19, -3.0);
+    double sigma_cmf_fe = 25.7e-24 * fastmath::pow(pkt_ptr->nu_cmf / 2.41326e19, -3.0);
 
     // 2.41326e19 = 100keV in frequency.
 
@@ -129,7 +130,7 @@ __host__ __device__ void pair_prod(struct packet *pkt_ptr) {
     abort();
   }
 
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
 
   if (zrand > prob_gamma) {
     // Convert it to an e-minus packet - actually it could be positron EK too, but this works
@@ -30,9 +30,9 @@ void escat_rpkt(struct packet *pkt_ptr) {
   double p = 0.;
   double x = 0.;
   do {
-    const double zrand = gsl_rng_uniform(rng);
-    const double zrand2 = gsl_rng_uniform(rng);
-    const double zrand3 = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
+    const double zrand2 = rng_uniform();
+    const double zrand3 = rng_uniform();
 
     M = 2 * zrand - 1;
     mu = pow(M, 2.);
@@ -53,12 +53,12 @@ void escat_rpkt(struct packet *pkt_ptr) {
 #else
 
   // Assume isotropic scattering
-  const double zrand = gsl_rng_uniform(rng);
-  const double zrand2 = gsl_rng_uniform(rng);
+  double zrands[2];
+  rng_uniform_fill(zrands, 2);
 
-  M = 2. * zrand - 1;
+  M = 2. * zrands[0] - 1;
   mu = pow(M, 2.);
-  phisc = 2 * PI * zrand2;
+  phisc = 2 * PI * zrands[1];
 
 #endif
 
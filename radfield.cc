@@ -7,8 +7,10 @@
 #include <algorithm>
 #include <cmath>
 #include <ctime>
+#include <vector>
 
 #include "atomic.h"
+#include "celloutput.h"
 #include "grid.h"
 #include "ltepop.h"
 #include "rpkt.h"
@@ -42,6 +44,8 @@ struct radfieldbin {
 };
 
 __managed__ static double radfieldbin_nu_upper[RADFIELDBINCOUNT];  // array of upper frequency boundaries of bins
+// number of bins in use, which can be fewer than RADFIELDBINCOUNT after adapt_bin_boundaries()
+__managed__ static int radfieldbincount = RADFIELDBINCOUNT;
 __managed__ static struct radfieldbin *radfieldbins = NULL;
 __managed__ static struct radfieldbin_solution *radfieldbin_solutions = NULL;
 
@@ -127,6 +131,7 @@ typedef struct {
 } gsl_T_R_solver_paras;
 
 static FILE *radfieldfile = NULL;
+static struct celloutput::bufferedfile radfield_output;
 
 static inline double get_bin_nu_upper(int binindex) { return radfieldbin_nu_upper[binindex]; }
 
@@ -337,6 +342,7 @@ void init(int my_rank, int ndo, int ndo_nonempty)
       fprintf(radfieldfile, "%8s %15s %8s %11s %11s %9s %9s %9s %9s %9s %12s\n", "timestep", "modelgridindex",
               "bin_num", "nu_lower", "nu_upper", "nuJ", "J", "J_nu_avg", "ncontrib", "T_R", "W");
       fflush(radfieldfile);
+      celloutput::init(&radfield_output, radfieldfile, grid::get_npts_model());
     }
 
     setup_bin_boundaries();
@@ -435,7 +441,7 @@ void init(int my_rank, int ndo, int ndo_nonempty)
 #endif
         {
           const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
-          for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+          for (int binindex = 0; binindex < radfieldbincount; binindex++) {
             const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
             radfieldbin_solutions[mgibinindex].W = -1.;
             radfieldbin_solutions[mgibinindex].T_R = -1.;
@@ -549,7 +555,7 @@ static double get_bin_J(int modelgridindex, int binindex)
   assert_testmodeonly(J_normfactor[modelgridindex] > 0.0);
   assert_testmodeonly(modelgridindex < grid::get_npts_model());
   assert_testmodeonly(binindex >= 0);
-  assert_testmodeonly(binindex < RADFIELDBINCOUNT);
+  assert_testmodeonly(binindex < radfieldbincount);
   const int mgibinindex = grid::get_modelcell_nonemptymgi(modelgridindex) * RADFIELDBINCOUNT + binindex;
   return radfieldbins[mgibinindex].J_raw * J_normfactor[modelgridindex];
 }
@@ -558,7 +564,7 @@ __host__ __device__ static double get_bin_nuJ(int modelgridindex, int binindex)
   assert_testmodeonly(J_normfactor[modelgridindex] > 0.0);
   assert_testmodeonly(modelgridindex < grid::get_npts_model());
   assert_testmodeonly(binindex >= 0);
-  assert_testmodeonly(binindex < RADFIELDBINCOUNT);
+  assert_testmodeonly(binindex < radfieldbincount);
   const int mgibinindex = grid::get_modelcell_nonemptymgi(modelgridindex) * RADFIELDBINCOUNT + binindex;
   return radfieldbins[mgibinindex].nuJ_raw * J_normfactor[modelgridindex];
 }
@@ -597,9 +603,9 @@ __host__ __device__ static inline int select_bin(double nu) {
   if (nu < get_bin_nu_lower(0)) return -2;  // out of range, nu lower than lowest bin's lower boundary
 
   // find the lowest frequency bin with radfieldbin_nu_upper > nu
-  const auto bin = std::upper_bound(&radfieldbin_nu_upper[0], &radfieldbin_nu_upper[RADFIELDBINCOUNT], nu);
+  const auto bin = std::upper_bound(&radfieldbin_nu_upper[0], &radfieldbin_nu_upper[radfieldbincount], nu);
   const int binindex = bin - &radfieldbin_nu_upper[0];
-  if (binindex >= RADFIELDBINCOUNT) {
+  if (binindex >= radfieldbincount) {
     // out of range, nu higher than highest bin's upper boundary
     return -1;
   }
@@ -608,83 +614,95 @@ __host__ __device__ static inline int select_bin(double nu) {
 }
 
 #ifndef FORCE_LTE
-void write_to_file(int modelgridindex, int timestep) {
-  assert_always(MULTIBIN_RADFIELD_MODEL_ON);
+static void write_cell_to_stream(FILE *outfile, int modelgridindex, int timestep) {
+  if (!initialized) {
+    printout("Call to radfield::write_to_file before radfield::init\n");
+    abort();
+  }
 
-#ifdef _OPENMP
-#pragma omp critical(out_file)
-  {
-#endif
-    if (!initialized) {
-      printout("Call to radfield::write_to_file before radfield::init\n");
-      abort();
-    }
+  int totalcontribs = 0;
+  for (int binindex = 0; binindex < radfieldbincount; binindex++)
+    totalcontribs += get_bin_contribcount(modelgridindex, binindex);
 
-    int totalcontribs = 0;
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++)
-      totalcontribs += get_bin_contribcount(modelgridindex, binindex);
+  for (int binindex = -1 - detailed_linecount; binindex < radfieldbincount; binindex++) {
+    double nu_lower = 0.0;
+    double nu_upper = 0.0;
+    double nuJ_out = 0.0;
+    double J_out = 0.0;
+    float T_R = 0.0;
+    float W = 0.0;
+    double J_nu_bar = 0.0;
+    int contribcount = 0;
 
-    for (int binindex = -1 - detailed_linecount; binindex < RADFIELDBINCOUNT; binindex++) {
-      double nu_lower = 0.0;
-      double nu_upper = 0.0;
-      double nuJ_out = 0.0;
-      double J_out = 0.0;
-      float T_R = 0.0;
-      float W = 0.0;
-      double J_nu_bar = 0.0;
-      int contribcount = 0;
+    bool skipoutput = false;
 
-      bool skipoutput = false;
-
-      if (binindex >= 0) {
-        nu_lower = get_bin_nu_lower(binindex);
-        nu_upper = get_bin_nu_upper(binindex);
-        nuJ_out = get_bin_nuJ(modelgridindex, binindex);
-        J_out = get_bin_J(modelgridindex, binindex);
-        T_R = get_bin_T_R(modelgridindex, binindex);
-        W = get_bin_W(modelgridindex, binindex);
-        J_nu_bar = J_out / (nu_upper - nu_lower);
-        contribcount = get_bin_contribcount(modelgridindex, binindex);
-      } else if (binindex == -1) {
-        nuJ_out = nuJ[modelgridindex];
-        J_out = J[modelgridindex];
-        T_R = grid::get_TR(modelgridindex);
-        W = grid::get_W(modelgridindex);
-        contribcount = totalcontribs;
-      } else  // use binindex < -1 for detailed line Jb_lu estimators
-      {
-        const int jblueindex = -2 - binindex;  // -2 is the first detailed line, -3 is the second, etc
-        const int lineindex = detailed_lineindicies[jblueindex];
-        const double nu_trans = globals::linelist[lineindex].nu;
-        nu_lower = nu_trans;
-        nu_upper = nu_trans;
-        nuJ_out = -1.;
-        J_out = -1.;
-        T_R = -1.;
-        W = -1.;
-        J_nu_bar = prev_Jb_lu_normed[modelgridindex][jblueindex].value,
-        contribcount = prev_Jb_lu_normed[modelgridindex][jblueindex].contribcount;
-
-        // if (J_nu_bar <= 0.)
-        // {
-        //   skipoutput = true;
-        // }
-      }
+    if (binindex >= 0) {
+      nu_lower = get_bin_nu_lower(binindex);
+      nu_upper = get_bin_nu_upper(binindex);
+      nuJ_out = get_bin_nuJ(modelgridindex, binindex);
+      J_out = get_bin_J(modelgridindex, binindex);
+      T_R = get_bin_T_R(modelgridindex, binindex);
+      W = get_bin_W(modelgridindex, binindex);
+      J_nu_bar = J_out / (nu_upper - nu_lower);
+      contribcount = get_bin_contribcount(modelgridindex, binindex);
+    } else if (binindex == -1) {
+      nuJ_out = nuJ[modelgridindex];
+      J_out = J[modelgridindex];
+      T_R = grid::get_TR(modelgridindex);
+      W = grid::get_W(modelgridindex);
+      contribcount = totalcontribs;
+    } else  // use binindex < -1 for detailed line Jb_lu estimators
+    {
+      const int jblueindex = -2 - binindex;  // -2 is the first detailed line, -3 is the second, etc
+      const int lineindex = detailed_lineindicies[jblueindex];
+      const double nu_trans = globals::linelist[lineindex].nu;
+      nu_lower = nu_trans;
+      nu_upper = nu_trans;
+      nuJ_out = -1.;
+      J_out = -1.;
+      T_R = -1.;
+      W = -1.;
+      J_nu_bar = prev_Jb_lu_normed[modelgridindex][jblueindex].value,
+      contribcount = prev_Jb_lu_normed[modelgridindex][jblueindex].contribcount;
+
+      // if (J_nu_bar <= 0.)
+      // {
+      //   skipoutput = true;
+      // }
+    }
 
-      if (!skipoutput) {
-        fprintf(radfieldfile, "%d %d %d %11.5e %11.5e %9.3e %9.3e %9.3e %d %9.1f %12.5e\n", timestep, modelgridindex,
-                binindex, nu_lower, nu_upper, nuJ_out, J_out, J_nu_bar, contribcount, T_R, W);
-      }
+    if (!skipoutput) {
+      fprintf(outfile, "%d %d %d %11.5e %11.5e %9.3e %9.3e %9.3e %d %9.1f %12.5e\n", timestep, modelgridindex, binindex,
+              nu_lower, nu_upper, nuJ_out, J_out, J_nu_bar, contribcount, T_R, W);
     }
-    fflush(radfieldfile);
-#ifdef _OPENMP
   }
+  fflush(outfile);
+}
+
+void write_to_file(int modelgridindex, int timestep) {
+  assert_always(MULTIBIN_RADFIELD_MODEL_ON);
+
+  FILE *outfile = celloutput::cellstream(&radfield_output, modelgridindex);
+  if constexpr (BUFFERED_CELL_OUTPUT) {
+    write_cell_to_stream(outfile, modelgridindex, timestep);
+  } else {
+#ifdef _OPENMP
+#pragma omp critical(out_file)
 #endif
+    { write_cell_to_stream(outfile, modelgridindex, timestep); }
+  }
 }
 #endif
 
+void flush_cell_output(void)
+// append the buffered radfield output of the cells to the file in modelgridindex order
+{
+  celloutput::flush(&radfield_output);
+}
+
 void close_file(void) {
   if (radfieldfile != NULL) {
+    celloutput::flush(&radfield_output);
     fclose(radfieldfile);
     radfieldfile = NULL;
   }
@@ -749,7 +767,7 @@ void zero_estimators(int modelgridindex)
     // printout("radfield: zeroing estimators in %d bins in cell %d\n",RADFIELDBINCOUNT,modelgridindex);
 
     assert_always(radfieldbins != NULL);
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
       const int mgibinindex = grid::get_modelcell_nonemptymgi(modelgridindex) * RADFIELDBINCOUNT + binindex;
       radfieldbins[mgibinindex].J_raw = 0.0;
       radfieldbins[mgibinindex].nuJ_raw = 0.0;
@@ -1188,18 +1206,18 @@ void fit_parameters(int modelgridindex, int timestep)
     }
 
     double J_bin_sum = 0.;
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) J_bin_sum += get_bin_J(modelgridindex, binindex);
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) J_bin_sum += get_bin_J(modelgridindex, binindex);
 
     printout("radfield bins sum to J of %g (%.1f%% of total J).\n", J_bin_sum, 100. * J_bin_sum / J[modelgridindex]);
-    printout("radfield: Finding parameters for %d bins...\n", RADFIELDBINCOUNT);
+    printout("radfield: Finding parameters for %d bins...\n", radfieldbincount);
 
     double J_bin_max = 0.;
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
       const double J_bin = get_bin_J(modelgridindex, binindex);
       if (J_bin > J_bin_max) J_bin_max = J_bin;
     }
 
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
       const double nu_lower = get_bin_nu_lower(binindex);
       const double nu_upper = get_bin_nu_upper(binindex);
       const double J_bin = get_bin_J(modelgridindex, binindex);
@@ -1213,7 +1231,7 @@ void fit_parameters(int modelgridindex, int timestep)
         {
           T_R_bin = find_T_R(modelgridindex, binindex);
 
-          if (binindex == RADFIELDBINCOUNT - 1) {
+          if (binindex == radfieldbincount - 1) {
             const float T_e = grid::get_Te(modelgridindex);
             printout("    replacing bin %d T_R %7.1f with cell T_e = %7.1f\n", binindex,
                      get_bin_T_R(modelgridindex, binindex), T_e);
@@ -1268,7 +1286,7 @@ void fit_parameters(int modelgridindex, int timestep)
     }
 
     // double prev_nu_upper = nu_lower_first_initial;
-    // for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++)
+    // for (int binindex = 0; binindex < radfieldbincount; binindex++)
     // {
     //   const double J_bin = get_bin_J(modelgridindex,binindex);
     //   const double T_R_bin = get_bin_T_R(modelgridindex,binindex);
@@ -1480,6 +1498,142 @@ double get_T_J_from_J(const int modelgridindex) {
     return T_J;
 }
 
+double get_J(const int modelgridindex)
+// full-spectrum J (only valid after normalise_J has been applied)
+{
+  return J[modelgridindex];
+}
+
+#ifndef FORCE_LTE
+double get_nuJ(const int modelgridindex)
+// full-spectrum nuJ (only valid after normalise_nuJ has been applied)
+{
+  return nuJ[modelgridindex];
+}
+#endif
+
+int get_total_contribcount(const int modelgridindex)
+// number of packet path contributions to the binned estimators of a cell (zero without MULTIBIN_RADFIELD_MODEL_ON)
+{
+  int totalcontribs = 0;
+  if constexpr (MULTIBIN_RADFIELD_MODEL_ON) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
+      totalcontribs += get_bin_contribcount(modelgridindex, binindex);
+    }
+  }
+  return totalcontribs;
+}
+
+void adapt_bin_boundaries(const int nts)
+// Re-derive the bin boundaries from the packet contribution counts of the last timestep summed over all cells
+// (identical on every rank after the estimators were reduced), with equal counts in each new bin. Bin boundaries are
+// then moved onto ground-level photoionisation edges, and the fitted parameters are remapped onto the new bins.
+// Call on all ranks after the grid properties have been communicated and before the estimators are zeroed
+{
+  if (!MULTIBIN_RADFIELD_MODEL_ON || !RADFIELD_ADAPTIVE_BINNING) {
+    return;
+  }
+  if (nts == 0 || nts % RADFIELD_ADAPTIVE_BINNING_INTERVAL != 0) {
+    return;
+  }
+
+  const int nbins_old = radfieldbincount;
+  const int nbins_new = std::min(RADFIELD_ADAPTIVE_BINCOUNT, RADFIELDBINCOUNT);
+  assert_always(nbins_new >= 3);
+
+  // packet counts in the old bins below the top super bin
+  std::vector<double> counts(nbins_old - 1, 0.);
+  for (int modelgridindex = 0; modelgridindex < grid::get_npts_model(); modelgridindex++) {
+    if (grid::get_numassociatedcells(modelgridindex) > 0) {
+      for (int binindex = 0; binindex < nbins_old - 1; binindex++) {
+        counts[binindex] += get_bin_contribcount(modelgridindex, binindex);
+      }
+    }
+  }
+  double counts_total = 0.;
+  for (int binindex = 0; binindex < nbins_old - 1; binindex++) {
+    counts_total += counts[binindex];
+  }
+  if (counts_total <= 0.) {
+    printout("radfield: no packet contributions to adapt the bins at timestep %d\n", nts);
+    return;
+  }
+
+  // a floor on the weight of each old bin keeps some resolution where there were no packets
+  const double weight_floor = 0.05 * counts_total / (nbins_old - 1);
+  const double weight_total = counts_total + (weight_floor * (nbins_old - 1));
+
+  const std::vector<double> nu_upper_old(radfieldbin_nu_upper, radfieldbin_nu_upper + nbins_old);
+  std::vector<double> nu_upper_new(nbins_new);
+
+  // invert the cumulative weight, which is linear in frequency within each old bin
+  int binindex_old = 0;
+  double weight_below = 0.;  // weight of the old bins below binindex_old
+  for (int binindex = 0; binindex < nbins_new - 2; binindex++) {
+    const double weight_target = weight_total * (binindex + 1) / (nbins_new - 1);
+    while (binindex_old < nbins_old - 2 && weight_below + counts[binindex_old] + weight_floor < weight_target) {
+      weight_below += counts[binindex_old] + weight_floor;
+      binindex_old++;
+    }
+    const double nu_lower = get_bin_nu_lower(binindex_old);
+    const double frac = (weight_target - weight_below) / (counts[binindex_old] + weight_floor);
+    nu_upper_new[binindex] = nu_lower + std::clamp(frac, 0., 1.) * (nu_upper_old[binindex_old] - nu_lower);
+  }
+  nu_upper_new[nbins_new - 2] = nu_upper_last_initial;
+  nu_upper_new[nbins_new - 1] = nu_upper_superbin;
+
+  // move the upper boundary of a bin down to the highest ground-level photoionisation edge inside it, so that the
+  // fitted radiation field does not average across the edge. The boundary of the super bin stays fixed
+  int nboundaries_on_edges = 0;
+  for (int binindex = 0; binindex < nbins_new - 2; binindex++) {
+    const double nu_lower = (binindex > 0) ? nu_upper_new[binindex - 1] : nu_lower_first_initial;
+    double nu_edge_highest = -1.;
+    for (int i = 0; i < globals::nbfcontinua; i++) {
+      const double nu_edge = globals::allcont[i].nu_edge;
+      if (globals::allcont[i].level == 0 && nu_edge > nu_lower && nu_edge < nu_upper_new[binindex]) {
+        nu_edge_highest = std::max(nu_edge_highest, nu_edge);
+      }
+    }
+    if (nu_edge_highest > 0.) {
+      nu_upper_new[binindex] = nu_edge_highest;
+      nboundaries_on_edges++;
+    }
+  }
+
+  // each new bin takes the solution of the old bin that contains its central frequency
+#ifdef MPI_ON
+  if (globals::rank_in_node == 0)
+#endif
+  {
+    std::vector<struct radfieldbin_solution> solutions_old(nbins_old);
+    for (int modelgridindex = 0; modelgridindex < grid::get_npts_model(); modelgridindex++) {
+      if (grid::get_numassociatedcells(modelgridindex) > 0) {
+        const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
+        std::copy_n(&radfieldbin_solutions[nonemptymgi * RADFIELDBINCOUNT], nbins_old, solutions_old.begin());
+
+        int binindex_old_mid = 0;
+        for (int binindex = 0; binindex < nbins_new; binindex++) {
+          const double nu_lower = (binindex > 0) ? nu_upper_new[binindex - 1] : nu_lower_first_initial;
+          const double nu_mid = (nu_lower + nu_upper_new[binindex]) / 2.;
+          while (binindex_old_mid < nbins_old - 1 && nu_upper_old[binindex_old_mid] <= nu_mid) {
+            binindex_old_mid++;
+          }
+          radfieldbin_solutions[nonemptymgi * RADFIELDBINCOUNT + binindex] = solutions_old[binindex_old_mid];
+        }
+      }
+    }
+  }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_node);
+#endif
+
+  std::copy(nu_upper_new.begin(), nu_upper_new.end(), radfieldbin_nu_upper);
+  radfieldbincount = nbins_new;
+
+  printout("radfield: timestep %d adapted %d bins to %d bins from %g packet contributions (%d on bf edges)\n", nts,
+           nbins_old, nbins_new, counts_total, nboundaries_on_edges);
+}
+
 #ifdef DO_TITER
 void titer_J(const int modelgridindex) {
   if (J_reduced_save[modelgridindex] >= 0) {
@@ -1502,15 +1656,15 @@ void titer_nuJ(const int modelgridindex) {
 void reduce_estimators(void)
 // reduce and broadcast (allreduce) the estimators for J and nuJ in all bins
 {
-  MPI_Allreduce(MPI_IN_PLACE, J, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, J, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 #ifndef FORCE_LTE
-  MPI_Allreduce(MPI_IN_PLACE, nuJ, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, nuJ, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 #endif
 
 #if (DETAILED_BF_ESTIMATORS_ON)
   {
     MPI_Allreduce(MPI_IN_PLACE, bfrate_raw, grid::get_nonempty_npts_model() * globals::nbfcontinua, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
+                  globals::mpi_comm_model);
   }
 #endif
 
@@ -1524,13 +1678,16 @@ void reduce_estimators(void)
       // grid::get_numassociatedcells(modelgridindex));
       if (grid::get_numassociatedcells(modelgridindex) > 0) {
         const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
-        for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+        for (int binindex = 0; binindex < radfieldbincount; binindex++) {
           const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
           // printout("MPI: pre-MPI_Allreduce, this process modelgrid %d binindex %d has a individual contribcount of
           // %d\n",modelgridindex,binindex,radfieldbins[mgibinindex].contribcount);
-          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].contribcount, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, MPI_SUM,
+                        globals::mpi_comm_model);
+          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, MPI_SUM,
+                        globals::mpi_comm_model);
+          MPI_Allreduce(MPI_IN_PLACE, &radfieldbins[mgibinindex].contribcount, 1, MPI_INT, MPI_SUM,
+                        globals::mpi_comm_model);
 
           // printout("MPI: After MPI_Allreduce: this process modelgrid %d binindex %d has a contribcount of
           // %d\n",modelgridindex,binindex,radfieldbins[mgibinindex].contribcount);
@@ -1551,35 +1708,35 @@ void reduce_estimators(void)
       if (grid::get_numassociatedcells(modelgridindex) > 0) {
         for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
           MPI_Allreduce(MPI_IN_PLACE, &Jb_lu_raw[modelgridindex][jblueindex].value, 1, MPI_DOUBLE, MPI_SUM,
-                        MPI_COMM_WORLD);
+                        globals::mpi_comm_model);
           MPI_Allreduce(MPI_IN_PLACE, &Jb_lu_raw[modelgridindex][jblueindex].contribcount, 1, MPI_INT, MPI_SUM,
-                        MPI_COMM_WORLD);
+                        globals::mpi_comm_model);
         }
       }
     }
     const int duration_reduction = time(NULL) - sys_time_start_reduction;
     printout(" (took %d s)\n", duration_reduction);
   }
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 }
 
 void do_MPI_Bcast(const int modelgridindex, const int root, int root_node_id)
 // broadcast computed radfield results including parameters
 // from the cells belonging to root process to all processes
 {
-  MPI_Bcast(&J_normfactor[modelgridindex], 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
+  MPI_Bcast(&J_normfactor[modelgridindex], 1, MPI_DOUBLE, root, globals::mpi_comm_model);
   if (grid::get_numassociatedcells(modelgridindex) > 0) {
     const int nonemptymgi = grid::get_modelcell_nonemptymgi(modelgridindex);
     if (MULTIBIN_RADFIELD_MODEL_ON) {
-      for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+      for (int binindex = 0; binindex < radfieldbincount; binindex++) {
         const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
         if (globals::rank_in_node == 0) {
           MPI_Bcast(&radfieldbin_solutions[mgibinindex].W, 1, MPI_FLOAT, root_node_id, globals::mpi_comm_internode);
           MPI_Bcast(&radfieldbin_solutions[mgibinindex].T_R, 1, MPI_FLOAT, root_node_id, globals::mpi_comm_internode);
         }
-        MPI_Bcast(&radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-        MPI_Bcast(&radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-        MPI_Bcast(&radfieldbins[mgibinindex].contribcount, 1, MPI_INT, root, MPI_COMM_WORLD);
+        MPI_Bcast(&radfieldbins[mgibinindex].J_raw, 1, MPI_DOUBLE, root, globals::mpi_comm_model);
+        MPI_Bcast(&radfieldbins[mgibinindex].nuJ_raw, 1, MPI_DOUBLE, root, globals::mpi_comm_model);
+        MPI_Bcast(&radfieldbins[mgibinindex].contribcount, 1, MPI_INT, root, globals::mpi_comm_model);
       }
     }
 
@@ -1594,12 +1751,13 @@ void do_MPI_Bcast(const int modelgridindex, const int root, int root_node_id)
 
     if (DETAILED_LINE_ESTIMATORS_ON) {
       for (int jblueindex = 0; jblueindex < detailed_linecount; jblueindex++) {
-        MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].value, 1, MPI_DOUBLE, root, MPI_COMM_WORLD);
-        MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].contribcount, 1, MPI_INT, root, MPI_COMM_WORLD);
+        MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].value, 1, MPI_DOUBLE, root, globals::mpi_comm_model);
+        MPI_Bcast(&prev_Jb_lu_normed[modelgridindex][jblueindex].contribcount, 1, MPI_INT, root,
+                  globals::mpi_comm_model);
       }
     }
   }
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 }
 #endif
 
@@ -1609,10 +1767,10 @@ void write_restart_data(FILE *gridsave_file) {
   fprintf(gridsave_file, "%d\n", 30490824);  // special number marking the beginning of radfield data
 
   if (MULTIBIN_RADFIELD_MODEL_ON) {
-    fprintf(gridsave_file, "%d %la %la %la %la\n", RADFIELDBINCOUNT, nu_lower_first_initial, nu_upper_last_initial,
+    fprintf(gridsave_file, "%d %la %la %la %la\n", radfieldbincount, nu_lower_first_initial, nu_upper_last_initial,
             T_R_min, T_R_max);
 
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
       fprintf(gridsave_file, "%d %la\n", binindex, radfieldbin_nu_upper[binindex]);
     }
   }
@@ -1649,7 +1807,7 @@ void write_restart_data(FILE *gridsave_file) {
       fprintf(gridsave_file, "%d %la\n", modelgridindex, J_normfactor[modelgridindex]);
 
       if (MULTIBIN_RADFIELD_MODEL_ON) {
-        for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+        for (int binindex = 0; binindex < radfieldbincount; binindex++) {
           const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
           fprintf(gridsave_file, "%la %la %a %a %d\n", radfieldbins[mgibinindex].J_raw,
                   radfieldbins[mgibinindex].nuJ_raw, radfieldbin_solutions[mgibinindex].W,
@@ -1696,8 +1854,11 @@ void read_restart_data(FILE *gridsave_file) {
     double nu_upper_last_ratio = nu_upper_last_initial_in / nu_upper_last_initial;
     if (nu_upper_last_ratio > 1.0) nu_upper_last_ratio = 1 / nu_upper_last_ratio;
 
-    if (bincount_in != RADFIELDBINCOUNT || T_R_min_in != T_R_min || T_R_max_in != T_R_max ||
-        nu_lower_first_ratio < 0.999 || nu_upper_last_ratio < 0.999) {
+    // the saved bin count is fewer than RADFIELDBINCOUNT if the bins were adapted
+    const bool bincount_ok = RADFIELD_ADAPTIVE_BINNING ? (bincount_in >= 2 && bincount_in <= RADFIELDBINCOUNT)
+                                                       : (bincount_in == RADFIELDBINCOUNT);
+    if (!bincount_ok || T_R_min_in != T_R_min || T_R_max_in != T_R_max || nu_lower_first_ratio < 0.999 ||
+        nu_upper_last_ratio < 0.999) {
       printout(
           "ERROR: gridsave file specifies %d bins, nu_lower_first_initial %lg nu_upper_last_initial %lg T_R_min %lg "
           "T_R_max %lg\n",
@@ -1706,8 +1867,9 @@ void read_restart_data(FILE *gridsave_file) {
                RADFIELDBINCOUNT, nu_lower_first_initial, nu_upper_last_initial, T_R_min, T_R_max);
       abort();
     }
+    radfieldbincount = bincount_in;
 
-    for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+    for (int binindex = 0; binindex < radfieldbincount; binindex++) {
       int binindex_in;
       assert_always(fscanf(gridsave_file, "%d %la\n", &binindex_in, &radfieldbin_nu_upper[binindex]) == 2);
       assert_always(binindex_in == binindex);
@@ -1769,7 +1931,7 @@ void read_restart_data(FILE *gridsave_file) {
       }
 
       if (MULTIBIN_RADFIELD_MODEL_ON) {
-        for (int binindex = 0; binindex < RADFIELDBINCOUNT; binindex++) {
+        for (int binindex = 0; binindex < radfieldbincount; binindex++) {
           const int mgibinindex = nonemptymgi * RADFIELDBINCOUNT + binindex;
           float W = 0;
           float T_R = 0;
@@ -1822,7 +1984,7 @@ inline int integrate(const gsl_function *f, double nu_a, double nu_b, double eps
         pts[npts++] = get_bin_nu_lower(0);
       }
 
-      const int maxbinplusone = (binindex_b < 0) ? RADFIELDBINCOUNT : binindex_b;
+      const int maxbinplusone = (binindex_b < 0) ? radfieldbincount : binindex_b;
 
       for (int binindex = binindex_a; binindex < maxbinplusone; binindex++) pts[npts++] = get_bin_nu_upper(binindex);
 
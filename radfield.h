@@ -12,6 +12,7 @@ void zero_estimators(int modelgridindex);
 void init(int my_rank, int ndo, int ndo_nonempty);
 void initialise_prev_titer_photoionestimators(void);
 void write_to_file(int modelgridindex, int timestep);
+void flush_cell_output(void);
 void close_file(void);
 __host__ __device__ void update_estimators(int modelgridindex, double distance_e_cmf, double nu_cmf,
                                            const struct packet *pkt_ptr);
@@ -23,6 +24,10 @@ __host__ __device__ void set_J_normfactor(int modelgridindex, double normfactor)
 __host__ __device__ void normalise_J(int modelgridindex, double estimator_normfactor_over4pi);
 __host__ __device__ void normalise_nuJ(int modelgridindex, double estimator_normfactor_over4pi);
 __host__ __device__ double get_T_J_from_J(int modelgridindex);
+double get_J(int modelgridindex);
+double get_nuJ(int modelgridindex);
+int get_total_contribcount(int modelgridindex);
+void adapt_bin_boundaries(int nts);
 __host__ __device__ int get_Jblueindex(int lineindex);
 __host__ __device__ double get_Jb_lu(int modelgridindex, int jblueindex);
 __host__ __device__ int get_Jb_lu_contribcount(int modelgridindex, int jblueindex);
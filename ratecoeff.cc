@@ -5,12 +5,15 @@
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <utility>
+#include <vector>
 // #define  _XOPEN_SOURCE
 #define D_POSIX_SOURCE
 #include <cstdio>
 
 #include "artisoptions.h"
 #include "atomic.h"
+#include "ensemble.h"
 #include "grid.h"
 #include "input.h"
 #include "ltepop.h"
@@ -192,8 +195,10 @@ static bool read_ratecoeff_dat(void)
   }
 }
 
-static void write_ratecoeff_dat(void) {
-  FILE *ratecoeff_file = fopen_required("ratecoeff.dat", "w");
+static void write_ratecoeff_dat(void)
+// write to a temporary file and rename it, so that ranks of other models never read a partly written ratecoeff.dat
+{
+  FILE *ratecoeff_file = fopen_required("ratecoeff.dat.tmp", "w");
   fprintf(ratecoeff_file, "%32s\n", adatafile_hash);
   fprintf(ratecoeff_file, "%32s\n", compositionfile_hash);
   fprintf(ratecoeff_file, "%32s\n", phixsfile_hash);
@@ -241,6 +246,7 @@ static void write_ratecoeff_dat(void) {
     }
   }
   fclose(ratecoeff_file);
+  assert_always(std::rename("ratecoeff.dat.tmp", "ratecoeff.dat") == 0);
 }
 
 ///****************************************************************************
@@ -452,176 +458,184 @@ static void precalculate_rate_coefficient_integrals(void) {
   const double intaccuracy = RATECOEFF_INTEGRAL_ACCURACY;
   const double epsrelwarning = 1e-2;  // fractional error to emit a warning
 
-  /// Calculate the rate coefficients for each level of each ion of each element
+  /// Calculate the rate coefficients for each level of each ion of each element. The ions are flattened into one
+  /// list so that the threads share out the work across elements, with dynamic scheduling because the cost of an
+  /// ion scales with its number of ionising levels.
+  std::vector<std::pair<int, int>> elementions;
   for (int element = 0; element < get_nelements(); element++) {
-    const int nions = get_nions(element) - 1;
+    for (int ion = 0; ion < get_nions(element) - 1; ion++) {
+      elementions.emplace_back(element, ion);
+    }
+  }
+  const int nelementions = elementions.size();
+
 #ifdef _OPENMP
-#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic)
 #endif
-    for (int ion = 0; ion < nions; ion++) {
-      // nlevels = get_nlevels(element,ion);
-      const int atomic_number = get_element(element);
-      const int ionstage = get_ionstage(element, ion);
-      const int nlevels = get_ionisinglevels(element, ion);
-      /// That's only an option for pure LTE
-      // if (TAKE_N_BFCONTINUA < nlevels) nlevels = TAKE_N_BFCONTINUA;
-      printout("Performing rate integrals for Z = %d, ion_stage %d...\n", atomic_number, ionstage);
-
-      gsl_error_handler_t *previous_handler = gsl_set_error_handler(gsl_error_handler_printout);
-
-      for (int level = 0; level < nlevels; level++) {
-        if ((level > 0) && (level % 50 == 0)) printout("  completed up to level %d of %d\n", level, nlevels);
-
-        const int nphixstargets = get_nphixstargets(element, ion, level);
-        for (int phixstargetindex = 0; phixstargetindex < nphixstargets; phixstargetindex++) {
-          const int upperlevel = get_phixsupperlevel(element, ion, level, phixstargetindex);
-          const double phixstargetprobability = get_phixsprobability(element, ion, level, phixstargetindex);
-
-          // printout("element %d, ion %d, level %d, upperlevel %d, epsilon %g, continuum %g, nlevels
-          // %d\n",element,ion,level,upperlevel,epsilon(element,ion,level),epsilon(element,ion+1,upperlevel),nlevels);
-
-          // const double E_threshold = epsilon(element,ion+1,upperlevel) - epsilon(element,ion,level);
-          const double E_threshold = get_phixs_threshold(element, ion, level, phixstargetindex);
-          const double nu_threshold = E_threshold / H;
-          const double nu_max_phixs =
-              nu_threshold * last_phixs_nuovernuedge;  // nu of the uppermost point in the phixs table
-          // Loop over the temperature grid
-          for (int iter = 0; iter < TABLESIZE; iter++) {
-            double error;
-            int status = 0;
-            const float T_e = MINTEMP * exp(iter * T_step_log);
-            // T_e = MINTEMP + iter*T_step;
-            const double sfac = calculate_sahafact(element, ion, level, upperlevel, T_e, E_threshold);
-            // printout("%d %g\n",iter,T_e);
-
-            assert_always(globals::elements[element].ions[ion].levels[level].photoion_xs != NULL);
-            // the threshold of the first target gives nu of the first phixstable point
-            gslintegration_paras intparas = {
-                .nu_edge = nu_threshold,
-                .T = T_e,
-                .photoion_xs = globals::elements[element].ions[ion].levels[level].photoion_xs};
-
-            // gsl_function F_gamma;
-            // F_gamma.function = &gamma_integrand_gsl;
-            // F_gamma.params = &intparas;
-            // gsl_function F_alpha_sp_E;
-            // F_alpha_sp_E.function = &alpha_sp_E_integrand_gsl;
-            // F_alpha_sp_E.params = &intparas;
-            // F_stimulated_bfcooling.function = &stimulated_bfcooling_integrand_gsl;
-            // F_stimulated_bfcooling.params = &intparas;
-            // F_stimulated_recomb.function = &stimulated_recomb_integrand_gsl;
-            // F_stimulated_recomb.params = &intparas;
-
-            /// Spontaneous recombination and bf-cooling coefficient don't depend on the cutted radiation field
-            double alpha_sp = 0.0;
-            const gsl_function F_alpha_sp = {.function = &alpha_sp_integrand_gsl, .params = &intparas};
-
-            status = gsl_integration_qag(&F_alpha_sp, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
-                                         GSL_INTEG_GAUSS61, gslworkspace, &alpha_sp, &error);
-            if (status != 0 && (status != 18 || (error / alpha_sp) > epsrelwarning)) {
-              printout("alpha_sp integrator status %d. Integral value %9.3e +/- %9.3e\n", status, alpha_sp, error);
-            }
-            alpha_sp *= FOURPI * sfac * phixstargetprobability;
+  for (int elementionindex = 0; elementionindex < nelementions; elementionindex++) {
+    const auto [element, ion] = elementions[elementionindex];
+    // nlevels = get_nlevels(element,ion);
+    const int atomic_number = get_element(element);
+    const int ionstage = get_ionstage(element, ion);
+    const int nlevels = get_ionisinglevels(element, ion);
+    /// That's only an option for pure LTE
+    // if (TAKE_N_BFCONTINUA < nlevels) nlevels = TAKE_N_BFCONTINUA;
+    printout("Performing rate integrals for Z = %d, ion_stage %d...\n", atomic_number, ionstage);
+
+    gsl_error_handler_t *previous_handler = gsl_set_error_handler(gsl_error_handler_printout);
+
+    for (int level = 0; level < nlevels; level++) {
+      if ((level > 0) && (level % 50 == 0)) printout("  completed up to level %d of %d\n", level, nlevels);
+
+      const int nphixstargets = get_nphixstargets(element, ion, level);
+      for (int phixstargetindex = 0; phixstargetindex < nphixstargets; phixstargetindex++) {
+        const int upperlevel = get_phixsupperlevel(element, ion, level, phixstargetindex);
+        const double phixstargetprobability = get_phixsprobability(element, ion, level, phixstargetindex);
+
+        // printout("element %d, ion %d, level %d, upperlevel %d, epsilon %g, continuum %g, nlevels
+        // %d\n",element,ion,level,upperlevel,epsilon(element,ion,level),epsilon(element,ion+1,upperlevel),nlevels);
+
+        // const double E_threshold = epsilon(element,ion+1,upperlevel) - epsilon(element,ion,level);
+        const double E_threshold = get_phixs_threshold(element, ion, level, phixstargetindex);
+        const double nu_threshold = E_threshold / H;
+        const double nu_max_phixs =
+            nu_threshold * last_phixs_nuovernuedge;  // nu of the uppermost point in the phixs table
+        // Loop over the temperature grid
+        for (int iter = 0; iter < TABLESIZE; iter++) {
+          double error;
+          int status = 0;
+          const float T_e = MINTEMP * exp(iter * T_step_log);
+          // T_e = MINTEMP + iter*T_step;
+          const double sfac = calculate_sahafact(element, ion, level, upperlevel, T_e, E_threshold);
+          // printout("%d %g\n",iter,T_e);
+
+          assert_always(globals::elements[element].ions[ion].levels[level].photoion_xs != NULL);
+          // the threshold of the first target gives nu of the first phixstable point
+          gslintegration_paras intparas = {
+              .nu_edge = nu_threshold,
+              .T = T_e,
+              .photoion_xs = globals::elements[element].ions[ion].levels[level].photoion_xs};
+
+          // gsl_function F_gamma;
+          // F_gamma.function = &gamma_integrand_gsl;
+          // F_gamma.params = &intparas;
+          // gsl_function F_alpha_sp_E;
+          // F_alpha_sp_E.function = &alpha_sp_E_integrand_gsl;
+          // F_alpha_sp_E.params = &intparas;
+          // F_stimulated_bfcooling.function = &stimulated_bfcooling_integrand_gsl;
+          // F_stimulated_bfcooling.params = &intparas;
+          // F_stimulated_recomb.function = &stimulated_recomb_integrand_gsl;
+          // F_stimulated_recomb.params = &intparas;
+
+          /// Spontaneous recombination and bf-cooling coefficient don't depend on the cutted radiation field
+          double alpha_sp = 0.0;
+          const gsl_function F_alpha_sp = {.function = &alpha_sp_integrand_gsl, .params = &intparas};
+
+          status = gsl_integration_qag(&F_alpha_sp, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
+                                       GSL_INTEG_GAUSS61, gslworkspace, &alpha_sp, &error);
+          if (status != 0 && (status != 18 || (error / alpha_sp) > epsrelwarning)) {
+            printout("alpha_sp integrator status %d. Integral value %9.3e +/- %9.3e\n", status, alpha_sp, error);
+          }
+          alpha_sp *= FOURPI * sfac * phixstargetprobability;
+
+          if (!std::isfinite(alpha_sp) || alpha_sp < 0) {
+            printout(
+                "WARNING: alpha_sp was negative or non-finite for level %d Te %g. alpha_sp %g sfac %g "
+                "phixstargetindex %d "
+                "phixstargetprobability %g\n",
+                level, T_e, alpha_sp, sfac, phixstargetindex, phixstargetprobability);
+            alpha_sp = 0;
+          }
+          // assert_always(alpha_sp >= 0);
+          globals::spontrecombcoeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = alpha_sp;
+
+          // if (atomic_number == 26 && ionstage == 3 && level < 5)
+          // {
+          //   const double E_threshold_b = get_phixs_threshold(element, ion, level, phixstargetindex);
+          //   const double sfac_b = calculate_sahafact(element,ion,level,upperlevel,T_e,E_threshold_b);
+          //   const double nu_threshold_b = E_threshold_b / H;
+          //   const double nu_max_phixs_b = nu_threshold * last_phixs_nuovernuedge; //nu of the uppermost point in
+          //   the phixs table intparas.nu_edge = nu_threshold_b;              // Global variable which passes the
+          //   threshold to the integrator
+          //                                                 // the threshold of the first target gives nu of the
+          //                                                 first phixstable point
+          //   double alpha_sp_new;
+          //   status = gsl_integration_qag(&F_alpha_sp, nu_threshold_b, nu_max_phixs_b, 0, intaccuracy, GSLWSIZE,
+          //   GSL_INTEG_GAUSS61, w, &alpha_sp_new, &error); alpha_sp_new *= FOURPI * sfac_b * phixstargetprobability;
+          //   printout("recomb: T_e %6.1f Z=%d ionstage %d->%d upper+1 %5d lower+1 %5d sfac %7.2e sfac_new %7.2e
+          //   alpha %7.2e alpha_new %7.2e threshold_ev %7.2e threshold_new_ev %7.2e\n",
+          //           T_e, get_element(element), get_ionstage(element, ion + 1),
+          //           get_ionstage(element, ion), upperlevel + 1, level + 1,
+          //           sfac, sfac_b,
+          //           alpha_sp, alpha_sp_new,
+          //           E_threshold / EV,
+          //           E_threshold_b / EV);
+          // }
 
-            if (!std::isfinite(alpha_sp) || alpha_sp < 0) {
-              printout(
-                  "WARNING: alpha_sp was negative or non-finite for level %d Te %g. alpha_sp %g sfac %g "
-                  "phixstargetindex %d "
-                  "phixstargetprobability %g\n",
-                  level, T_e, alpha_sp, sfac, phixstargetindex, phixstargetprobability);
-              alpha_sp = 0;
-            }
-            // assert_always(alpha_sp >= 0);
-            globals::spontrecombcoeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = alpha_sp;
-
-            // if (atomic_number == 26 && ionstage == 3 && level < 5)
-            // {
-            //   const double E_threshold_b = get_phixs_threshold(element, ion, level, phixstargetindex);
-            //   const double sfac_b = calculate_sahafact(element,ion,level,upperlevel,T_e,E_threshold_b);
-            //   const double nu_threshold_b = E_threshold_b / H;
-            //   const double nu_max_phixs_b = nu_threshold * last_phixs_nuovernuedge; //nu of the uppermost point in
-            //   the phixs table intparas.nu_edge = nu_threshold_b;              // Global variable which passes the
-            //   threshold to the integrator
-            //                                                 // the threshold of the first target gives nu of the
-            //                                                 first phixstable point
-            //   double alpha_sp_new;
-            //   status = gsl_integration_qag(&F_alpha_sp, nu_threshold_b, nu_max_phixs_b, 0, intaccuracy, GSLWSIZE,
-            //   GSL_INTEG_GAUSS61, w, &alpha_sp_new, &error); alpha_sp_new *= FOURPI * sfac_b * phixstargetprobability;
-            //   printout("recomb: T_e %6.1f Z=%d ionstage %d->%d upper+1 %5d lower+1 %5d sfac %7.2e sfac_new %7.2e
-            //   alpha %7.2e alpha_new %7.2e threshold_ev %7.2e threshold_new_ev %7.2e\n",
-            //           T_e, get_element(element), get_ionstage(element, ion + 1),
-            //           get_ionstage(element, ion), upperlevel + 1, level + 1,
-            //           sfac, sfac_b,
-            //           alpha_sp, alpha_sp_new,
-            //           E_threshold / EV,
-            //           E_threshold_b / EV);
-            // }
-
-            // if (iter == 0)
-            //   printout("alpha_sp: element %d ion %d level %d upper level %d at temperature %g, alpha_sp is %g
-            //   (integral %g, sahafac %g)\n", element, ion, level, upperlevel, T_e, alpha_sp, alpha_sp/(FOURPI * sfac *
-            //   phixstargetprobability),sfac);
+          // if (iter == 0)
+          //   printout("alpha_sp: element %d ion %d level %d upper level %d at temperature %g, alpha_sp is %g
+          //   (integral %g, sahafac %g)\n", element, ion, level, upperlevel, T_e, alpha_sp, alpha_sp/(FOURPI * sfac *
+          //   phixstargetprobability),sfac);
 
 #if (!NO_LUT_PHOTOION)
-            double gammacorr = 0.0;
-            const gsl_function F_gammacorr = {.function = &gammacorr_integrand_gsl, .params = &intparas};
+          double gammacorr = 0.0;
+          const gsl_function F_gammacorr = {.function = &gammacorr_integrand_gsl, .params = &intparas};
 
-            status = gsl_integration_qag(&F_gammacorr, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
-                                         GSL_INTEG_GAUSS61, gslworkspace, &gammacorr, &error);
-            if (status != 0 && (status != 18 || (error / gammacorr) > epsrelwarning)) {
-              printout("gammacorr integrator status %d. Integral value %9.3e +/- %9.3e\n", status, gammacorr, error);
-            }
-            gammacorr *= FOURPI * phixstargetprobability;
-            assert_always(gammacorr >= 0);
-            if (gammacorr < 0) {
-              printout("WARNING: gammacorr was negative for level %d\n", level);
-              gammacorr = 0;
-            }
-            globals::corrphotoioncoeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = gammacorr;
+          status = gsl_integration_qag(&F_gammacorr, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
+                                       GSL_INTEG_GAUSS61, gslworkspace, &gammacorr, &error);
+          if (status != 0 && (status != 18 || (error / gammacorr) > epsrelwarning)) {
+            printout("gammacorr integrator status %d. Integral value %9.3e +/- %9.3e\n", status, gammacorr, error);
+          }
+          gammacorr *= FOURPI * phixstargetprobability;
+          assert_always(gammacorr >= 0);
+          if (gammacorr < 0) {
+            printout("WARNING: gammacorr was negative for level %d\n", level);
+            gammacorr = 0;
+          }
+          globals::corrphotoioncoeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = gammacorr;
 #endif
 
 #if (!NO_LUT_BFHEATING)
-            double bfheating_coeff = 0.0;
-            const gsl_function F_bfheating = {.function = &approx_bfheating_integrand_gsl, .params = &intparas};
+          double bfheating_coeff = 0.0;
+          const gsl_function F_bfheating = {.function = &approx_bfheating_integrand_gsl, .params = &intparas};
 
-            status = gsl_integration_qag(&F_bfheating, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
-                                         GSL_INTEG_GAUSS61, gslworkspace, &bfheating_coeff, &error);
+          status = gsl_integration_qag(&F_bfheating, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
+                                       GSL_INTEG_GAUSS61, gslworkspace, &bfheating_coeff, &error);
 
-            if (status != 0 && (status != 18 || (error / bfheating_coeff) > epsrelwarning)) {
-              printout("bfheating_coeff integrator status %d. Integral value %9.3e +/- %9.3e\n", status,
-                       bfheating_coeff, error);
-            }
-            bfheating_coeff *= FOURPI * phixstargetprobability;
-            if (bfheating_coeff < 0) {
-              printout("WARNING: bfheating_coeff was negative for level %d\n", level);
-              bfheating_coeff = 0;
-            }
-            globals::bfheating_coeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = bfheating_coeff;
+          if (status != 0 && (status != 18 || (error / bfheating_coeff) > epsrelwarning)) {
+            printout("bfheating_coeff integrator status %d. Integral value %9.3e +/- %9.3e\n", status,
+                     bfheating_coeff, error);
+          }
+          bfheating_coeff *= FOURPI * phixstargetprobability;
+          if (bfheating_coeff < 0) {
+            printout("WARNING: bfheating_coeff was negative for level %d\n", level);
+            bfheating_coeff = 0;
+          }
+          globals::bfheating_coeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = bfheating_coeff;
 #endif
 
-            double bfcooling_coeff = 0.0;
-            const gsl_function F_bfcooling = {.function = &bfcooling_integrand_gsl, .params = &intparas};
+          double bfcooling_coeff = 0.0;
+          const gsl_function F_bfcooling = {.function = &bfcooling_integrand_gsl, .params = &intparas};
 
-            status = gsl_integration_qag(&F_bfcooling, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
-                                         GSL_INTEG_GAUSS61, gslworkspace, &bfcooling_coeff, &error);
-            if (status != 0 && (status != 18 || (error / bfcooling_coeff) > epsrelwarning)) {
-              printout("bfcooling_coeff integrator status %d. Integral value %9.3e +/- %9.3e\n", status,
-                       bfcooling_coeff, error);
-            }
-            bfcooling_coeff *= FOURPI * sfac * phixstargetprobability;
-            if (!std::isfinite(bfcooling_coeff) || bfcooling_coeff < 0) {
-              printout(
-                  "WARNING: bfcooling_coeff was negative or non-finite for level %d Te %g. bfcooling_coeff %g sfac %g "
-                  "phixstargetindex %d phixstargetprobability %g\n",
-                  level, T_e, bfcooling_coeff, sfac, phixstargetindex, phixstargetprobability);
-              bfcooling_coeff = 0;
-            }
-            globals::bfcooling_coeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = bfcooling_coeff;
+          status = gsl_integration_qag(&F_bfcooling, nu_threshold, nu_max_phixs, 0, intaccuracy, GSLWSIZE,
+                                       GSL_INTEG_GAUSS61, gslworkspace, &bfcooling_coeff, &error);
+          if (status != 0 && (status != 18 || (error / bfcooling_coeff) > epsrelwarning)) {
+            printout("bfcooling_coeff integrator status %d. Integral value %9.3e +/- %9.3e\n", status,
+                     bfcooling_coeff, error);
+          }
+          bfcooling_coeff *= FOURPI * sfac * phixstargetprobability;
+          if (!std::isfinite(bfcooling_coeff) || bfcooling_coeff < 0) {
+            printout(
+                "WARNING: bfcooling_coeff was negative or non-finite for level %d Te %g. bfcooling_coeff %g sfac %g "
+                "phixstargetindex %d phixstargetprobability %g\n",
+                level, T_e, bfcooling_coeff, sfac, phixstargetindex, phixstargetprobability);
+            bfcooling_coeff = 0;
           }
+          globals::bfcooling_coeff[get_bflutindex(iter, element, ion, level, phixstargetindex)] = bfcooling_coeff;
         }
       }
-      gsl_set_error_handler(previous_handler);
     }
+    gsl_set_error_handler(previous_handler);
   }
 }
 
@@ -640,7 +654,7 @@ double select_continuum_nu(int element, int lowerion, int lower, int upperionlev
 
   const gsl_function F_alpha_sp = {.function = &alpha_sp_E_integrand_gsl, .params = &intparas};
 
-  const double zrand = 1. - gsl_rng_uniform(rng);  // Make sure that 0 < zrand <= 1
+  const double zrand = 1. - rng_uniform();  // Make sure that 0 < zrand <= 1
 
   // printout("emitted bf photon Z=%2d ionstage %d->%d upper %4d lower %4d lambda %7.1f lambda_edge %7.1f ratio %g zrand
   // %g\n",
@@ -810,7 +824,7 @@ static void scale_level_phixs(const int element, const int ion, const int level,
 // also update the quantities integrated from (and proportional to) the cross sections
 {
   // if we store the cross sections in node shared memory, then only one rank should update it
-  if (globals::rank_in_node == 0) {
+  if (globals::rank_in_atomic_node == 0) {
     for (int n = 0; n < globals::NPHIXSPOINTS; n++) {
       globals::elements[element].ions[ion].levels[level].photoion_xs[n] *= factor;
     }
@@ -1008,16 +1022,23 @@ void ratecoefficients_init(void)
   assert_always(phixs_file_version >= 0);  // check that it has been changed from the default value of -1
   md5_file(phixsdata_filenames[phixs_file_version], phixsfile_hash);
 
-  /// Check if we need to calculate the ratecoefficients or if we were able to read them from file
-  if (!read_ratecoeff_dat()) {
-    precalculate_rate_coefficient_integrals();
-    /// And the master process writes them to file in a serial operation
-    if (globals::rank_global == 0) {
-      write_ratecoeff_dat();
+  // the tables are in node-shared memory, so one rank per node reads or calculates them and applies the recombination
+  // rate scaling (rank_in_atomic_node is zero without MPI)
+  if (globals::rank_in_atomic_node == 0) {
+    /// Check if we need to calculate the ratecoefficients or if we were able to read them from file
+    if (!read_ratecoeff_dat()) {
+      precalculate_rate_coefficient_integrals();
+      /// And the master process writes them to file in a serial operation
+      if (ensemble::is_shared_data_writer()) {
+        write_ratecoeff_dat();
+      }
     }
-  }
 
-  read_recombrate_file();
+    read_recombrate_file();
+  }
+#ifdef MPI_ON
+  MPI_Barrier(globals::mpi_comm_atomic_node);
+#endif
 
   precalculate_ion_alpha_sp();
 }
@@ -6,6 +6,8 @@
 
 #include "atomic.h"
 #include "boundary.h"
+#include "expansionopacity.h"
+#include "fastmath.h"
 #include "grey_emissivities.h"
 #include "grid.h"
 #include "kpkt.h"
@@ -64,6 +66,29 @@ __host__ __device__ int closest_transition(const double nu_cmf, const int next_t
   }
 }
 
+__host__ __device__ static double get_distance_to_nu_cmf(const struct packet *pkt_ptr, const double nu_trans)
+// distance from the current position until the comoving-frame frequency of the packet redshifts to nu_trans
+{
+  if (pkt_ptr->nu_cmf <= nu_trans) {
+    return 0.;  /// photon was propagated too far, make sure that we don't miss a line
+  } else if (!USE_RELATIVISTIC_DOPPLER_SHIFT) {
+    return CLIGHT * pkt_ptr->prop_time * (pkt_ptr->nu_cmf / nu_trans - 1);
+  } else {
+    // With special relativity, the Doppler shift formula has an extra factor of 1/gamma in it,
+    // which changes the distance reach a line resonance and creates a dependence
+    // on packet position and direction
+
+    // relativistic distance formula from tardis-sn project
+    // (committed by Christian Vogl, https://github.com/tardis-sn/tardis/pull/697)
+    const double nu_r = nu_trans / pkt_ptr->nu_rf;
+    const double ct = CLIGHT * pkt_ptr->prop_time;
+    const double r = vec_len(pkt_ptr->pos);  // radius
+    const double mu = dot(pkt_ptr->dir, pkt_ptr->pos) / r;
+    return -mu * r + (ct - nu_r * nu_r * sqrt(ct * ct - (1 + r * r * (1 - mu * mu) * (1 + pow(nu_r, -2))))) /
+                         (1 + nu_r * nu_r);
+  }
+}
+
 __host__ __device__ static double get_event(
     const int modelgridindex,
     struct packet *pkt_ptr,  // pointer to packet object
@@ -110,30 +135,7 @@ __host__ __device__ static double get_event(
       // multiple scattering events of one pp in a single line
       dummypkt_ptr->next_trans = lineindex + 1;
 
-      double ldist;  // distance from current position to the line interaction
-      if (dummypkt_ptr->nu_cmf <= nu_trans) {
-        // printout(
-        //     "[warning] packet %d dummypkt_ptr->nu_cmf %lg <= nu_trans %lg diff %lg next_trans %d, Z=%d ionstage %d
-        //     " "lower %d upper %d\n", pkt_ptr->number, dummypkt_ptr->nu_cmf, nu_trans, (dummypkt_ptr->nu_cmf -
-        //     nu_trans) / nu_trans, dummypkt_ptr->next_trans, get_element(element), get_ionstage(element, ion),
-        //     lower, upper);
-        ldist = 0;  /// photon was propagated too far, make sure that we don't miss a line
-      } else if (!USE_RELATIVISTIC_DOPPLER_SHIFT) {
-        ldist = CLIGHT * dummypkt_ptr->prop_time * (dummypkt_ptr->nu_cmf / nu_trans - 1);
-      } else {
-        // With special relativity, the Doppler shift formula has an extra factor of 1/gamma in it,
-        // which changes the distance reach a line resonance and creates a dependence
-        // on packet position and direction
-
-        // relativistic distance formula from tardis-sn project
-        // (committed by Christian Vogl, https://github.com/tardis-sn/tardis/pull/697)
-        const double nu_r = nu_trans / dummypkt_ptr->nu_rf;
-        const double ct = CLIGHT * dummypkt_ptr->prop_time;
-        const double r = vec_len(dummypkt_ptr->pos);  // radius
-        const double mu = dot(dummypkt_ptr->dir, dummypkt_ptr->pos) / r;
-        ldist = -mu * r + (ct - nu_r * nu_r * sqrt(ct * ct - (1 + r * r * (1 - mu * mu) * (1 + pow(nu_r, -2))))) /
-                              (1 + nu_r * nu_r);
-      }
+      double ldist = get_distance_to_nu_cmf(dummypkt_ptr, nu_trans);
 
       if (ldist < 0.) {
         printout("[warning] ldist %lg < 0.\n", ldist);
@@ -327,6 +329,57 @@ __host__ __device__ static double get_event(
   return edist;
 }
 
+__host__ __device__ static double get_event_expansionopacity(const int modelgridindex, struct packet *pkt_ptr,
+                                                              int *rpkt_eventtype, const double tau_rnd,
+                                                              const double abort_dist)
+// same as get_event(), but the lines are a continuous opacity within each frequency bin of the binned expansion
+// opacity (EXPANSION_OPACITY_BINNED), so the packet crosses the lines in bin steps
+{
+  struct packet dummypkt = *pkt_ptr;
+
+  calculate_kappa_rpkt_cont(pkt_ptr, &globals::kappa_rpkt_cont[tid]);
+  const double dopplerfactor = doppler_packet_nucmf_on_nurf(pkt_ptr);
+  const double kap_cont = globals::kappa_rpkt_cont[tid].total * dopplerfactor;
+
+  double tau = 0.;
+  double dist = 0.;
+  // the packet redshifts through the bins in order of decreasing frequency
+  for (int binindex = expansionopacity::get_bin(pkt_ptr->nu_cmf);; binindex--) {
+    const bool inbins = (binindex >= 0 && binindex < EXPANSION_OPACITY_NBINS);
+    const double kap_lines = inbins ? expansionopacity::get_kappa(modelgridindex, binindex) * dopplerfactor : 0.;
+    const double kap_tot = kap_cont + kap_lines;
+
+    // distance to the lower edge of the bin or the abort distance, whichever comes first
+    double stepdist = abort_dist - dist;
+    if (binindex >= 0) {
+      stepdist = std::min(stepdist, get_distance_to_nu_cmf(&dummypkt, expansionopacity::get_bin_nu_lower(binindex)));
+    }
+
+    if (tau_rnd - tau <= kap_tot * stepdist) {
+      const double eventdist = (tau_rnd - tau) / kap_tot;
+      if (rng_uniform() * kap_tot < kap_cont) {
+        *rpkt_eventtype = RPKT_EVENTTYPE_CONT;
+      } else {
+        const int lineindex = expansionopacity::select_line(modelgridindex, binindex);
+        pkt_ptr->mastate.element = globals::linelist[lineindex].elementindex;
+        pkt_ptr->mastate.ion = globals::linelist[lineindex].ionindex;
+        pkt_ptr->mastate.level = globals::linelist[lineindex].upperlevelindex;
+        pkt_ptr->mastate.activatingline = lineindex;
+        pkt_ptr->next_trans = lineindex + 1;
+        *rpkt_eventtype = RPKT_EVENTTYPE_BB;
+      }
+      return dist + eventdist;
+    }
+
+    tau += kap_tot * stepdist;
+    dist += stepdist;
+    if (dist >= abort_dist || binindex < 0) {
+      return std::numeric_limits<double>::max();
+    }
+    move_pkt_withtime(&dummypkt, stepdist);
+  }
+}
+
 __host__ __device__ static void rpkt_event_continuum(struct packet *pkt_ptr,
                                                      struct rpkt_cont_opacity kappa_rpkt_cont_thisthread,
                                                      int modelgridindex) {
@@ -340,7 +393,7 @@ __host__ __device__ static void rpkt_event_continuum(struct packet *pkt_ptr,
 
   /// continuum process happens. select due to its probabilities sigma/kappa_cont, kappa_ff/kappa_cont,
   /// kappa_bf/kappa_cont
-  const double zrand = gsl_rng_uniform(rng);
+  const double zrand = rng_uniform();
   // printout("[debug] rpkt_event:   r-pkt undergoes a continuum transition\n");
   // printout("[debug] rpkt_event:   zrand*kappa_cont %g, sigma %g, kappa_ff %g, kappa_bf %g\n", zrand * kappa_cont,
   // sigma, kappa_ff, kappa_bf);
@@ -391,7 +444,7 @@ __host__ __device__ static void rpkt_event_continuum(struct packet *pkt_ptr,
     assert_always(globals::phixslist[tid].kappa_bf_sum[globals::nbfcontinua - 1] == kappa_bf_inrest);
 
     /// Determine in which continuum the bf-absorption occurs
-    const double zrand2 = gsl_rng_uniform(rng);
+    const double zrand2 = rng_uniform();
     const double kappa_bf_rand = zrand2 * kappa_bf_inrest;
 
     double *upperval = std::lower_bound(&globals::phixslist[tid].kappa_bf_sum[0],
@@ -413,7 +466,7 @@ __host__ __device__ static void rpkt_event_continuum(struct packet *pkt_ptr,
     }
 
     /// and decide whether we go to ionisation energy
-    const double zrand3 = gsl_rng_uniform(rng);
+    const double zrand3 = rng_uniform();
     if (zrand3 < nu_edge / nu) {
       stats::increment(stats::COUNTER_MA_STAT_ACTIVATION_BF);
       pkt_ptr->interactions += 1;
@@ -640,8 +693,8 @@ __host__ __device__ static bool do_rpkt_step(struct packet *pkt_ptr, const doubl
 
   // Assign optical depth to next physical event. And start counter of
   // optical depth for this path.
-  const double zrand = gsl_rng_uniform_pos(rng);
-  const double tau_next = -1. * log(zrand);
+  const double zrand = rng_uniform_pos();
+  const double tau_next = -1. * fastmath::log(zrand);
 
   // Start by finding the distance to the crossing of the grid cell
   // boundaries. sdist is the boundary distance and snext is the
@@ -715,6 +768,8 @@ __host__ __device__ static bool do_rpkt_step(struct packet *pkt_ptr, const doubl
       edist = (tau_next - tau_current) / kappa;
       find_nextline = true;
       // printout("[debug] do_rpkt: propagating through grey cell, edist  %g\n",edist);
+    } else if constexpr (EXPANSION_OPACITY_BINNED) {
+      edist = get_event_expansionopacity(mgi, pkt_ptr, &rpkt_eventtype, tau_next, fmin(tdist, sdist));
     } else {
       // get distance to the next physical event (continuum or bound-bound)
       edist = get_event(mgi, pkt_ptr, &rpkt_eventtype, tau_next,
@@ -776,6 +831,10 @@ __host__ __device__ static bool do_rpkt_step(struct packet *pkt_ptr, const doubl
         rpkt_event_thickcell(pkt_ptr);
       } else if (rpkt_eventtype == RPKT_EVENTTYPE_BB) {
         rpkt_event_boundbound(pkt_ptr, mgi);
+        if (EXPANSION_OPACITY_BINNED && rng_uniform() < EXPANSION_OPACITY_THERMALISATION_PROB) {
+          // the absorbed energy goes to the thermal pool instead of the macroatom
+          pkt_ptr->type = TYPE_KPKT;
+        }
       } else if (rpkt_eventtype == RPKT_EVENTTYPE_CONT) {
         rpkt_event_continuum(pkt_ptr, globals::kappa_rpkt_cont[tid], mgi);
       } else {
@@ -920,7 +979,7 @@ __host__ __device__ static double get_rpkt_escapeprob_fromdirection(const double
   }
 
   const double tau_escape = *tot_tau_cont + *tot_tau_lines;
-  const double escape_prob = exp(-tau_escape);
+  const double escape_prob = fastmath::exp(-tau_escape);
   // printout("  tot_tau_lines %g tot_tau_cont %g escape_prob %g\n",
   //          tot_tau_lines, tot_tau_cont, escape_prob);
   return escape_prob;
@@ -1144,7 +1203,7 @@ __host__ __device__ double calculate_kappa_bf_gammacontr(const int modelgridinde
           globals::cellhistory[tid].ch_allcont_departureratios[i] = departure_ratio;
         }
 
-        const double stimfactor = departure_ratio * exp(-HOVERKB * nu / T_e);
+        const double stimfactor = departure_ratio * fastmath::exp(-HOVERKB * nu / T_e);
         double corrfactor = 1 - stimfactor;  // photoionisation minus stimulated recombination
         if (corrfactor < 0) {
           corrfactor = 0.;
@@ -14,17 +14,31 @@
 
 #include <getopt.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+
+#include <cctype>
 
 #include "atomic.h"
 #include "decay.h"
 #include "emissivities.h"
+#include "ensemble.h"
+#include "escapelog.h"
+#include "expansionopacity.h"
+#include "fastmath.h"
+#include "formalint.h"
+#include "gammadeposition.h"
 #include "globals.h"
 #include "grey_emissivities.h"
 #include "grid.h"
 #include "input.h"
+#include "kpkt.h"
 // #include "ltepop.h"
 #include "nltepop.h"
 #include "nonthermal.h"
+#include "packetcount.h"
 #include "radfield.h"
 #include "ratecoeff.h"
 #include "spectrum.h"
@@ -49,16 +63,76 @@ gsl_rng *rng = NULL;
 #else
 __device__ void *rng = NULL;
 #endif
+std::uint64_t rng_xoshiro_state[4];
 gsl_integration_workspace *gslworkspace = NULL;
 FILE *output_file = NULL;
 static FILE *linestat_file = NULL;
 static time_t real_time_start = -1;
 static time_t time_timestep_start = -1;  // this will be set after the first update of the grid and before packet prop
+static int nts_last_checkpoint = -1;     // timestep of the most recent restart data (gridsave and packets tmp files)
+static time_t time_last_checkpoint = -1;
 static FILE *estimators_file = NULL;
 
 int mpi_grid_buffer_size = 0;
 char *mpi_grid_buffer = NULL;
 
+static int get_numa_node_of_cpu(const int cpu)
+// read the NUMA node of a logical CPU from sysfs (Linux only), or return 0 if it is unknown
+{
+#ifdef __linux__
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    return 0;
+  }
+  int node = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4])) {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#else
+  return 0;
+#endif
+}
+
+static void pin_thread_to_core(void)
+// bind the calling OpenMP thread to the tid-th CPU of the CPU set that this process was started with (e.g., by the
+// MPI launcher), so that first-touched memory stays local to the thread
+{
+#ifdef __linux__
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  assert_always(sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0);
+  const int ncpus = CPU_COUNT(&cpuset);
+  int cpucount = 0;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpuset)) {
+      if (cpucount == tid % ncpus) {
+        cpu_set_t threadcpuset;
+        CPU_ZERO(&threadcpuset);
+        CPU_SET(cpu, &threadcpuset);
+        assert_always(sched_setaffinity(0, sizeof(threadcpuset), &threadcpuset) == 0);
+        printout("NUMA: thread %d pinned to CPU %d (NUMA node %d) of %d available\n", tid, cpu,
+                 get_numa_node_of_cpu(cpu), ncpus);
+        break;
+      }
+      cpucount++;
+    }
+  }
+  if (tid >= ncpus) {
+    printout("NUMA: WARNING: %d OpenMP threads share %d CPUs\n", get_num_threads(), ncpus);
+  }
+#else
+  printout("NUMA: thread pinning is only available on Linux\n");
+#endif
+}
+
 static void initialise_linestat_file(void) {
   linestat_file = fopen_required("linestat.out", "w");
 
@@ -134,18 +208,21 @@ static void write_deposition_file(const int nts, const int my_rank, const int ns
 
 #ifdef MPI_ON
     // in MPI mode, each process only did some fraction of the cells
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_positron_ana_power, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_electron_ana_power, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_alpha_ana_power, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_betaminus, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_alpha, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_positron_ana_power, 1, MPI_DOUBLE, MPI_SUM,
+                  globals::mpi_comm_model);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_electron_ana_power, 1, MPI_DOUBLE, MPI_SUM,
+                  globals::mpi_comm_model);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].eps_alpha_ana_power, 1, MPI_DOUBLE, MPI_SUM,
+                  globals::mpi_comm_model);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_betaminus, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_alpha, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+    MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[i].qdot_total, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 #endif
   }
 
 #ifdef MPI_ON
-  MPI_Allreduce(MPI_IN_PLACE, &mtot, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &mtot, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   if (my_rank == 0) {
@@ -193,19 +270,22 @@ static void mpi_communicate_grid_properties(const int my_rank, const int nprocs,
                                             const int mpi_grid_buffer_size) {
   int position = 0;
   for (int root = 0; root < nprocs; root++) {
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_model);
     int root_nstart = nstart;
-    MPI_Bcast(&root_nstart, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&root_nstart, 1, MPI_INT, root, globals::mpi_comm_model);
     int root_ndo = ndo;
-    MPI_Bcast(&root_ndo, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&root_ndo, 1, MPI_INT, root, globals::mpi_comm_model);
     int root_node_id = globals::node_id;
-    MPI_Bcast(&root_node_id, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&root_node_id, 1, MPI_INT, root, globals::mpi_comm_model);
 
     for (int modelgridindex = root_nstart; modelgridindex < (root_nstart + root_ndo); modelgridindex++) {
       radfield::do_MPI_Bcast(modelgridindex, root, root_node_id);
 
       if (grid::get_numassociatedcells(modelgridindex) > 0) {
         nonthermal::nt_MPI_Bcast(modelgridindex, root);
+        if constexpr (EXPANSION_OPACITY_BINNED) {
+          expansionopacity::do_MPI_Bcast(modelgridindex, root_node_id);
+        }
         if (NLTE_POPS_ON && globals::rank_in_node == 0) {
           MPI_Bcast(grid::modelgrid[modelgridindex].nlte_pops, globals::total_nlte_levels, MPI_DOUBLE, root_node_id,
                     globals::mpi_comm_internode);
@@ -214,49 +294,49 @@ static void mpi_communicate_grid_properties(const int my_rank, const int nprocs,
 #if (!NO_LUT_PHOTOION)
         assert_always(globals::corrphotoionrenorm != NULL);
         MPI_Bcast(&globals::corrphotoionrenorm[modelgridindex * get_nelements() * get_max_nions()],
-                  get_nelements() * get_max_nions(), MPI_DOUBLE, root, MPI_COMM_WORLD);
+                  get_nelements() * get_max_nions(), MPI_DOUBLE, root, globals::mpi_comm_model);
         assert_always(globals::gammaestimator != NULL);
         MPI_Bcast(&globals::gammaestimator[modelgridindex * get_nelements() * get_max_nions()],
-                  get_nelements() * get_max_nions(), MPI_DOUBLE, root, MPI_COMM_WORLD);
+                  get_nelements() * get_max_nions(), MPI_DOUBLE, root, globals::mpi_comm_model);
 #endif
       }
     }
 
     if (root == my_rank) {
       position = 0;
-      MPI_Pack(&ndo, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
+      MPI_Pack(&ndo, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, globals::mpi_comm_model);
       for (int mgi = nstart; mgi < (nstart + ndo); mgi++) {
-        MPI_Pack(&mgi, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
+        MPI_Pack(&mgi, 1, MPI_INT, mpi_grid_buffer, mpi_grid_buffer_size, &position, globals::mpi_comm_model);
 
         if (grid::get_numassociatedcells(mgi) > 0) {
           MPI_Pack(&grid::modelgrid[mgi].Te, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].TR, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].TJ, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].W, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].rho, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].nne, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].nnetot, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].kappagrey, 1, MPI_FLOAT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].totalcooling, 1, MPI_DOUBLE, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
           MPI_Pack(&grid::modelgrid[mgi].thick, 1, MPI_SHORT, mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
 
           for (int element = 0; element < get_nelements(); element++) {
             MPI_Pack(grid::modelgrid[mgi].composition[element].groundlevelpop, get_nions(element), MPI_FLOAT,
-                     mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
+                     mpi_grid_buffer, mpi_grid_buffer_size, &position, globals::mpi_comm_model);
             MPI_Pack(grid::modelgrid[mgi].composition[element].partfunct, get_nions(element), MPI_FLOAT,
-                     mpi_grid_buffer, mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
+                     mpi_grid_buffer, mpi_grid_buffer_size, &position, globals::mpi_comm_model);
             MPI_Pack(grid::modelgrid[mgi].cooling_contrib_ion[element], get_nions(element), MPI_DOUBLE, mpi_grid_buffer,
-                     mpi_grid_buffer_size, &position, MPI_COMM_WORLD);
+                     mpi_grid_buffer_size, &position, globals::mpi_comm_model);
           }
         }
       }
@@ -264,108 +344,112 @@ static void mpi_communicate_grid_properties(const int my_rank, const int nprocs,
                mpi_grid_buffer_size);
       assert_always(position <= mpi_grid_buffer_size);
     }
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Bcast(mpi_grid_buffer, mpi_grid_buffer_size, MPI_PACKED, root, MPI_COMM_WORLD);
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_model);
+    MPI_Bcast(mpi_grid_buffer, mpi_grid_buffer_size, MPI_PACKED, root, globals::mpi_comm_model);
+    MPI_Barrier(globals::mpi_comm_model);
 
     position = 0;
     int nlp;
-    MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &nlp, 1, MPI_INT, MPI_COMM_WORLD);
+    MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &nlp, 1, MPI_INT, globals::mpi_comm_model);
     for (int nn = 0; nn < nlp; nn++) {
       int mgi;
-      MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &mgi, 1, MPI_INT, MPI_COMM_WORLD);
+      MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &mgi, 1, MPI_INT, globals::mpi_comm_model);
 
       if (grid::get_numassociatedcells(mgi) > 0) {
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].Te, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].TR, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].TJ, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].W, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].rho, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].nne, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].nnetot, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].kappagrey, 1, MPI_FLOAT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].totalcooling, 1, MPI_DOUBLE,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
         MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position, &grid::modelgrid[mgi].thick, 1, MPI_SHORT,
-                   MPI_COMM_WORLD);
+                   globals::mpi_comm_model);
 
         for (int element = 0; element < get_nelements(); element++) {
           MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
                      grid::modelgrid[mgi].composition[element].groundlevelpop, get_nions(element), MPI_FLOAT,
-                     MPI_COMM_WORLD);
+                     globals::mpi_comm_model);
           MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
                      grid::modelgrid[mgi].composition[element].partfunct, get_nions(element), MPI_FLOAT,
-                     MPI_COMM_WORLD);
+                     globals::mpi_comm_model);
           MPI_Unpack(mpi_grid_buffer, mpi_grid_buffer_size, &position,
-                     grid::modelgrid[mgi].cooling_contrib_ion[element], get_nions(element), MPI_DOUBLE, MPI_COMM_WORLD);
+                     grid::modelgrid[mgi].cooling_contrib_ion[element], get_nions(element), MPI_DOUBLE,
+                     globals::mpi_comm_model);
         }
       }
     }
   }
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 }
 
 static void mpi_reduce_estimators(int my_rank, int nts) {
   radfield::reduce_estimators();
 #ifndef FORCE_LTE
-  MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, globals::ffheatingestimator, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, globals::ffheatingestimator, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM,
+                globals::mpi_comm_model);
   MPI_Allreduce(MPI_IN_PLACE, globals::colheatingestimator, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM,
-                MPI_COMM_WORLD);
-  MPI_Barrier(MPI_COMM_WORLD);
+                globals::mpi_comm_model);
+  MPI_Barrier(globals::mpi_comm_model);
 #if (!NO_LUT_PHOTOION) || (!NO_LUT_BFHEATING)
   const int arraylen = grid::get_npts_model() * get_nelements() * get_max_nions();
 #endif
 #if (!NO_LUT_PHOTOION)
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   assert_always(globals::gammaestimator != NULL);
-  MPI_Allreduce(MPI_IN_PLACE, globals::gammaestimator, arraylen, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, globals::gammaestimator, arraylen, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 #endif
 #if (!NO_LUT_BFHEATING)
-  MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, globals::bfheatingestimator, arraylen, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, globals::bfheatingestimator, arraylen, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 #endif
 #endif
 
 #ifdef RECORD_LINESTAT
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   assert_always(globals::ecounter != NULL);
-  MPI_Allreduce(MPI_IN_PLACE, globals::ecounter, globals::nlines, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, globals::ecounter, globals::nlines, MPI_INT, MPI_SUM, globals::mpi_comm_model);
   assert_always(globals::acounter != NULL);
-  MPI_Allreduce(MPI_IN_PLACE, globals::acounter, globals::nlines, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, globals::acounter, globals::nlines, MPI_INT, MPI_SUM, globals::mpi_comm_model);
 #endif
 
   // double deltaV = pow(grid::wid_init * globals::time_step[nts].mid/globals::tmin, 3.0);
   // double deltat = globals::time_step[nts].width;
   if (globals::do_rlc_est != 0) {
     assert_always(globals::rpkt_emiss != NULL);
-    MPI_Allreduce(MPI_IN_PLACE, globals::rpkt_emiss, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, globals::rpkt_emiss, grid::get_npts_model(), MPI_DOUBLE, MPI_SUM,
+                  globals::mpi_comm_model);
   }
   if (globals::do_comp_est) {
     assert_always(globals::compton_emiss != NULL);
     MPI_Allreduce(MPI_IN_PLACE, globals::compton_emiss, grid::get_npts_model() * EMISS_MAX, MPI_FLOAT, MPI_SUM,
-                  MPI_COMM_WORLD);
+                  globals::mpi_comm_model);
   }
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 
   /// Communicate gamma and positron deposition and write to file
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].cmf_lum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].gamma_dep, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].positron_dep, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].electron_dep, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].electron_emission, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].alpha_dep, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].alpha_emission, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].gamma_emission, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].cmf_lum, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].gamma_dep, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].positron_dep, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].electron_dep, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].electron_emission, 1, MPI_DOUBLE, MPI_SUM,
+                globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].alpha_dep, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].alpha_emission, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
+  MPI_Allreduce(MPI_IN_PLACE, &globals::time_step[nts].gamma_emission, 1, MPI_DOUBLE, MPI_SUM, globals::mpi_comm_model);
 
   globals::time_step[nts].cmf_lum /= globals::nprocs;
   globals::time_step[nts].gamma_dep /= globals::nprocs;
@@ -380,7 +464,7 @@ static void mpi_reduce_estimators(int my_rank, int nts) {
   stats::reduce_estimators();
 #endif
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 }
 #endif
 
@@ -419,7 +503,7 @@ static void remove_grid_restart_data(const int timestep) {
 
 static bool walltime_sufficient_to_continue(const int nts, const int nts_prev, const int walltimelimitseconds) {
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   // time is measured from just before packet propagation from one timestep to the next
@@ -438,7 +522,7 @@ static bool walltime_sufficient_to_continue(const int nts, const int nts_prev, c
 
 #ifdef MPI_ON
     // communicate whatever decision the rank 0 process decided, just in case they differ
-    MPI_Bcast(&do_this_full_loop, 1, MPI_C_BOOL, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&do_this_full_loop, 1, MPI_C_BOOL, 0, globals::mpi_comm_model);
 #endif
     if (do_this_full_loop)
       printout("TIMED_RESTARTS: Going to continue since remaining time %d s >= 1.5 * time_per_timestep\n",
@@ -501,14 +585,45 @@ static void save_grid_and_packets(const int nts, const int my_rank, struct packe
   if (!KEEP_ALL_RESTART_FILES) {
 // ensure new packets files have been written by all processes before we remove the old set
 #ifdef MPI_ON
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_model);
 #endif
 
-    if (my_rank == 0) remove_grid_restart_data(nts - 1);
+    if (my_rank == 0) remove_grid_restart_data(nts_last_checkpoint);
 
-    // delete temp packets files from previous timestep now that all restart data for the new timestep is available
-    remove_temp_packetsfile(nts - 1, my_rank);
+    // delete temp packets files from previous checkpoint now that all restart data for the new timestep is available
+    remove_temp_packetsfile(nts_last_checkpoint, my_rank);
   }
+
+  nts_last_checkpoint = nts;
+  time_last_checkpoint = time(NULL);
+}
+
+static bool checkpoint_due(const int nts, const bool do_this_full_loop)
+// decide whether to write restart data at the start of timestep nts, according to CHECKPOINT_INTERVAL_TIMESTEPS and
+// CHECKPOINT_INTERVAL_SECONDS. Restart data is always written before stopping early and at the last timestep of
+// this job, and on every timestep if that timestep's packets file is needed again for another iteration.
+{
+  if (!do_this_full_loop || nts == globals::ftstep - 1 || globals::n_titer > 1) {
+    return true;
+  }
+#ifdef VPKT_ON
+  // the virtual packet restart files alternate between even and odd timesteps
+  return true;
+#else
+  bool due = (nts - nts_last_checkpoint) >= CHECKPOINT_INTERVAL_TIMESTEPS;
+  if (CHECKPOINT_INTERVAL_SECONDS > 0 && (time(NULL) - time_last_checkpoint) >= CHECKPOINT_INTERVAL_SECONDS) {
+    due = true;
+  }
+
+#ifdef MPI_ON
+  // the wall time can differ between ranks, so use the decision of rank 0
+  MPI_Bcast(&due, 1, MPI_C_BOOL, 0, globals::mpi_comm_model);
+#endif
+  if (!due) {
+    printout("timestep %d: skipping restart data (last written at timestep %d)\n", nts, nts_last_checkpoint);
+  }
+  return due;
+#endif
 }
 
 static bool do_timestep(const int nts, const int titer, const int my_rank, const int nstart, const int ndo,
@@ -538,6 +653,11 @@ static bool do_timestep(const int nts, const int titer, const int my_rank, const
 
   globals::do_comp_est = globals::do_r_lc ? false : estim_switch(nts);
 
+  // the deposition rates in update_grid need the gamma-ray deposition of this timestep
+  if constexpr (GAMMA_DEPOSITION_RAYTRACE) {
+    gammadeposition::calculate(my_rank, nts);
+  }
+
   // Update the matter quantities in the grid for the new timestep.
 
   update_grid(estimators_file, nts, nts_prev, my_rank, nstart, ndo, titer, real_time_start);
@@ -555,19 +675,29 @@ static bool do_timestep(const int nts, const int titer, const int my_rank, const
 
   /// If this is not the 0th time step of the current job step,
   /// write out a snapshot of the grid properties for further restarts
-  /// and update input.txt accordingly
+  /// and update input.txt accordingly (if a checkpoint is due)
   if (((nts - globals::itstep) != 0)) {
-    save_grid_and_packets(nts, my_rank, packets);
     do_this_full_loop = walltime_sufficient_to_continue(nts, nts_prev, walltimelimitseconds);
+    if (checkpoint_due(nts, do_this_full_loop)) {
+      save_grid_and_packets(nts, my_rank, packets);
+    }
   }
   time_timestep_start = time(NULL);
 
+  // uses the radiation field contribution counts of the last timestep, so this goes before the bins are adapted
+  if constexpr (ADAPTIVE_PACKET_COUNT) {
+    packetcount::adjust_packets(nts, packets);
+  }
+
+  // the estimators were saved with the old bins, and the new bins are used from this timestep's packets onwards
+  radfield::adapt_bin_boundaries(nts);
+
   // set all the estimators to zero before moving packets. This is now done
   // after update_grid so that, if requires, the gamma-ray heating estimator is known there
   // and also the photoion and stimrecomb estimators
   zero_estimators();
 
-  // MPI_Barrier(MPI_COMM_WORLD);
+  // MPI_Barrier(globals::mpi_comm_model);
   if ((nts < globals::ftstep) && do_this_full_loop) {
     /// Now process the packets.
 
@@ -602,6 +732,10 @@ static bool do_timestep(const int nts, const int titer, const int my_rank, const
 
     write_partial_lightcurve_spectra(my_rank, nts, packets);
 
+    if constexpr (FORMAL_INTEGRAL) {
+      formalint::write_spectrum(my_rank, nts);
+    }
+
 #ifdef MPI_ON
     printout("timestep %d: time after estimators have been communicated %ld (took %ld seconds)\n", nts, time(NULL),
              time(NULL) - time_communicate_estimators_start);
@@ -711,20 +845,41 @@ int main(int argc, char **argv)
 
 #ifdef MPI_ON
   MPI_Init(&argc, &argv);
-  MPI_Comm_rank(MPI_COMM_WORLD, &globals::rank_global);
-  MPI_Comm_size(MPI_COMM_WORLD, &globals::nprocs);
+  int rank_world = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank_world);
+
+  // make an intra-node communicator (group ranks that can share memory). In ensemble mode, the ranks of all models on
+  // the node share the atomic data
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank_world, MPI_INFO_NULL, &globals::mpi_comm_atomic_node);
+#ifdef __linux__
+  if constexpr (NUMA_AWARE_MEMORY) {
+    // treat each NUMA domain as a node, so that the shared read-mostly data (atomic data, grid, and radiation field
+    // solutions) is replicated per NUMA domain. This requires the ranks to be bound to CPUs by the launcher
+    MPI_Comm mpi_comm_sharedmem = globals::mpi_comm_atomic_node;
+    MPI_Comm_split(mpi_comm_sharedmem, get_numa_node_of_cpu(sched_getcpu()), rank_world,
+                   &globals::mpi_comm_atomic_node);
+    MPI_Comm_free(&mpi_comm_sharedmem);
+  }
+#endif
+  MPI_Comm_rank(globals::mpi_comm_atomic_node, &globals::rank_in_atomic_node);
+  MPI_Comm_size(globals::mpi_comm_atomic_node, &globals::atomic_node_nprocs);
 
-  // make an intra-node communicator (group ranks that can share memory)
-  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, globals::rank_global, MPI_INFO_NULL,
-                      &globals::mpi_comm_node);
+  // in ensemble mode, split the ranks into one communicator per model and change to the model directory
+  ensemble::init(argc, argv);
+  MPI_Comm_rank(globals::mpi_comm_model, &globals::rank_global);
+  MPI_Comm_size(globals::mpi_comm_model, &globals::nprocs);
+
+  // the ranks of this model on this node share the grid and radiation field data
+  MPI_Comm_split(globals::mpi_comm_atomic_node, ensemble::get_model_index(), globals::rank_global,
+                 &globals::mpi_comm_node);
   // get the local rank within this node
   MPI_Comm_rank(globals::mpi_comm_node, &globals::rank_in_node);
   // get the number of ranks on the node
   MPI_Comm_size(globals::mpi_comm_node, &globals::node_nprocs);
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 
   // make an inter-node communicator (using local rank as the key for group membership)
-  MPI_Comm_split(MPI_COMM_WORLD, globals::rank_in_node, globals::rank_global, &globals::mpi_comm_internode);
+  MPI_Comm_split(globals::mpi_comm_model, globals::rank_in_node, globals::rank_global, &globals::mpi_comm_internode);
 
   // take the node id from the local rank 0 (node master) and broadcast it
   if (globals::rank_in_node == 0) {
@@ -736,10 +891,13 @@ int main(int argc, char **argv)
   MPI_Bcast(&globals::node_count, 1, MPI_INT, 0, globals::mpi_comm_node);
 
 #else
+  ensemble::init(argc, argv);
   globals::rank_global = 0;
   globals::nprocs = 1;
   globals::rank_in_node = 0;
   globals::node_nprocs = 1;
+  globals::rank_in_atomic_node = 0;
+  globals::atomic_node_nprocs = 1;
   globals::node_id = 0;
   globals::node_count = 0;
 #endif
@@ -770,6 +928,10 @@ int main(int argc, char **argv)
     printout("OpenMP is not available in this build\n");
 #endif
 
+    if constexpr (NUMA_AWARE_MEMORY) {
+      pin_thread_to_core();
+    }
+
     gslworkspace = gsl_integration_workspace_alloc(GSLWSIZE);
   }
 
@@ -783,7 +945,7 @@ int main(int argc, char **argv)
 #endif
 
   int opt;
-  while ((opt = getopt(argc, argv, "w:")) != -1) {
+  while ((opt = getopt(argc, argv, "w:e:")) != -1) {
     switch (opt) {
       case 'w': {
         printout("Command line argument specifies wall time hours '%s', setting ", optarg);
@@ -793,6 +955,13 @@ int main(int argc, char **argv)
         break;
       }
 
+      case 'e': {
+        // the ensemble file has already been read by ensemble::init()
+        printout("Ensemble mode: running model %d of ensemble file '%s' in this directory\n",
+                 ensemble::get_model_index(), optarg);
+        break;
+      }
+
         // case 'p':
         //   printout("Command line argument specifies number of packets '%s', setting ", optarg);
         //   npkts = (int) strtol(optarg, NULL, 10);
@@ -800,7 +969,7 @@ int main(int argc, char **argv)
         //   break;
 
       default: {
-        fprintf(stderr, "Usage: %s [-w WALLTIMELIMITHOURS]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-w WALLTIMELIMITHOURS] [-e ENSEMBLEFILE]\n", argv[0]);
         exit(EXIT_FAILURE);
       }
     }
@@ -838,7 +1007,8 @@ int main(int argc, char **argv)
 #ifdef MPI_ON
   printout("process id (pid): %d\n", getpid());
   printout("MPI enabled:\n");
-  printout("  rank %d of [0..%d] in MPI_COMM_WORLD\n", globals::rank_global, globals::nprocs - 1);
+  printout("  rank %d of [0..%d] in MPI_COMM_WORLD (or this model's ensemble group)\n", globals::rank_global,
+           globals::nprocs - 1);
   printout("  node %d of [0..%d]\n", globals::node_id, globals::node_count - 1);
   printout("  rank %d of [0..%d] within this node (MPI_COMM_WORLD_SHARED)\n", globals::rank_in_node,
            globals::node_nprocs - 1);
@@ -889,6 +1059,12 @@ int main(int argc, char **argv)
 
   input(my_rank);
 
+#if defined TESTMODE && TESTMODE
+  if constexpr (USE_FAST_TRANSPORT_MATH) {
+    fastmath::check_accuracy();
+  }
+#endif
+
 #ifdef RECORD_LINESTAT
   if (my_rank == 0) {
     initialise_linestat_file();
@@ -904,12 +1080,16 @@ int main(int argc, char **argv)
   /// T_e = T_R for this precalculation.
   /// Make this parallel ?
   printout("time before tabulation of rate coefficients %ld\n", time(NULL));
+  ensemble::enter_shared_data_dir();
   ratecoefficients_init();
+  ensemble::leave_shared_data_dir();
+  kpkt::setup_factorised_cooling();
   printout("time after tabulation of rate coefficients %ld\n", time(NULL));
+  setup_stage_done("rate coefficients");
   //  abort();
 #ifdef MPI_ON
   printout("barrier after tabulation of rate coefficients: time before barrier %ld, ", time(NULL));
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   printout("time after barrier %ld\n", time(NULL));
 #endif
 
@@ -933,6 +1113,8 @@ int main(int argc, char **argv)
   }
   printout("time grid_init %ld\n", time(NULL));
   grid::grid_init(my_rank);
+  setup_stage_done("grid init");
+  print_setup_stage_summary();
 
   printout("Simulation propagates %g packets per process (total %g with nprocs %d)\n", 1. * globals::npkts,
            1. * globals::npkts * globals::nprocs, globals::nprocs);
@@ -964,7 +1146,7 @@ int main(int argc, char **argv)
   }
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   int maxndo = grid::get_maxndo();
   /// Initialise the exchange buffer
   /// The factor 4 comes from the fact that our buffer should contain elements of 4 byte
@@ -977,7 +1159,7 @@ int main(int argc, char **argv)
     printout("[fatal] input: not enough memory to initialize MPI grid buffer ... abort.\n");
     abort();
   }
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   /** That's the end of the initialisation. */
@@ -994,8 +1176,13 @@ int main(int argc, char **argv)
   /// Now use while loop to allow for timed restarts
   const int last_loop = globals::ftstep;
   int nts = globals::itstep;
+  nts_last_checkpoint = globals::itstep;
+  time_last_checkpoint = time(NULL);
 
   macroatom_open_file(my_rank);
+  if constexpr (ESCAPED_PACKET_LOG) {
+    escapelog::init(my_rank);
+  }
   if (ndo > 0) {
     assert_always(estimators_file == NULL);
     snprintf(filename, 128, "estimators_%.4d.out", my_rank);
@@ -1038,7 +1225,7 @@ int main(int argc, char **argv)
     globals::nts_global = nts;
 #ifdef MPI_ON
     //        const time_t time_before_barrier = time(NULL);
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Barrier(globals::mpi_comm_model);
     //        const time_t time_after_barrier = time(NULL);
     //        printout("timestep %d: time before barrier %d, time after barrier %d\n", nts, time_before_barrier,
     //        time_after_barrier);
@@ -1085,7 +1272,7 @@ int main(int argc, char **argv)
   /// code.
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   free(mpi_grid_buffer);
 #endif
 
@@ -1106,7 +1293,7 @@ int main(int argc, char **argv)
   }
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   printout("simulation finished at %ld\n", time(NULL));
@@ -1119,6 +1306,9 @@ int main(int argc, char **argv)
   }
 
   macroatom_close_file();
+  if constexpr (ESCAPED_PACKET_LOG) {
+    escapelog::close_file();
+  }
   if (NLTE_POPS_ON) nltepop_close_file();
 
   radfield::close_file();
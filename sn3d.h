@@ -3,6 +3,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
@@ -137,13 +138,89 @@ extern gsl_rng *rng;  // pointer for random number generator
 #else
 extern __device__ void *rng;
 #endif
+extern std::uint64_t rng_xoshiro_state[4];  // state of the inline xoshiro256++ generator (if USE_XOSHIRO_RNG)
 extern gsl_integration_workspace *gslworkspace;
 extern __managed__ int myGpuId;
 
 #ifdef _OPENMP
-#pragma omp threadprivate(tid, myGpuId, use_cellhist, neutral_flag, rng, gslworkspace, output_file)
+#pragma omp threadprivate(tid, myGpuId, use_cellhist, neutral_flag, rng, rng_xoshiro_state, gslworkspace, output_file)
 #endif
 
+// xoshiro256++ by Blackman & Vigna (2019), https://prng.di.unimi.it/xoshiro256plusplus.c
+// the state is passed explicitly so that the same code can be used for benchmarking on a copy of the state
+__host__ __device__ constexpr std::uint64_t rng_xoshiro_rotl(const std::uint64_t x, const int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+__host__ __device__ inline std::uint64_t rng_xoshiro_next(std::uint64_t s[4]) {
+  const std::uint64_t result = rng_xoshiro_rotl(s[0] + s[3], 23) + s[0];
+  const std::uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+
+  s[2] ^= t;
+  s[3] = rng_xoshiro_rotl(s[3], 45);
+
+  return result;
+}
+
+// fill the xoshiro state from a single seed with splitmix64, as recommended by the xoshiro authors
+inline void rng_xoshiro_seed(std::uint64_t s[4], const std::uint64_t seed) {
+  std::uint64_t z = seed;
+  for (int i = 0; i < 4; i++) {
+    z += 0x9e3779b97f4a7c15;
+    std::uint64_t x = z;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    s[i] = x ^ (x >> 31);
+  }
+}
+
+// uniform random number in [0, 1)
+__host__ __device__ inline double rng_uniform(void) {
+#ifndef __CUDA_ARCH__
+  if constexpr (USE_XOSHIRO_RNG) {
+    return static_cast<double>(rng_xoshiro_next(rng_xoshiro_state) >> 11) * 0x1.0p-53;
+  }
+#endif
+  return gsl_rng_uniform(rng);
+}
+
+// uniform random number in (0, 1)
+__host__ __device__ inline double rng_uniform_pos(void) {
+#ifndef __CUDA_ARCH__
+  if constexpr (USE_XOSHIRO_RNG) {
+    // use 52 bits and offset by half a step, so that zero can never be returned without any rejection loop
+    return (static_cast<double>(rng_xoshiro_next(rng_xoshiro_state) >> 12) + 0.5) * 0x1.0p-52;
+  }
+#endif
+  return gsl_rng_uniform_pos(rng);
+}
+
+// fill an array with uniform random numbers in [0, 1) for block draws.
+// The sequence is identical to calling rng_uniform() count times.
+__host__ __device__ inline void rng_uniform_fill(double *const zrands, const int count) {
+#ifndef __CUDA_ARCH__
+  if constexpr (USE_XOSHIRO_RNG) {
+    // copy the state to the stack, so that the compiler can keep it in registers for the whole block
+    std::uint64_t s[4] = {rng_xoshiro_state[0], rng_xoshiro_state[1], rng_xoshiro_state[2], rng_xoshiro_state[3]};
+    for (int i = 0; i < count; i++) {
+      zrands[i] = static_cast<double>(rng_xoshiro_next(s) >> 11) * 0x1.0p-53;
+    }
+    for (int i = 0; i < 4; i++) {
+      rng_xoshiro_state[i] = s[i];
+    }
+    return;
+  }
+#endif
+  for (int i = 0; i < count; i++) {
+    zrands[i] = gsl_rng_uniform(rng);
+  }
+}
+
 #include "globals.h"
 #include "vectors.h"
 
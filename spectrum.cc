@@ -1,9 +1,11 @@
 #include "spectrum.h"
 
+#include <cstring>
 #include <ctime>
 
 #include "atomic.h"
 #include "exspec.h"
+#include "fastmath.h"
 #include "light_curve.h"
 #include "sn3d.h"
 #include "vectors.h"
@@ -30,6 +32,19 @@ double traceemission_totalenergy = 0.;
 double traceabsorption_totalenergy = 0.;
 
 static struct spec *rpkt_spectra = NULL;
+static struct spec *rpkt_stokes_i = NULL;
+static struct spec *rpkt_stokes_q = NULL;
+static struct spec *rpkt_stokes_u = NULL;
+
+// with ESCAPED_PACKET_LOG, running totals on this rank of the packets that have escaped so far
+static struct spec *escaped_rpkt_spectra = NULL;
+static struct spec *escaped_stokes_i = NULL;
+static struct spec *escaped_stokes_q = NULL;
+static struct spec *escaped_stokes_u = NULL;
+static double *escaped_rpkt_light_curve_lum = NULL;
+static double *escaped_rpkt_light_curve_lumcmf = NULL;
+static double *escaped_gamma_light_curve_lum = NULL;
+static double *escaped_gamma_light_curve_lumcmf = NULL;
 
 static int compare_emission(const void *p1, const void *p2) {
   const struct emissionabsorptioncontrib *elem1 = (struct emissionabsorptioncontrib *)p1;
@@ -351,9 +366,9 @@ static void add_to_spec(const struct packet *const pkt_ptr, const int current_ab
     const int nt = get_timestep(t_arrive);
     const double nu_min = spectra->nu_min;
     const double nu_max = spectra->nu_max;
-    const double dlognu = (log(nu_max) - log(nu_min)) / globals::nnubins;
+    const double dlognu = (fastmath::log(nu_max) - fastmath::log(nu_min)) / globals::nnubins;
 
-    const int nnu = (log(pkt_ptr->nu_rf) - log(nu_min)) / dlognu;
+    const int nnu = (fastmath::log(pkt_ptr->nu_rf) - fastmath::log(nu_min)) / dlognu;
     assert_always(nnu < globals::nnubins);
 
     const double deltaE = pkt_ptr->e_rf / globals::time_step[nt].width / spectra->delta_freq[nnu] / 4.e12 / PI /
@@ -407,7 +422,7 @@ static void add_to_spec(const struct packet *const pkt_ptr, const int current_ab
         }
       }
 
-      const int nnu_abs = (log(pkt_ptr->absorptionfreq) - log(nu_min)) / dlognu;
+      const int nnu_abs = (fastmath::log(pkt_ptr->absorptionfreq) - fastmath::log(nu_min)) / dlognu;
       if (nnu_abs >= 0 && nnu_abs < globals::nnubins) {
         const int ioncount = get_nelements() * get_max_nions();
         const double deltaE_absorption = pkt_ptr->e_rf / globals::time_step[nt].width / spectra->delta_freq[nnu_abs] /
@@ -623,21 +638,128 @@ void add_to_spec_res(const struct packet *const pkt_ptr, int current_abin, struc
 static void mpi_reduce_spectra(int my_rank, struct spec *spectra, int numtimesteps) {
   for (int n = 0; n < numtimesteps; n++) {
     MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : spectra->timesteps[n].flux, spectra->timesteps[n].flux, globals::nnubins,
-               MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+               MPI_DOUBLE, MPI_SUM, 0, globals::mpi_comm_model);
 
     if (spectra->do_emission_res) {
       const int proccount = get_proccount();
       MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : spectra->timesteps[n].absorption, spectra->timesteps[n].absorption,
-                 globals::nnubins * get_nelements() * get_max_nions(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+                 globals::nnubins * get_nelements() * get_max_nions(), MPI_DOUBLE, MPI_SUM, 0, globals::mpi_comm_model);
       MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : spectra->timesteps[n].emission, spectra->timesteps[n].emission,
-                 globals::nnubins * proccount, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+                 globals::nnubins * proccount, MPI_DOUBLE, MPI_SUM, 0, globals::mpi_comm_model);
       MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : spectra->timesteps[n].trueemission, spectra->timesteps[n].trueemission,
-                 globals::nnubins * proccount, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+                 globals::nnubins * proccount, MPI_DOUBLE, MPI_SUM, 0, globals::mpi_comm_model);
     }
   }
 }
 #endif
 
+void add_to_partial_lightcurve_spectra(const struct packet *pkts, const int npkts)
+// add any escaped packets among pkts[0..npkts-1] to the running totals for the partial light curves and spectra
+{
+  assert_always(ESCAPED_PACKET_LOG);
+  TRACE_EMISSION_ABSORPTION_REGION_ON = false;
+  globals::nnubins = MNUBINS;
+
+  if (escaped_rpkt_spectra == NULL) {
+    // the emission/absorption contributions are always accumulated, because they are cheap to add as packets escape
+    const bool do_emission_res = WRITE_PARTIAL_EMISSIONABSORPTIONSPEC ? globals::do_emission_res : false;
+    escaped_rpkt_spectra = alloc_spectra(do_emission_res);
+    assert_always(escaped_rpkt_spectra != NULL);
+    init_spectra(escaped_rpkt_spectra, globals::nu_min_r, globals::nu_max_r, do_emission_res);
+
+#ifdef POL_ON
+    // only the Stokes fluxes are written to the partial specpol.out
+    escaped_stokes_i = alloc_spectra(false);
+    escaped_stokes_q = alloc_spectra(false);
+    escaped_stokes_u = alloc_spectra(false);
+    init_spectra(escaped_stokes_i, globals::nu_min_r, globals::nu_max_r, false);
+    init_spectra(escaped_stokes_q, globals::nu_min_r, globals::nu_max_r, false);
+    init_spectra(escaped_stokes_u, globals::nu_min_r, globals::nu_max_r, false);
+#endif
+
+    escaped_rpkt_light_curve_lum = static_cast<double *>(calloc(globals::ntstep, sizeof(double)));
+    escaped_rpkt_light_curve_lumcmf = static_cast<double *>(calloc(globals::ntstep, sizeof(double)));
+    escaped_gamma_light_curve_lum = static_cast<double *>(calloc(globals::ntstep, sizeof(double)));
+    escaped_gamma_light_curve_lumcmf = static_cast<double *>(calloc(globals::ntstep, sizeof(double)));
+  }
+
+  for (int ii = 0; ii < npkts; ii++) {
+    if (pkts[ii].type == TYPE_ESCAPE) {
+      const int abin = -1;  // all angles
+      if (pkts[ii].escape_type == TYPE_RPKT) {
+        add_to_lc_res(&pkts[ii], abin, escaped_rpkt_light_curve_lum, escaped_rpkt_light_curve_lumcmf);
+        add_to_spec_res(&pkts[ii], abin, escaped_rpkt_spectra, escaped_stokes_i, escaped_stokes_q, escaped_stokes_u);
+      } else if (pkts[ii].escape_type == TYPE_GAMMA) {
+        add_to_lc_res(&pkts[ii], abin, escaped_gamma_light_curve_lum, escaped_gamma_light_curve_lumcmf);
+      }
+    }
+  }
+}
+
+void clear_partial_lightcurve_spectra(void)
+// reset the running totals of the escaped packets
+{
+  if (escaped_rpkt_spectra == NULL) {
+    return;
+  }
+  init_spectra(escaped_rpkt_spectra, globals::nu_min_r, globals::nu_max_r, escaped_rpkt_spectra->do_emission_res);
+#ifdef POL_ON
+  init_spectra(escaped_stokes_i, globals::nu_min_r, globals::nu_max_r, false);
+  init_spectra(escaped_stokes_q, globals::nu_min_r, globals::nu_max_r, false);
+  init_spectra(escaped_stokes_u, globals::nu_min_r, globals::nu_max_r, false);
+#endif
+  for (int nts = 0; nts < globals::ntstep; nts++) {
+    escaped_rpkt_light_curve_lum[nts] = 0.;
+    escaped_rpkt_light_curve_lumcmf[nts] = 0.;
+    escaped_gamma_light_curve_lum[nts] = 0.;
+    escaped_gamma_light_curve_lumcmf[nts] = 0.;
+  }
+}
+
+static void copy_escaped_totals(struct spec *spectra, struct spec *stokes_i, struct spec *stokes_q,
+                                struct spec *stokes_u, double *rpkt_light_curve_lum, double *rpkt_light_curve_lumcmf,
+                                double *gamma_light_curve_lum, double *gamma_light_curve_lumcmf)
+// copy the running totals into the (initialised) partial output arrays, which are then reduced in place
+{
+  assert_always(escaped_rpkt_spectra != NULL);
+  const size_t ntstep = globals::ntstep;
+  const size_t nnubins = globals::nnubins;
+  memcpy(rpkt_light_curve_lum, escaped_rpkt_light_curve_lum, ntstep * sizeof(double));
+  memcpy(rpkt_light_curve_lumcmf, escaped_rpkt_light_curve_lumcmf, ntstep * sizeof(double));
+  memcpy(gamma_light_curve_lum, escaped_gamma_light_curve_lum, ntstep * sizeof(double));
+  memcpy(gamma_light_curve_lumcmf, escaped_gamma_light_curve_lumcmf, ntstep * sizeof(double));
+
+  memcpy(spectra->fluxalltimesteps, escaped_rpkt_spectra->fluxalltimesteps, ntstep * nnubins * sizeof(double));
+  if (stokes_i != NULL) {
+    memcpy(stokes_i->fluxalltimesteps, escaped_stokes_i->fluxalltimesteps, ntstep * nnubins * sizeof(double));
+    memcpy(stokes_q->fluxalltimesteps, escaped_stokes_q->fluxalltimesteps, ntstep * nnubins * sizeof(double));
+    memcpy(stokes_u->fluxalltimesteps, escaped_stokes_u->fluxalltimesteps, ntstep * nnubins * sizeof(double));
+  }
+  if (spectra->do_emission_res) {
+    assert_always(escaped_rpkt_spectra->do_emission_res);
+    const size_t proccount = get_proccount();
+    const size_t ioncount = get_nelements() * get_max_nions();
+    memcpy(spectra->emissionalltimesteps, escaped_rpkt_spectra->emissionalltimesteps,
+           ntstep * nnubins * proccount * sizeof(double));
+    memcpy(spectra->trueemissionalltimesteps, escaped_rpkt_spectra->trueemissionalltimesteps,
+           ntstep * nnubins * proccount * sizeof(double));
+    memcpy(spectra->absorptionalltimesteps, escaped_rpkt_spectra->absorptionalltimesteps,
+           ntstep * nnubins * ioncount * sizeof(double));
+  }
+}
+
+double get_partial_spectrum_lum(const int nts)
+// luminosity [erg/s] between nu_min_r and nu_max_r of the packet spectrum of timestep nts from the last call to
+// write_partial_lightcurve_spectra (only complete on rank 0 with MPI)
+{
+  assert_always(rpkt_spectra != NULL);
+  double lum = 0.;
+  for (int nnu = 0; nnu < globals::nnubins; nnu++) {
+    lum += rpkt_spectra->timesteps[nts].flux[nnu] * rpkt_spectra->delta_freq[nnu];
+  }
+  return lum * 4.e12 * PI * PARSEC * PARSEC;
+}
+
 void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts) {
   const time_t time_func_start = time(NULL);
 
@@ -656,9 +778,19 @@ void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts)
     assert_always(rpkt_spectra != NULL);
   }
 
-  struct spec *stokes_i = NULL;
-  struct spec *stokes_q = NULL;
-  struct spec *stokes_u = NULL;
+#ifdef POL_ON
+  if (rpkt_stokes_i == NULL) {
+    rpkt_stokes_i = alloc_spectra(false);
+    rpkt_stokes_q = alloc_spectra(false);
+    rpkt_stokes_u = alloc_spectra(false);
+  }
+  init_spectra(rpkt_stokes_i, globals::nu_min_r, globals::nu_max_r, false);
+  init_spectra(rpkt_stokes_q, globals::nu_min_r, globals::nu_max_r, false);
+  init_spectra(rpkt_stokes_u, globals::nu_min_r, globals::nu_max_r, false);
+#endif
+  struct spec *stokes_i = rpkt_stokes_i;
+  struct spec *stokes_q = rpkt_stokes_q;
+  struct spec *stokes_u = rpkt_stokes_u;
 
   // the emission resolved spectra are slow to generate, so only allow making them for the final timestep or every n
   if (WRITE_PARTIAL_EMISSIONABSORPTIONSPEC && globals::do_emission_res) {
@@ -669,14 +801,19 @@ void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts)
 
   init_spectra(rpkt_spectra, globals::nu_min_r, globals::nu_max_r, do_emission_res);
 
-  for (int ii = 0; ii < globals::npkts; ii++) {
-    if (pkts[ii].type == TYPE_ESCAPE) {
-      const int abin = -1;  // all angles
-      if (pkts[ii].escape_type == TYPE_RPKT) {
-        add_to_lc_res(&pkts[ii], abin, rpkt_light_curve_lum, rpkt_light_curve_lumcmf);
-        add_to_spec_res(&pkts[ii], abin, rpkt_spectra, stokes_i, stokes_q, stokes_u);
-      } else if (abin == -1 && pkts[ii].escape_type == TYPE_GAMMA) {
-        add_to_lc_res(&pkts[ii], abin, gamma_light_curve_lum, gamma_light_curve_lumcmf);
+  if constexpr (ESCAPED_PACKET_LOG) {
+    copy_escaped_totals(rpkt_spectra, stokes_i, stokes_q, stokes_u, rpkt_light_curve_lum, rpkt_light_curve_lumcmf,
+                        gamma_light_curve_lum, gamma_light_curve_lumcmf);
+  } else {
+    for (int ii = 0; ii < globals::npkts; ii++) {
+      if (pkts[ii].type == TYPE_ESCAPE) {
+        const int abin = -1;  // all angles
+        if (pkts[ii].escape_type == TYPE_RPKT) {
+          add_to_lc_res(&pkts[ii], abin, rpkt_light_curve_lum, rpkt_light_curve_lumcmf);
+          add_to_spec_res(&pkts[ii], abin, rpkt_spectra, stokes_i, stokes_q, stokes_u);
+        } else if (abin == -1 && pkts[ii].escape_type == TYPE_GAMMA) {
+          add_to_lc_res(&pkts[ii], abin, gamma_light_curve_lum, gamma_light_curve_lumcmf);
+        }
       }
     }
   }
@@ -686,17 +823,22 @@ void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts)
 
   const time_t time_mpireduction_start = time(NULL);
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
   mpi_reduce_spectra(my_rank, rpkt_spectra, numtimesteps);
+  if (stokes_i != NULL) {
+    mpi_reduce_spectra(my_rank, stokes_i, numtimesteps);
+    mpi_reduce_spectra(my_rank, stokes_q, numtimesteps);
+    mpi_reduce_spectra(my_rank, stokes_u, numtimesteps);
+  }
   MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : rpkt_light_curve_lum, rpkt_light_curve_lum, numtimesteps, MPI_DOUBLE,
-             MPI_SUM, 0, MPI_COMM_WORLD);
+             MPI_SUM, 0, globals::mpi_comm_model);
   MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : rpkt_light_curve_lumcmf, rpkt_light_curve_lumcmf, numtimesteps, MPI_DOUBLE,
-             MPI_SUM, 0, MPI_COMM_WORLD);
+             MPI_SUM, 0, globals::mpi_comm_model);
   MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : gamma_light_curve_lum, gamma_light_curve_lum, numtimesteps, MPI_DOUBLE,
-             MPI_SUM, 0, MPI_COMM_WORLD);
+             MPI_SUM, 0, globals::mpi_comm_model);
   MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : gamma_light_curve_lumcmf, gamma_light_curve_lumcmf, numtimesteps, MPI_DOUBLE,
-             MPI_SUM, 0, MPI_COMM_WORLD);
-  MPI_Barrier(MPI_COMM_WORLD);
+             MPI_SUM, 0, globals::mpi_comm_model);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   const time_t time_mpireduction_end = time(NULL);
 
@@ -704,6 +846,9 @@ void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts)
     write_light_curve("light_curve.out", -1, rpkt_light_curve_lum, rpkt_light_curve_lumcmf, numtimesteps);
     write_light_curve("gamma_light_curve.out", -1, gamma_light_curve_lum, gamma_light_curve_lumcmf, numtimesteps);
     write_spectrum("spec.out", "emission.out", "emissiontrue.out", "absorption.out", rpkt_spectra, numtimesteps);
+    if (stokes_i != NULL) {
+      write_specpol("specpol.out", NULL, NULL, stokes_i, stokes_q, stokes_u);
+    }
   }
 
   free(rpkt_light_curve_lum);
@@ -712,7 +857,7 @@ void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts)
   free(gamma_light_curve_lumcmf);
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
 
   printout("timestep %d: Saving partial light curves and %sspectra took %lds (%lds for MPI reduction)\n", nts,
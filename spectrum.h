@@ -36,6 +36,9 @@ struct spec *alloc_spectra(const bool do_emission_res);
 void init_spectra(struct spec *spectra, const double nu_min, const double nu_max, const bool do_emission_res);
 void init_spectrum_trace(void);
 void free_spectra(struct spec *spectra);
+void clear_partial_lightcurve_spectra(void);
+void add_to_partial_lightcurve_spectra(const struct packet *pkts, int npkts);
 void write_partial_lightcurve_spectra(int my_rank, int nts, struct packet *pkts);
+double get_partial_spectrum_lum(int nts);
 
 #endif  // SPECTRUM_H
@@ -138,49 +138,64 @@ static double get_bfheatingcoeff(int element, int ion, int level)
   return globals::cellhistory[tid].chelements[element].chions[ion].chlevels[level].bfheatingcoeff;
 }
 
-void calculate_bfheatingcoeffs(int modelgridindex) {
-  const double minelfrac = 0.01;
-  for (int element = 0; element < get_nelements(); element++) {
-    if (!(grid::get_elem_abundance(modelgridindex, element) > minelfrac || !NO_LUT_BFHEATING)) {
-      printout("skipping Z=%d X=%g, ", get_element(element), grid::get_elem_abundance(modelgridindex, element));
-    }
+static void calculate_bfheatingcoeffs_element(const int modelgridindex, const int element, const double minelfrac,
+                                              struct chelements *const cellhist_elements) {
+  if (!(grid::get_elem_abundance(modelgridindex, element) > minelfrac || !NO_LUT_BFHEATING)) {
+    printout("skipping Z=%d X=%g, ", get_element(element), grid::get_elem_abundance(modelgridindex, element));
+  }
 
-    const int nions = get_nions(element);
-    for (int ion = 0; ion < nions; ion++) {
-      const int nlevels = get_nlevels(element, ion);
-      for (int level = 0; level < nlevels; level++) {
-        double bfheatingcoeff = 0.;
-        if (grid::get_elem_abundance(modelgridindex, element) > minelfrac || !NO_LUT_BFHEATING) {
-          for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level);
-               phixstargetindex++) {
+  const int nions = get_nions(element);
+  for (int ion = 0; ion < nions; ion++) {
+    const int nlevels = get_nlevels(element, ion);
+    for (int level = 0; level < nlevels; level++) {
+      double bfheatingcoeff = 0.;
+      if (grid::get_elem_abundance(modelgridindex, element) > minelfrac || !NO_LUT_BFHEATING) {
+        for (int phixstargetindex = 0; phixstargetindex < get_nphixstargets(element, ion, level); phixstargetindex++) {
 #if NO_LUT_BFHEATING
 
-            bfheatingcoeff += calculate_bfheatingcoeff(element, ion, level, phixstargetindex, modelgridindex);
+          bfheatingcoeff += calculate_bfheatingcoeff(element, ion, level, phixstargetindex, modelgridindex);
 
 #else
 
-            /// The correction factor for stimulated emission in gammacorr is set to its
-            /// LTE value. Because the T_e dependence of gammacorr is weak, this correction
-            /// correction may be evaluated at T_R!
-            const double T_R = grid::get_TR(modelgridindex);
-            const double W = grid::get_W(modelgridindex);
-            bfheatingcoeff += get_bfheatingcoeff_ana(element, ion, level, phixstargetindex, T_R, W);
+          /// The correction factor for stimulated emission in gammacorr is set to its
+          /// LTE value. Because the T_e dependence of gammacorr is weak, this correction
+          /// correction may be evaluated at T_R!
+          const double T_R = grid::get_TR(modelgridindex);
+          const double W = grid::get_W(modelgridindex);
+          bfheatingcoeff += get_bfheatingcoeff_ana(element, ion, level, phixstargetindex, T_R, W);
 
 #endif
-          }
-          assert_always(std::isfinite(bfheatingcoeff));
+        }
+        assert_always(std::isfinite(bfheatingcoeff));
 
 #if !NO_LUT_BFHEATING
-          const int index_in_groundlevelcontestimator =
-              globals::elements[element].ions[ion].levels[level].closestgroundlevelcont;
-          if (index_in_groundlevelcontestimator >= 0) {
-            bfheatingcoeff *= globals::bfheatingestimator[modelgridindex * get_nelements() * get_max_nions() +
-                                                          index_in_groundlevelcontestimator];
-          }
-#endif
+        const int index_in_groundlevelcontestimator =
+            globals::elements[element].ions[ion].levels[level].closestgroundlevelcont;
+        if (index_in_groundlevelcontestimator >= 0) {
+          bfheatingcoeff *= globals::bfheatingestimator[modelgridindex * get_nelements() * get_max_nions() +
+                                                        index_in_groundlevelcontestimator];
         }
-        globals::cellhistory[tid].chelements[element].chions[ion].chlevels[level].bfheatingcoeff = bfheatingcoeff;
+#endif
       }
+      cellhist_elements[element].chions[ion].chlevels[level].bfheatingcoeff = bfheatingcoeff;
+    }
+  }
+}
+
+void calculate_bfheatingcoeffs(int modelgridindex) {
+  const double minelfrac = 0.01;
+  // the coefficients go into the cellhistory of the calling thread, even if the elements are divided between threads
+  struct chelements *const cellhist_elements = globals::cellhistory[tid].chelements;
+  if (globals::intracell_parallel) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int element = 0; element < get_nelements(); element++) {
+      calculate_bfheatingcoeffs_element(modelgridindex, element, minelfrac, cellhist_elements);
+    }
+  } else {
+    for (int element = 0; element < get_nelements(); element++) {
+      calculate_bfheatingcoeffs_element(modelgridindex, element, minelfrac, cellhist_elements);
     }
   }
   globals::cellhistory[tid].bfheating_mgi = modelgridindex;
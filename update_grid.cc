@@ -3,9 +3,12 @@
 #include <gsl/gsl_roots.h>
 
 #include <cmath>
+#include <vector>
 
 #include "atomic.h"
+#include "celloutput.h"
 #include "decay.h"
+#include "expansionopacity.h"
 #include "grid.h"
 #include "kpkt.h"
 #include "ltepop.h"
@@ -38,6 +41,9 @@ void precalculate_partfuncts(int modelgridindex)
   }
 }
 
+// per-cell buffers for the estimators file when BUFFERED_CELL_OUTPUT is on
+static struct celloutput::bufferedfile estimators_output;
+
 static void write_to_estimators_file(FILE *estimators_file, const int mgi, const int timestep, const int titer,
                                      const struct heatingcoolingrates *heatingcoolingrates) {
   // return; disable for better performance (if estimators files are not needed)
@@ -829,9 +835,21 @@ static void solve_Te_nltepops(const int n, const int nts, const int titer,
       // fractional difference between previous and current iteration's (nne or max(ground state population change))
       double nlte_test = 0.;
       if (NLTE_POPS_ALL_IONS_SIMULTANEOUS) {
-        for (int element = 0; element < get_nelements(); element++) {
-          if (get_nions(element) > 0) {
-            solve_nlte_pops_element(element, n, nts, nlte_iter);
+        // each element's populations are solved independently
+        if (globals::intracell_parallel) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+          for (int element = 0; element < get_nelements(); element++) {
+            if (get_nions(element) > 0) {
+              solve_nlte_pops_element(element, n, nts, nlte_iter);
+            }
+          }
+        } else {
+          for (int element = 0; element < get_nelements(); element++) {
+            if (get_nions(element) > 0) {
+              solve_nlte_pops_element(element, n, nts, nlte_iter);
+            }
           }
         }
       } else {
@@ -1009,6 +1027,148 @@ static void set_all_corrphotoionrenorm(const int modelgridindex, const double va
 }
 #endif
 
+#ifndef FORCE_LTE
+struct cellconvergence_inputs {
+  // estimators that drive the radiation field fit and the T_e/NLTE/non-thermal solutions, divided by the
+  // density so that the homologous dilution between timesteps does not count as a change
+  double J_per_rho = -1.;
+  double nubar = -1.;  // nuJ / J
+  double deposition_per_rho = -1.;
+  std::vector<double> gamma_per_rho;  // photoionisation rate estimators, or -1 for ions with negligible population
+};
+
+struct cellconvergence_state {
+  struct cellconvergence_inputs ref;  // inputs at the last full solution
+  double rho_lastupdate = -1.;        // density at the last (full or skipped) update
+  // heating and cooling rates from the T_e solution at the last full solution
+  struct heatingcoolingrates heatingcoolingrates = {};
+  int consecutive_skips = 0;
+  bool ref_valid = false;
+};
+
+// indexed by modelgridindex. Each cell is only updated by the thread that works on it in update_grid
+static std::vector<struct cellconvergence_state> cellconvergence;
+
+static void get_cellconvergence_inputs(const int mgi, const double estimator_normfactor,
+                                       struct cellconvergence_inputs *inputs)
+// must be called after J and nuJ have been normalised, but before the raw gamma estimators are converted by
+// update_gamma_corrphotoionrenorm_bfheating_estimators
+{
+  const double rho = grid::get_rho(mgi);
+  const double J = radfield::get_J(mgi);
+  inputs->J_per_rho = J / rho;
+  inputs->nubar = (J > 0.) ? radfield::get_nuJ(mgi) / J : 0.;
+  inputs->deposition_per_rho = NT_ON ? nonthermal::get_deposition_rate_density(mgi) / rho : 0.;
+
+  inputs->gamma_per_rho.assign(get_nelements() * get_max_nions(), -1.);
+#if (!NO_LUT_PHOTOION)
+  for (int element = 0; element < get_nelements(); element++) {
+    const int nions = get_nions(element);
+    double elementpop = 0.;
+    for (int ion = 0; ion < nions; ion++) {
+      elementpop += ionstagepop(mgi, element, ion);
+    }
+    for (int ion = 0; ion < nions - 1; ion++) {
+      // rates of ions that are a tiny fraction of the element are too noisy to be useful and hardly matter
+      if (elementpop > 0. && ionstagepop(mgi, element, ion) > 1e-3 * elementpop) {
+        const int ionestimindex = mgi * get_nelements() * get_max_nions() + element * get_max_nions() + ion;
+        inputs->gamma_per_rho[element * get_max_nions() + ion] =
+            globals::gammaestimator[ionestimindex] * estimator_normfactor / H / rho;
+      }
+    }
+  }
+#else
+  (void)estimator_normfactor;
+#endif
+}
+
+static inline double fracdiff(const double newval, const double refval) {
+  if (newval == refval) {
+    return 0.;
+  }
+  return (refval != 0.) ? fabs(newval / refval - 1) : INFINITY;
+}
+
+static bool cell_can_skip_solvers(const int mgi, const int nts, const struct cellconvergence_inputs *inputs)
+// decide whether the changes in the estimators since the last full solution of the cell are within the Monte Carlo
+// noise, and log the decision and the reason
+{
+  const struct cellconvergence_state *state = &cellconvergence[mgi];
+  if (!state->ref_valid) {
+    printout("update_grid: cell %d timestep %d full solve (no previous solution)\n", mgi, nts);
+    return false;
+  }
+  if (state->consecutive_skips >= UPDATEGRID_SKIP_MAX_CONSECUTIVE) {
+    printout("update_grid: cell %d timestep %d full solve (skipped %d consecutive updates)\n", mgi, nts,
+             state->consecutive_skips);
+    return false;
+  }
+
+  const int contribcount = radfield::get_total_contribcount(mgi);
+  if (contribcount <= 0) {
+    printout("update_grid: cell %d timestep %d full solve (no estimator contribution counts)\n", mgi, nts);
+    return false;
+  }
+  const double noise = 1. / sqrt(contribcount);
+  const double tolerance = UPDATEGRID_SKIP_NOISE_THRESHOLD * noise;
+
+  const struct cellconvergence_inputs *ref = &state->ref;
+  double maxchange = fracdiff(inputs->J_per_rho, ref->J_per_rho);
+  const char *maxchange_input = "J";
+  if (fracdiff(inputs->nubar, ref->nubar) > maxchange) {
+    maxchange = fracdiff(inputs->nubar, ref->nubar);
+    maxchange_input = "nubar";
+  }
+  if (fracdiff(inputs->deposition_per_rho, ref->deposition_per_rho) > maxchange) {
+    maxchange = fracdiff(inputs->deposition_per_rho, ref->deposition_per_rho);
+    maxchange_input = "deposition";
+  }
+  for (size_t i = 0; i < inputs->gamma_per_rho.size(); i++) {
+    if ((inputs->gamma_per_rho[i] < 0.) != (ref->gamma_per_rho[i] < 0.)) {
+      printout("update_grid: cell %d timestep %d full solve (set of populated ions changed)\n", mgi, nts);
+      return false;
+    }
+    if (inputs->gamma_per_rho[i] >= 0. && fracdiff(inputs->gamma_per_rho[i], ref->gamma_per_rho[i]) > maxchange) {
+      maxchange = fracdiff(inputs->gamma_per_rho[i], ref->gamma_per_rho[i]);
+      maxchange_input = "gamma";
+    }
+  }
+
+  if (maxchange >= tolerance) {
+    printout("update_grid: cell %d timestep %d full solve (%s changed by %.2e >= %g x noise %.2e)\n", mgi, nts,
+             maxchange_input, maxchange, UPDATEGRID_SKIP_NOISE_THRESHOLD, noise);
+    return false;
+  }
+
+  printout(
+      "update_grid: cell %d timestep %d skipping solvers (max change %.2e in %s < %g x noise %.2e), keeping T_e %g "
+      "T_R %g W %g\n",
+      mgi, nts, maxchange, maxchange_input, UPDATEGRID_SKIP_NOISE_THRESHOLD, noise, grid::get_Te(mgi),
+      grid::get_TR(mgi), grid::get_W(mgi));
+  return true;
+}
+
+static void update_skipped_cell_populations(const int mgi)
+// keep the ionisation and excitation state of the previous solution, but update the density-dependent populations
+{
+  if (!NLTE_POPS_ON) {
+    // LTE populations at the kept T_e
+    calculate_populations(mgi);
+  } else {
+    // NLTE level populations are stored per unit density, but the ground level populations are number densities
+    const double rhoratio = grid::get_rho(mgi) / cellconvergence[mgi].rho_lastupdate;
+    for (int element = 0; element < get_nelements(); element++) {
+      const int nions = get_nions(element);
+      for (int ion = 0; ion < nions; ion++) {
+        grid::modelgrid[mgi].composition[element].groundlevelpop[ion] *= rhoratio;
+      }
+    }
+    precalculate_partfuncts(mgi);
+    calculate_electron_densities(mgi);
+  }
+}
+#endif
+
 static void update_grid_cell(const int mgi, const int nts, const int nts_prev, const int titer, const double tratmid,
                              const double deltat, std::unique_ptr<double[]> &mps,
                              struct heatingcoolingrates *heatingcoolingrates)
@@ -1122,6 +1282,13 @@ static void update_grid_cell(const int mgi, const int nts, const int nts_prev, c
 
           precalculate_partfuncts(mgi);
           calculate_populations(mgi);
+
+#ifndef FORCE_LTE
+          if constexpr (UPDATEGRID_SKIP_CONVERGED_CELLS) {
+            // the next non-LTE update needs a full solution
+            cellconvergence[mgi].ref_valid = false;
+          }
+#endif
         }
 #ifndef FORCE_LTE
         else  // not (initial_iteration || grid::modelgrid[n].thick == 1)
@@ -1138,19 +1305,43 @@ static void update_grid_cell(const int mgi, const int nts, const int nts_prev, c
           titer_average_estimators(mgi);
 #endif
 
+          struct cellconvergence_inputs convergence_inputs;
+          bool skip_solvers = false;
+          if constexpr (UPDATEGRID_SKIP_CONVERGED_CELLS) {
+            get_cellconvergence_inputs(mgi, estimator_normfactor, &convergence_inputs);
+            skip_solvers = cell_can_skip_solvers(mgi, nts, &convergence_inputs);
+          }
+
 #if (!NO_LUT_PHOTOION || !NO_LUT_BFHEATING)
           update_gamma_corrphotoionrenorm_bfheating_estimators(mgi, estimator_normfactor);
 #endif
 
-          // Get radiation field parameters (T_J, T_R, W, and bins if enabled) out of the full-spectrum and binned J
-          // and nuJ estimators
-          radfield::fit_parameters(mgi, nts);
-
 #if (DETAILED_BF_ESTIMATORS_ON)
           radfield::normalise_bf_estimators(mgi, estimator_normfactor / H);
 #endif
 
-          solve_Te_nltepops(mgi, nts, titer, heatingcoolingrates);
+          if (skip_solvers) {
+            update_skipped_cell_populations(mgi);
+            cellconvergence[mgi].consecutive_skips++;
+            // the estimators file gets the rates of the solution that is being kept
+            *heatingcoolingrates = cellconvergence[mgi].heatingcoolingrates;
+          } else {
+            // Get radiation field parameters (T_J, T_R, W, and bins if enabled) out of the full-spectrum and binned J
+            // and nuJ estimators
+            radfield::fit_parameters(mgi, nts);
+
+            solve_Te_nltepops(mgi, nts, titer, heatingcoolingrates);
+
+            if constexpr (UPDATEGRID_SKIP_CONVERGED_CELLS) {
+              cellconvergence[mgi].ref = convergence_inputs;
+              cellconvergence[mgi].heatingcoolingrates = *heatingcoolingrates;
+              cellconvergence[mgi].ref_valid = true;
+              cellconvergence[mgi].consecutive_skips = 0;
+            }
+          }
+          if constexpr (UPDATEGRID_SKIP_CONVERGED_CELLS) {
+            cellconvergence[mgi].rho_lastupdate = grid::get_rho(mgi);
+          }
         }
 #endif
         printout("Temperature/NLTE solution for cell %d timestep %d took %ld seconds\n", mgi, nts,
@@ -1206,6 +1397,10 @@ static void update_grid_cell(const int mgi, const int nts, const int nts_prev, c
 
       printout("calculate_kpkt_rates for cell %d timestep %d took %ld seconds\n", mgi, nts,
                time(NULL) - sys_time_start_calc_kpkt_rates);
+
+      if constexpr (EXPANSION_OPACITY_BINNED) {
+        expansionopacity::calculate_cell(mgi, globals::time_step[nts].mid);
+      }
     } else {
       // For opacity_case != 4 the opacity treatment is grey. Enforce
       // optically thick treatment in this case (should be equivalent to grey)
@@ -1307,6 +1502,16 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
   /// regime proportional to the density to a regime independent of the density
   /// This is done by solving for tau_sobolev == 1
   /// tau_sobolev = PI*QE*QE/(ME*C) * rho_crit_para * rho/nucmass(28, 56) * 3000e-8 * globals::time_step[m].mid;
+#ifndef FORCE_LTE
+  if constexpr (UPDATEGRID_SKIP_CONVERGED_CELLS) {
+    if (cellconvergence.empty()) {
+      cellconvergence.resize(grid::get_npts_model());
+    }
+  }
+#endif
+
+  celloutput::init(&estimators_output, estimators_file, grid::get_npts_model());
+
   globals::rho_crit = ME * CLIGHT * decay::nucmass(28, 56) /
                       (PI * QE * QE * globals::rho_crit_para * 3000e-8 * globals::time_step[nts].mid);
   printout("update_grid: rho_crit = %g\n", globals::rho_crit);
@@ -1318,8 +1523,31 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
   // printout("timestep %d, titer %d\n", nts, titer);
   // printout("deltat %g\n", deltat);
 
+  if constexpr (INTRA_CELL_PARALLEL) {
+    int ndo_nonempty = 0;
+    for (int mgi = nstart; mgi < nstart + ndo; mgi++) {
+      if (grid::get_numassociatedcells(mgi) > 0) {
+        ndo_nonempty++;
+      }
+    }
+    globals::intracell_parallel = (ndo_nonempty < get_max_threads());
+    printout("update_grid: %d non-empty cells for %d threads. Parallelising within cells: %s\n", ndo_nonempty,
+             get_max_threads(), globals::intracell_parallel ? "yes" : "no");
+  }
+
+  if (globals::intracell_parallel) {
+    // the threads that will share the work inside each cell also must not use the cellhistory
 #ifdef _OPENMP
 #pragma omp parallel
+#endif
+    {
+      use_cellhist = false;
+      cellhistory_reset(-99, true);
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel if (!globals::intracell_parallel)
 #endif
   {
     /// Do not use values which are saved in the cellhistory within update_grid
@@ -1348,10 +1576,15 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
 
         // use_cellhist = true;
         // cellhistory_reset(mgi, true);
+        FILE *estimators_cellstream = celloutput::cellstream(&estimators_output, mgi);
+        if constexpr (BUFFERED_CELL_OUTPUT) {
+          write_to_estimators_file(estimators_cellstream, mgi, nts, titer, &heatingcoolingrates);
+        } else {
 #ifdef _OPENMP
 #pragma omp critical(estimators_file)
 #endif
-        { write_to_estimators_file(estimators_file, mgi, nts, titer, &heatingcoolingrates); }
+          { write_to_estimators_file(estimators_cellstream, mgi, nts, titer, &heatingcoolingrates); }
+        }
 
         const int write_estim_duration = time(NULL) - sys_time_start_write_estimators;
         if (write_estim_duration > 1) {
@@ -1372,6 +1605,18 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
     use_cellhist = true;
   }  /// end OpenMP parallel section
 
+  if (globals::intracell_parallel) {
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    { use_cellhist = true; }
+    globals::intracell_parallel = false;
+  }
+
+  celloutput::flush(&estimators_output);
+  radfield::flush_cell_output();
+  nonthermal::flush_cell_output();
+
   // alterative way to write out estimators. this keeps the modelgrid cells in order but heatingrates are not valid.
   // #ifdef _OPENMP
   // for (int n = nstart; n < nstart+nblock; n++)
@@ -1417,7 +1662,7 @@ void update_grid(FILE *estimators_file, const int nts, const int nts_prev, const
   printout("finished update grid on this rank at time %ld\n", time_update_grid_end_thisrank);
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Barrier(globals::mpi_comm_model);
 #endif
   printout("timestep %d: time after update grid for all processes %ld (rank %d took %lds, waited %lds, total %lds)\n",
            nts, time(NULL), my_rank, time_update_grid_end_thisrank - sys_time_start_update_grid,
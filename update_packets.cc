@@ -1,18 +1,28 @@
 #include "update_packets.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "decay.h"
+#include "escapelog.h"
 #include "gammapkt.h"
 #include "grid.h"
 #include "kpkt.h"
 #include "nonthermal.h"
 #include "packet.h"
+#include "packetcount.h"
 #include "rpkt.h"
 #include "sn3d.h"
 #include "stats.h"
 #include "update_grid.h"
 
+// these options work on the active-packet index list and rely on escaped packets being compacted to the end
+static_assert(UPDATE_PACKETS_ACTIVE_LIST || !ESCAPED_PACKET_LOG, "ESCAPED_PACKET_LOG needs UPDATE_PACKETS_ACTIVE_LIST");
+static_assert(UPDATE_PACKETS_ACTIVE_LIST || !RPKT_SPLITTING_ROULETTE,
+              "RPKT_SPLITTING_ROULETTE needs UPDATE_PACKETS_ACTIVE_LIST");
+static_assert(UPDATE_PACKETS_ACTIVE_LIST || !MPI_PACKET_WORK_STEALING,
+              "MPI_PACKET_WORK_STEALING needs UPDATE_PACKETS_ACTIVE_LIST");
+
 static void do_nonthermal_predeposit(struct packet *pkt_ptr, const int nts, const double t2) {
   const double ts = pkt_ptr->prop_time;
 
@@ -35,7 +45,7 @@ static void do_nonthermal_predeposit(struct packet *pkt_ptr, const int nts, cons
     // endot(E) * delta_t = endot(E) * delta_E / endot(E) = delta_E (delta_t is the time spent in the bin range)
     // so all final energies are equally likely.
     // Choose random en_absorb [0, particle_en]
-    const double zrand = gsl_rng_uniform(rng);
+    const double zrand = rng_uniform();
     const double en_absorb = zrand * particle_en;
 
     // for endot independent of energy, the next line is trival (for E dependent endot, an integral would be needed)
@@ -231,19 +241,12 @@ static bool std_compare_packets_bymodelgriddensity(const struct packet &p1, cons
   return false;
 }
 
-void update_packets(const int my_rank, const int nts, struct packet *packets)
-// Subroutine to move and update packets during the current timestep (nts)
+static void do_update_packets_sorted_passes(const int nts, struct packet *packets)
+// sort the whole packet array by cell at the start of each pass and move every packet that has not escaped or
+// finished the timestep, until a pass leaves no packets unfinished
 {
-  // At the start, the packets have all either just been initialised or have already been
-  // processed for one or more timesteps. Those that are pellets will just be sitting in the
-  // matter. Those that are photons (or one sort or another) will already have a position and
-  // a direction.
-
   const double ts = globals::time_step[nts].start;
   const double tw = globals::time_step[nts].width;
-
-  const time_t time_update_packets_start = time(NULL);
-  printout("timestep %d: start update_packets at time %ld\n", nts, time_update_packets_start);
   bool timestepcomplete = false;
   int passnumber = 0;
   while (!timestepcomplete) {
@@ -251,40 +254,20 @@ void update_packets(const int my_rank, const int nts, struct packet *packets)
 
     const time_t sys_time_start_pass = time(NULL);
 
-    // printout("sorting packets...");
-
     std::sort(packets, packets + globals::npkts, std_compare_packets_bymodelgriddensity);
 
-    // printout("took %lds\n", time(NULL) - sys_time_start_pass);
-
     printout("  update_packets timestep %d pass %3d: started at %ld\n", nts, passnumber, sys_time_start_pass);
 
     int count_pktupdates = 0;
     const int updatecellcounter_beforepass = stats::get_counter(stats::COUNTER_UPDATECELL);
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic)
+#pragma omp parallel for schedule(dynamic) reduction(+ : count_pktupdates)
 #endif
     for (int n = 0; n < globals::npkts; n++) {
       struct packet *pkt_ptr = &packets[n];
 
-      // if (pkt_ptr->type == TYPE_ESCAPE)
-      // {
-      //   printout("packet index %d already escaped. Skipping rest of packets (which are all escaped).\n", n);
-      //   // for (int n2 = n; n2 < globals::npkts; n2++)
-      //   // {
-      //   //   assert_always(packets[n2].type == TYPE_ESCAPE);
-      //   // }
-      //   break;
-      // }
-      // pkt_ptr->timestep = nts;
-
-      if (passnumber == 0) {
-        pkt_ptr->interactions = 0;
-        pkt_ptr->scat_count = 0;
-      }
-
-      if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->prop_time < (ts + tw)) {
+      if (pkt_ptr->type != TYPE_ESCAPE && pkt_ptr->type != TYPE_UNUSED && pkt_ptr->prop_time < (ts + tw)) {
         const int cellindex = pkt_ptr->where;
         const int mgi = grid::get_cell_modelgridindex(cellindex);
         /// for non empty cells update the global available level populations and cooling terms
@@ -294,7 +277,6 @@ void update_packets(const int my_rank, const int nts, struct packet *packets)
           cellhistory_reset(mgi, false);
         }
 
-        // enum packet_type oldtype = pkt_ptr->type;
         int newmgi = mgi;
         bool workedonpacket = false;
         while ((newmgi == mgi || newmgi == grid::get_npts_model()) && pkt_ptr->prop_time < (ts + tw) &&
@@ -318,6 +300,324 @@ void update_packets(const int my_rank, const int nts, struct packet *packets)
 
     passnumber++;
   }
+}
+
+static int compact_escaped_packets(struct packet *packets)
+// move escaped packets to the end of the packet array, where they stay because they never become active again, and
+// return the number of packets that have not escaped
+{
+  struct packet *first_escaped = std::partition(packets, packets + globals::npkts, [](const struct packet &pkt) {
+    return pkt.type != TYPE_ESCAPE;
+  });
+  return first_escaped - packets;
+}
+
+static void do_update_packets_pass(const int nts, const int passnumber, struct packet *packets,
+                                   std::vector<int> &active_packets, const bool ownpackets)
+// move each active packet until it leaves its cell, escapes, or reaches the end of the timestep, then drop the
+// packets that escaped or finished the timestep from the list. Packets borrowed from another rank (ownpackets false)
+// are not split or rouletted, because the free slots for copies are in the rank's own packet array
+{
+  const bool split_roulette = RPKT_SPLITTING_ROULETTE && ownpackets;
+  const double ts = globals::time_step[nts].start;
+  const double tw = globals::time_step[nts].width;
+  const time_t sys_time_start_pass = time(NULL);
+
+  // order by cell and type (ties broken by packet index to make the order reproducible)
+  std::sort(active_packets.begin(), active_packets.end(), [packets](const int n1, const int n2) {
+    if (std_compare_packets_bymodelgriddensity(packets[n1], packets[n2])) return true;
+    if (std_compare_packets_bymodelgriddensity(packets[n2], packets[n1])) return false;
+    return n1 < n2;
+  });
+
+  const char *passname = ownpackets ? "pass" : "borrowed pass";
+  printout("  update_packets timestep %d %s %3d: started at %ld activepackets %7zu\n", nts, passname, passnumber,
+           sys_time_start_pass, active_packets.size());
+
+  int count_pktupdates = 0;
+  const int updatecellcounter_beforepass = stats::get_counter(stats::COUNTER_UPDATECELL);
+  const int nactive = active_packets.size();
+
+  // importance of each r-packet at the start of the pass (zero for other packet types)
+  std::vector<double> importance_before(split_roulette ? nactive : 0);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+ : count_pktupdates)
+#endif
+  for (int i = 0; i < nactive; i++) {
+    struct packet *pkt_ptr = &packets[active_packets[i]];
+
+    const int cellindex = pkt_ptr->where;
+    const int mgi = grid::get_cell_modelgridindex(cellindex);
+    /// for non empty cells update the global available level populations and cooling terms
+    /// Reset cellhistory if packet starts up in another than the last active cell
+    if (mgi != grid::get_npts_model() && globals::cellhistory[tid].cellnumber != mgi) {
+      stats::increment(stats::COUNTER_UPDATECELL);
+      cellhistory_reset(mgi, false);
+    }
+
+    if (split_roulette) {
+      importance_before[i] = (pkt_ptr->type == TYPE_RPKT) ? packetcount::get_rpkt_importance(pkt_ptr) : 0.;
+    }
+
+    // enum packet_type oldtype = pkt_ptr->type;
+    int newmgi = mgi;
+    bool workedonpacket = false;
+    while ((newmgi == mgi || newmgi == grid::get_npts_model()) && pkt_ptr->prop_time < (ts + tw) &&
+           pkt_ptr->type != TYPE_ESCAPE) {
+      workedonpacket = true;
+      do_packet(pkt_ptr, ts + tw, nts);
+      const int newcellnum = pkt_ptr->where;
+      newmgi = grid::get_cell_modelgridindex(newcellnum);
+    }
+    count_pktupdates += workedonpacket ? 1 : 0;
+  }
+
+  // r-packets that moved to another cell are split or rouletted before the next pass
+  if (split_roulette) {
+    packetcount::split_roulette_rpkts(packets, active_packets, importance_before, ts + tw);
+  }
+
+  // drop the packets that escaped, reached the end of the timestep, or were killed by roulette
+  const auto new_end = std::remove_if(active_packets.begin(), active_packets.end(), [packets, ts, tw](const int n) {
+    return packets[n].type == TYPE_ESCAPE || packets[n].type == TYPE_UNUSED || packets[n].prop_time >= (ts + tw);
+  });
+  active_packets.erase(new_end, active_packets.end());
+
+  const int cellhistresets = stats::get_counter(stats::COUNTER_UPDATECELL) - updatecellcounter_beforepass;
+  printout(
+      "  update_packets timestep %d %s %3d: finished at %ld packetsupdated %7d cellhistoryresets %7d (took %lds)\n",
+      nts, passname, passnumber, time(NULL), count_pktupdates, cellhistresets, time(NULL) - sys_time_start_pass);
+}
+
+#ifdef MPI_ON
+// Packet work stealing between MPI ranks. A rank that has finished its own packets for the timestep asks the other
+// ranks in turn for work. Busy ranks answer between passes by lending a batch of their active packets (indices and
+// packet data), which the thief moves to the end of the timestep and sends back. The packets are therefore always
+// written out by the rank that owns them, and the estimators are reduced over all ranks afterwards as before.
+// A rank enters a non-blocking barrier once it has no work left and all of its lent packets have come back, and keeps
+// answering requests until every rank has entered the barrier.
+// All MPI calls are made outside the OpenMP parallel regions.
+
+enum steal_tags {
+  TAG_STEAL_REQUEST = 7001,
+  TAG_STEAL_REPLY_INDICES = 7002,
+  TAG_STEAL_REPLY_PACKETS = 7003,
+  TAG_STEAL_RETURN_INDICES = 7004,
+  TAG_STEAL_RETURN_PACKETS = 7005,
+};
+
+static int nlent_outstanding = 0;  // packets lent to other ranks that have not been returned yet
+
+static void send_packet_batch(const int dest, const int tag_indices, const int tag_packets, const int *indices,
+                              const struct packet *pkts, const int count) {
+  MPI_Send(indices, count, MPI_INT, dest, tag_indices, globals::mpi_comm_model);
+  if (count > 0) {
+    MPI_Send(pkts, count * sizeof(struct packet), MPI_BYTE, dest, tag_packets, globals::mpi_comm_model);
+  }
+}
+
+static int recv_packet_batch(const int source, const int tag_indices, const int tag_packets, std::vector<int> &indices,
+                             std::vector<struct packet> &pkts)
+// receive a batch sent by send_packet_batch and return the number of packets
+{
+  MPI_Status status;
+  MPI_Probe(source, tag_indices, globals::mpi_comm_model, &status);
+  int count = 0;
+  MPI_Get_count(&status, MPI_INT, &count);
+  indices.resize(count);
+  pkts.resize(count);
+  MPI_Recv(indices.data(), count, MPI_INT, source, tag_indices, globals::mpi_comm_model, MPI_STATUS_IGNORE);
+  if (count > 0) {
+    MPI_Recv(pkts.data(), count * sizeof(struct packet), MPI_BYTE, source, tag_packets, globals::mpi_comm_model,
+             MPI_STATUS_IGNORE);
+  }
+  return count;
+}
+
+static void serve_steal_messages(struct packet *packets, std::vector<int> *active_packets)
+// answer pending work requests (lending from active_packets if it is not NULL) and take back returned packets
+{
+  int flag = 0;
+  MPI_Status status;
+  MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL_RETURN_INDICES, globals::mpi_comm_model, &flag, &status);
+  while (flag) {
+    std::vector<int> indices;
+    std::vector<struct packet> pkts;
+    const int count =
+        recv_packet_batch(status.MPI_SOURCE, TAG_STEAL_RETURN_INDICES, TAG_STEAL_RETURN_PACKETS, indices, pkts);
+    for (int i = 0; i < count; i++) {
+      packets[indices[i]] = pkts[i];
+    }
+    nlent_outstanding -= count;
+    MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL_RETURN_INDICES, globals::mpi_comm_model, &flag, &status);
+  }
+
+  MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL_REQUEST, globals::mpi_comm_model, &flag, &status);
+  while (flag) {
+    const int thief = status.MPI_SOURCE;
+    MPI_Recv(NULL, 0, MPI_INT, thief, TAG_STEAL_REQUEST, globals::mpi_comm_model, MPI_STATUS_IGNORE);
+
+    // keep at least half of the active packets, and lend from the end of the list (the lowest density cells)
+    int nlend = 0;
+    if (active_packets != NULL) {
+      nlend = std::min(static_cast<int>(active_packets->size() / 2), MPI_PACKET_STEAL_BATCH_SIZE);
+    }
+    std::vector<int> indices;
+    std::vector<struct packet> pkts;
+    if (nlend > 0) {
+      indices.assign(active_packets->end() - nlend, active_packets->end());
+      for (const int n : indices) {
+        pkts.push_back(packets[n]);
+      }
+      active_packets->resize(active_packets->size() - nlend);
+      nlent_outstanding += nlend;
+      printout("  update_packets: lending %d packets to rank %d\n", nlend, thief);
+    }
+    send_packet_batch(thief, TAG_STEAL_REPLY_INDICES, TAG_STEAL_REPLY_PACKETS, indices.data(), pkts.data(), nlend);
+
+    MPI_Iprobe(MPI_ANY_SOURCE, TAG_STEAL_REQUEST, globals::mpi_comm_model, &flag, &status);
+  }
+}
+
+static int steal_packets(const int victim, struct packet *packets, std::vector<int> &indices,
+                         std::vector<struct packet> &pkts)
+// ask the victim rank for packets, serving other ranks' messages while waiting for the reply
+{
+  MPI_Request request;
+  MPI_Isend(NULL, 0, MPI_INT, victim, TAG_STEAL_REQUEST, globals::mpi_comm_model, &request);
+  int flag = 0;
+  while (!flag) {
+    serve_steal_messages(packets, NULL);
+    MPI_Iprobe(victim, TAG_STEAL_REPLY_INDICES, globals::mpi_comm_model, &flag, MPI_STATUS_IGNORE);
+  }
+  MPI_Wait(&request, MPI_STATUS_IGNORE);
+  return recv_packet_batch(victim, TAG_STEAL_REPLY_INDICES, TAG_STEAL_REPLY_PACKETS, indices, pkts);
+}
+
+static void steal_work_until_all_done(const int my_rank, const int nts, struct packet *packets)
+// process packets borrowed from the other ranks until none have work to lend, then wait for all ranks to finish
+{
+  int nstolen_total = 0;
+  int nfailed = 0;  // consecutive unsuccessful requests
+  int victim = (my_rank + 1) % globals::nprocs;
+  while (nfailed < globals::nprocs - 1) {
+    std::vector<int> indices;
+    std::vector<struct packet> stolen;
+    const int nstolen = steal_packets(victim, packets, indices, stolen);
+    if (nstolen == 0) {
+      // try the next rank, but keep asking a rank for as long as it has packets to lend
+      nfailed++;
+      victim = (victim + 1) % globals::nprocs;
+      if (victim == my_rank) {
+        victim = (victim + 1) % globals::nprocs;
+      }
+      continue;
+    }
+    nfailed = 0;
+    nstolen_total += nstolen;
+    printout("  update_packets timestep %d: borrowed %d packets from rank %d\n", nts, nstolen, victim);
+
+    std::vector<int> stolen_active(nstolen);
+    for (int i = 0; i < nstolen; i++) {
+      stolen_active[i] = i;
+    }
+    // the borrowed batch is only moved to the end of the timestep. The pass must not touch the rank's own packet
+    // state (e.g., the free slots for r-packet splitting), so it runs with ownpackets false
+    int passnumber = 0;
+    while (!stolen_active.empty()) {
+      do_update_packets_pass(nts, passnumber, stolen.data(), stolen_active, false);
+      serve_steal_messages(packets, NULL);
+      passnumber++;
+    }
+
+    send_packet_batch(victim, TAG_STEAL_RETURN_INDICES, TAG_STEAL_RETURN_PACKETS, indices.data(), stolen.data(),
+                      nstolen);
+  }
+
+  while (nlent_outstanding > 0) {
+    serve_steal_messages(packets, NULL);
+  }
+
+  MPI_Request barrier_request;
+  MPI_Ibarrier(globals::mpi_comm_model, &barrier_request);
+  int alldone = 0;
+  while (!alldone) {
+    serve_steal_messages(packets, NULL);
+    MPI_Test(&barrier_request, &alldone, MPI_STATUS_IGNORE);
+  }
+  printout("  update_packets timestep %d: processed %d packets borrowed from other ranks\n", nts, nstolen_total);
+}
+#endif
+
+void update_packets(const int my_rank, const int nts, struct packet *packets)
+// Subroutine to move and update packets during the current timestep (nts)
+{
+  // At the start, the packets have all either just been initialised or have already been
+  // processed for one or more timesteps. Those that are pellets will just be sitting in the
+  // matter. Those that are photons (or one sort or another) will already have a position and
+  // a direction.
+
+  const double ts = globals::time_step[nts].start;
+  const double tw = globals::time_step[nts].width;
+
+  const time_t time_update_packets_start = time(NULL);
+  printout("timestep %d: start update_packets at time %ld\n", nts, time_update_packets_start);
+
+  for (int n = 0; n < globals::npkts; n++) {
+    packets[n].interactions = 0;
+    packets[n].scat_count = 0;
+  }
+
+  if constexpr (!UPDATE_PACKETS_ACTIVE_LIST) {
+    do_update_packets_sorted_passes(nts, packets);
+  } else {
+    // each pass only sorts and iterates over the indices of packets that are still active in this timestep,
+    // and the list is shrunk after each pass
+    const int npkts_nonescaped = compact_escaped_packets(packets);
+    if constexpr (ESCAPED_PACKET_LOG) {
+      escapelog::start_timestep(nts, packets, npkts_nonescaped);
+    }
+    if constexpr (RPKT_SPLITTING_ROULETTE) {
+      packetcount::start_timestep(nts, packets, npkts_nonescaped);
+    }
+
+    std::vector<int> active_packets;
+    active_packets.reserve(npkts_nonescaped);
+    for (int n = 0; n < npkts_nonescaped; n++) {
+      if (packets[n].prop_time < (ts + tw) && packets[n].type != TYPE_UNUSED) {
+        active_packets.push_back(n);
+      }
+    }
+    printout("  update_packets timestep %d: %d packets not escaped, %zu active\n", nts, npkts_nonescaped,
+             active_packets.size());
+
+    int passnumber = 0;
+    while (!active_packets.empty()) {
+      do_update_packets_pass(nts, passnumber, packets, active_packets, true);
+#ifdef MPI_ON
+      if constexpr (MPI_PACKET_WORK_STEALING) {
+        serve_steal_messages(packets, &active_packets);
+      }
+#endif
+      passnumber++;
+    }
+
+#ifdef MPI_ON
+    if constexpr (MPI_PACKET_WORK_STEALING) {
+      if (globals::nprocs > 1) {
+        steal_work_until_all_done(my_rank, nts, packets);
+      }
+    }
+#endif
+
+    if constexpr (ESCAPED_PACKET_LOG) {
+      escapelog::end_timestep(nts, packets, npkts_nonescaped);
+    }
+    if constexpr (RPKT_SPLITTING_ROULETTE) {
+      packetcount::end_timestep(nts);
+    }
+  }
 
   stats::pkt_action_counters_printout(packets, nts);
 
@@ -325,7 +625,7 @@ void update_packets(const int my_rank, const int nts, struct packet *packets)
   printout("end of update_packets for this rank at time %ld\n", time_update_packets_end_thisrank);
 
 #ifdef MPI_ON
-  MPI_Barrier(MPI_COMM_WORLD);  // hold all processes once the packets are updated
+  MPI_Barrier(globals::mpi_comm_model);  // hold all processes once the packets are updated
 #endif
   printout("timestep %d: time after update packets %ld (rank %d took %lds, waited %lds, total %lds)\n", nts, time(NULL),
            my_rank, time_update_packets_end_thisrank - time_update_packets_start,